@@ -1,6 +1,7 @@
 #include "Application.h"
 #include "Log.h"
 #include "Random.h"
+#include "JobSystem.h"
 #include "Renderer.h"
 
 #include <imgui.h>
@@ -90,6 +91,7 @@ void Application::Create()
 	m_Window->SetCallback(std::bind(&Application::OnEvent, this, std::placeholders::_1));
 
 	Random::Create();
+	JobSystem::Create();
 	Renderer::Create();
 	
 	// Setup Dear ImGui context
@@ -114,6 +116,7 @@ void Application::Destroy()
 	ImGui::DestroyContext();
 
 	Renderer::Destroy();
+	JobSystem::Destroy();
 	Random::Destroy();
 }
 
@@ -0,0 +1,302 @@
+#include "Arena.h"
+#include "Random.h"
+#include "JobSystem.h"
+#include "Log.h"
+
+float EvaluationSettings::Aggregate(float *scores, size_t count) const
+{
+	if (count == 0)
+	{
+		return 0.0f;
+	}
+
+	switch (Aggregation)
+	{
+	case FitnessAggregation::Min:
+		return *std::min_element(scores, scores + count);
+
+	case FitnessAggregation::Quantile:
+	{
+		std::sort(scores, scores + count);
+
+		float position = std::clamp(Quantile, 0.0f, 1.0f) * static_cast<float>(count - 1);
+		size_t lower = static_cast<size_t>(position);
+		size_t upper = std::min(lower + 1, count - 1);
+		float t = position - static_cast<float>(lower);
+
+		return scores[lower] + t * (scores[upper] - scores[lower]);
+	}
+
+	case FitnessAggregation::Mean:
+	default:
+		return std::accumulate(scores, scores + count, 0.0f) / static_cast<float>(count);
+	}
+}
+
+const char *EvaluationSettings::GetAggregationName(FitnessAggregation aggregation)
+{
+	switch (aggregation)
+	{
+	case FitnessAggregation::Mean:     return "Mean";
+	case FitnessAggregation::Min:      return "Min";
+	case FitnessAggregation::Quantile: return "Quantile";
+	default:                           return "Unknown";
+	}
+}
+
+Arena::Arena()
+	: m_Platform(nullptr)
+	, m_TerrainSeed(0)
+	, m_Finish(0.0f)
+	, m_TargetFitness(0.0f)
+	, m_DoneCount(0)
+	, m_FinishedCount(0)
+	, m_LeaderIndex(-1)
+	, m_SimulatedTime(0.0f)
+{
+}
+
+Arena::~Arena()
+{
+	if (m_Shards.empty())
+	{
+		return;
+	}
+
+	DestroyCars();
+
+	for (Shard &shard : m_Shards)
+	{
+		shard.Terrain->Destory();
+	}
+}
+
+void Arena::Create(uint32_t terrainSeed, size_t numCars)
+{
+	m_TerrainSeed = terrainSeed;
+	m_TargetFitness = 0.0f;
+	m_DoneCount = 0;
+	m_FinishedCount = 0;
+	m_LeaderIndex = -1;
+	m_SimulatedTime = 0.0f;
+
+	size_t numShards = GetShardCount(numCars);
+
+	m_Shards.resize(numShards);
+	CreateShards(0, numShards);
+
+	m_Platform = m_Shards.front().Terrain.get();
+	m_Finish = m_Platform->GetFinish();
+
+	m_Cars.resize(numCars);
+	m_CarKeys.resize(numCars);
+}
+
+void Arena::Reset(size_t numCars)
+{
+	BL_ASSERT(!m_Shards.empty(), "The arena has not been created !");
+
+	DestroyCars();
+
+	m_TargetFitness = 0.0f;
+	m_DoneCount = 0;
+	m_FinishedCount = 0;
+	m_LeaderIndex = -1;
+	m_SimulatedTime = 0.0f;
+
+	size_t numShards = GetShardCount(numCars);
+	size_t oldShards = m_Shards.size();
+
+	for (size_t i = numShards; i < oldShards; i++)
+	{
+		m_Shards[i].Terrain->Destory();
+	}
+
+	m_Shards.resize(numShards);
+	if (numShards > oldShards)
+	{
+		CreateShards(oldShards, numShards);
+	}
+
+	for (Shard &shard : m_Shards)
+	{
+		shard.Controllers = ControllerBatch();
+		shard.DoneCount = 0;
+		shard.FinishedCount = 0;
+		shard.LeaderIndex = -1;
+		shard.LeaderX = 0.0f;
+	}
+
+	m_Cars.assign(numCars, Car());
+	m_CarKeys.assign(numCars, 0);
+}
+
+void Arena::CreateShards(size_t first, size_t last)
+{
+	JobSystem::ParallelFor(last - first, 1, [this, first](size_t begin, size_t end)
+	{
+		for (size_t i = first + begin; i < first + end; i++)
+		{
+			Shard &shard = m_Shards[i];
+			shard.World = std::make_unique<b2World>(ArenaConstants::kGravity);
+
+			shard.Terrain = std::make_unique<Platform>();
+			shard.Terrain->Create(*shard.World, ArenaConstants::kPlatformCount, m_TerrainSeed);
+		}
+	});
+}
+
+void Arena::DestroyCars()
+{
+	for (Car &car : m_Cars)
+	{
+		if (car.IsSimulated() || car.IsCached())
+		{
+			car.Destory();
+		}
+	}
+}
+
+size_t Arena::GetShardCount(size_t numCars)
+{
+	return std::max<size_t>((numCars + ArenaConstants::kCarsPerWorld - 1) / ArenaConstants::kCarsPerWorld, 1);
+}
+
+void Arena::Step(float delta, const KillRules &rules)
+{
+	m_SimulatedTime += delta;
+
+	JobSystem::ParallelFor(m_Shards.size(), 1, [this, delta, &rules](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			StepShard(i, delta, rules);
+		}
+	});
+
+	m_DoneCount = 0;
+	m_FinishedCount = 0;
+	m_LeaderIndex = -1;
+
+	float leaderX = 0.0f;
+	for (const Shard &shard : m_Shards)
+	{
+		m_DoneCount += shard.DoneCount;
+		m_FinishedCount += shard.FinishedCount;
+
+		if (shard.LeaderIndex >= 0 && shard.LeaderX > leaderX)
+		{
+			leaderX = shard.LeaderX;
+			m_LeaderIndex = shard.LeaderIndex;
+		}
+	}
+}
+
+void Arena::StepShard(size_t shardIndex, float delta, const KillRules &rules)
+{
+	Shard &shard = m_Shards[shardIndex];
+
+	UpdateShardControllers(shardIndex);
+
+	shard.World->Step(delta, ArenaConstants::kVelocityIterations, ArenaConstants::kPositionIterations);
+
+	size_t begin = shardIndex * ArenaConstants::kCarsPerWorld;
+	size_t end = std::min(begin + ArenaConstants::kCarsPerWorld, m_Cars.size());
+
+	shard.DoneCount = 0;
+	shard.FinishedCount = 0;
+	shard.LeaderIndex = -1;
+	shard.LeaderX = 0.0f;
+
+	for (size_t i = begin; i < end; i++)
+	{
+		Car &car = m_Cars[i];
+
+		car.Update(delta);
+
+		if (!car.IsDead() && car.IsSimulated())
+		{
+			car.TrackBehaviour(delta, m_Platform->SampleHeight(car.GetPosition().x));
+			car.ApplyKillRules(rules, delta, m_Platform->GetFloor(car.GetPosition().x), m_Finish, m_TargetFitness);
+		}
+
+		if (car.IsDead() || car.IsCached())
+		{
+			shard.DoneCount++;
+		}
+
+		// A cached car would have died on the step its run's time is reached
+		if (car.IsDead() || (car.IsCached() && m_SimulatedTime >= car.GetCachedTime()))
+		{
+			shard.FinishedCount++;
+		}
+
+		if (!car.IsDead() && car.GetPosition().x > shard.LeaderX)
+		{
+			shard.LeaderX = car.GetPosition().x;
+			shard.LeaderIndex = static_cast<int>(i);
+		}
+	}
+}
+
+void Arena::UpdateControllers()
+{
+	JobSystem::ParallelFor(m_Shards.size(), 1, [this](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			UpdateShardControllers(i);
+		}
+	});
+}
+
+void Arena::UpdateShardControllers(size_t shardIndex)
+{
+	Shard &shard = m_Shards[shardIndex];
+
+	if (!shard.Controllers.IsCreated())
+	{
+		size_t begin = shardIndex * ArenaConstants::kCarsPerWorld;
+		size_t end = std::min(begin + ArenaConstants::kCarsPerWorld, m_Cars.size());
+
+		shard.Controllers.Create(m_Cars.data() + begin, end - begin);
+	}
+
+	shard.Controllers.Update(*shard.Terrain);
+}
+
+void Arena::CutOff()
+{
+	for (Car &car : m_Cars)
+	{
+		car.CutOff();
+	}
+
+	m_DoneCount = m_Cars.size();
+	m_FinishedCount = m_Cars.size();
+	m_LeaderIndex = -1;
+}
+
+void Arena::DrawPlatform(DrawList &drawList) const
+{
+	m_Platform->Draw(drawList);
+}
+
+void Arena::DrawCars(DrawList &drawList, size_t begin, size_t end) const
+{
+	for (size_t i = begin; i < end && i < m_Cars.size(); i++)
+	{
+		m_Cars[i].Draw(drawList);
+	}
+}
+
+uint32_t Arena::MakeTerrainSeed(uint32_t baseSeed, int terrainIndex)
+{
+	if (terrainIndex == 0)
+	{
+		return baseSeed;
+	}
+
+	// Never zero, which means a random terrain
+	return static_cast<uint32_t>(RandomStream::MakeKey(baseSeed, static_cast<uint64_t>(terrainIndex))) | 1u;
+}
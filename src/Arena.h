@@ -0,0 +1,159 @@
+#pragma once
+
+#include "Car.h"
+#include "Platform.h"
+#include "FitnessCache.h"
+#include "Controller.h"
+
+#include <box2d/box2d.h>
+
+namespace ArenaConstants
+{
+	static constexpr int kPlatformCount = 1024;
+
+	static constexpr int kVelocityIterations = 6;
+	static constexpr int kPositionIterations = 2;
+
+	static const b2Vec2 kGravity = { 0.0f, -10.0f };
+
+	// Cars of an arena are split over worlds of at most this many, see Arena
+	static constexpr size_t kCarsPerWorld = 256;
+}
+
+enum class FitnessAggregation
+{
+	Mean = 0,
+	Min,
+	Quantile,
+
+	Count
+};
+
+// How the fitness of a genome is worked out
+struct EvaluationSettings
+{
+	// Every genome is simulated on this many terrains, each in its own arena
+	int TerrainCount = 1;
+
+	FitnessAggregation Aggregation = FitnessAggregation::Mean;
+
+	// Used by the quantile aggregation, e.g. 0.25 scores a genome by how it
+	// does on the worst quarter of the terrains.
+	float Quantile = 0.25f;
+
+	// Reorders the scores
+	float Aggregate(float *scores, size_t count) const;
+
+	static const char *GetAggregationName(FitnessAggregation aggregation);
+};
+
+// One terrain which every genome of a generation is simulated on. Arenas
+// share nothing, so each can be stepped on its own thread.
+//
+// Cars only collide with the terrain, but the broad phase still pairs every
+// car with every other one its box overlaps, and they all start in the same
+// place. A large population is therefore split over several worlds with a
+// copy of the terrain each, which keeps a step linear in the number of cars
+// and lets the worlds be stepped as separate jobs.
+class Arena
+{
+public:
+	Arena();
+	~Arena();
+
+	void Create(uint32_t terrainSeed, size_t numCars);
+
+	// Destroys the cars and makes room for numCars new ones on the same
+	// terrain. The worlds and their terrain are kept, only as many are built
+	// or dropped as the new number of cars needs. Box2D hands the proxies of
+	// the old cars out again, so a reused world is not bit for bit the same
+	// as a new one.
+	void Reset(size_t numCars);
+
+	void Step(float delta, const KillRules &rules);
+	// Only reads the bodies, so ranges of cars can be drawn on several
+	// threads while the world is not being stepped
+	void DrawPlatform(DrawList &drawList) const;
+	void DrawCars(DrawList &drawList, size_t begin, size_t end) const;
+
+	// Sets the motor speeds of the controlled cars, done at the start of
+	// every step. The batches are gathered on the first call, once the cars
+	// have been created.
+	void UpdateControllers();
+
+	// The world a car is simulated in
+	inline b2World &GetWorld(size_t carIndex) { return *m_Shards[carIndex / ArenaConstants::kCarsPerWorld].World; }
+	inline size_t GetWorldCount() const { return m_Shards.size(); }
+	inline uint32_t GetTerrainSeed() const { return m_TerrainSeed; }
+	inline float GetFinish() const { return m_Finish; }
+	inline const Platform &GetPlatform() const { return *m_Platform; }
+
+	inline size_t GetNumCars() const { return m_Cars.size(); }
+	inline Car &GetCar(size_t index) { return m_Cars[index]; }
+	inline const Car &GetCar(size_t index) const { return m_Cars[index]; }
+
+	// Furthest car which is still running as of the last step, -1 if none
+	// has moved forward yet
+	inline int GetLeaderIndex() const { return m_LeaderIndex; }
+
+	inline FitnessCache::Key GetCarKey(size_t index) const { return m_CarKeys[index]; }
+	inline void SetCarKey(size_t index, FitnessCache::Key key) { m_CarKeys[index] = key; }
+
+	// Fitness below which the lagging kill rule applies, the median of the
+	// previous generation on this terrain.
+	inline float GetTargetFitness() const { return m_TargetFitness; }
+	inline void SetTargetFitness(float fitness) { m_TargetFitness = fitness; }
+
+	// Every car is dead, or its fitness was already known
+	inline bool IsDone() const { return m_DoneCount == m_Cars.size(); }
+	inline size_t GetDoneCount() const { return m_DoneCount; }
+
+	// Cars which are dead, or cached and simulated for as long as their run
+	// lasted, so as many as would be dead by now without the fitness cache
+	inline size_t GetFinishedCount() const { return m_FinishedCount; }
+
+	// Stops every car which is still running
+	void CutOff();
+
+	// The first terrain is the run's own, the others are derived from it
+	static uint32_t MakeTerrainSeed(uint32_t baseSeed, int terrainIndex);
+
+private:
+	struct Shard
+	{
+		std::unique_ptr<b2World> World;
+		std::unique_ptr<Platform> Terrain;
+		ControllerBatch Controllers;
+
+		size_t DoneCount = 0;
+		size_t FinishedCount = 0;
+		int LeaderIndex = -1;
+		float LeaderX = 0.0f;
+	};
+
+	void CreateShards(size_t first, size_t last);
+	void DestroyCars();
+	void StepShard(size_t shardIndex, float delta, const KillRules &rules);
+	void UpdateShardControllers(size_t shardIndex);
+
+	static size_t GetShardCount(size_t numCars);
+
+private:
+	// The first shard's terrain is also the one drawn and asked for the floor
+	std::vector<Shard> m_Shards;
+	Platform *m_Platform;
+
+	// Never resized after Create, the bodies of a car stay where they are
+	std::vector<Car> m_Cars;
+	std::vector<FitnessCache::Key> m_CarKeys;
+
+	uint32_t m_TerrainSeed;
+	float m_Finish;
+	float m_TargetFitness;
+	size_t m_DoneCount;
+	size_t m_FinishedCount;
+	int m_LeaderIndex;
+
+	// Summed step by step as each car sums its own
+	float m_SimulatedTime;
+};
@@ -0,0 +1,168 @@
+#include "Benchmark.h"
+#include "BenchmarkUtils.h"
+#include "FitnessCache.h"
+#include "Random.h"
+
+#include <cstring>
+
+int Benchmark::Run(int argc, char **argv)
+{
+	if (argc < 1)
+	{
+		fprintf(stdout, "Usage: Blobolution --bench <selection|breeding|trajectory|turnover|jobs|draw|population|controllers|surrogate|novelty|optimizer|server|replay> [args...]\n");
+		return 1;
+	}
+
+	const char *name = argv[0];
+
+	if (std::strcmp(name, "selection") == 0)
+	{
+		return RunSelection(argc - 1, argv + 1);
+	}
+
+	if (std::strcmp(name, "breeding") == 0)
+	{
+		return RunBreeding(argc - 1, argv + 1);
+	}
+
+	if (std::strcmp(name, "trajectory") == 0)
+	{
+		return RunTrajectory(argc - 1, argv + 1);
+	}
+
+	if (std::strcmp(name, "turnover") == 0)
+	{
+		return RunTurnover(argc - 1, argv + 1);
+	}
+
+	if (std::strcmp(name, "jobs") == 0)
+	{
+		return RunJobs(argc - 1, argv + 1);
+	}
+
+	if (std::strcmp(name, "draw") == 0)
+	{
+		return RunDraw(argc - 1, argv + 1);
+	}
+
+	if (std::strcmp(name, "population") == 0)
+	{
+		return RunPopulation(argc - 1, argv + 1);
+	}
+
+	if (std::strcmp(name, "controllers") == 0)
+	{
+		return RunControllers(argc - 1, argv + 1);
+	}
+
+	if (std::strcmp(name, "surrogate") == 0)
+	{
+		return RunSurrogate(argc - 1, argv + 1);
+	}
+
+	if (std::strcmp(name, "novelty") == 0)
+	{
+		return RunNovelty(argc - 1, argv + 1);
+	}
+
+	if (std::strcmp(name, "optimizer") == 0)
+	{
+		return RunOptimizer(argc - 1, argv + 1);
+	}
+
+	if (std::strcmp(name, "server") == 0)
+	{
+		return RunServer(argc - 1, argv + 1);
+	}
+
+	if (std::strcmp(name, "replay") == 0)
+	{
+		return RunReplay(argc - 1, argv + 1);
+	}
+
+	fprintf(stdout, "Unknown benchmark '%s'\n", name);
+	return 1;
+}
+
+GenerationSettings Benchmark::MakeSettings(int numCars)
+{
+	GenerationSettings settings;
+	settings.NumCars = numCars;
+	settings.TerrainSeed = kSeed;
+	settings.UseFitnessCache = false;
+
+	return settings;
+}
+
+void Benchmark::CreateGeneration(Generation &generation, const GenerationSettings &settings, uint32_t seed)
+{
+	Random::Seed(seed);
+	generation.Create(settings);
+}
+
+double Benchmark::TimeSteps(Generation &generation, int numSteps)
+{
+	Clock::time_point start = Clock::now();
+	for (int step = 0; step < numSteps; step++)
+	{
+		generation.Update(k_UpdateDeltaTime);
+	}
+
+	return ElapsedSeconds(start) / static_cast<double>(std::max(numSteps, 1));
+}
+
+Benchmark::Convergence Benchmark::RunToTarget(Generation &generation, int targetFitness, int maxGenerations)
+{
+	Convergence result;
+
+	Clock::time_point start = Clock::now();
+	int steps = 0;
+
+	while (generation.GetGenerationIndex() < maxGenerations && !result.Reached)
+	{
+		int generationIndex = generation.GetGenerationIndex();
+
+		generation.Update(k_UpdateDeltaTime);
+
+		if (generation.GetGenerationIndex() != generationIndex)
+		{
+			result.Best = generation.GetBestFitnessHistory().back();
+			result.Reached = result.Best >= static_cast<float>(targetFitness);
+			steps = 0;
+		}
+		else if (++steps > kMaxStepsPerGeneration)
+		{
+			result.Stalled = true;
+			break;
+		}
+	}
+
+	result.Seconds = ElapsedSeconds(start);
+
+	return result;
+}
+
+bool Benchmark::RunGenerations(Generation &generation, int last, std::vector<uint64_t> &checksums)
+{
+	int steps = 0;
+
+	while (generation.GetGenerationIndex() <= last)
+	{
+		int generationIndex = generation.GetGenerationIndex();
+
+		generation.Update(k_UpdateDeltaTime);
+
+		if (generation.GetGenerationIndex() != generationIndex)
+		{
+			const std::vector<float> &fitness = generation.GetLastFitness();
+			checksums.push_back(FitnessCache::HashBytes(fitness.data(), fitness.size() * sizeof(float)));
+			steps = 0;
+		}
+		else if (++steps > kMaxStepsPerGeneration)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+// Headless benchmarks, run with `Blobolution --bench <name> [args...]`. Each
+// returns non-zero when what it measured fails a check, e.g. a generation
+// which stalls or results which differ between thread counts.
+namespace Benchmark
+{
+	int Run(int argc, char **argv);
+
+	// Generations and wall-clock time for each selection strategy to reach a
+	// target fitness on a fixed terrain seed.
+	int RunSelection(int argc, char **argv);
+
+	// Time to breed a whole generation at increasing population sizes, one car
+	// at a time with a draw for every branch as before RandomStream, and with
+	// the Breeder
+	int RunBreeding(int argc, char **argv);
+
+	// Cost of recording every car's trajectory as a share of step time
+	int RunTrajectory(int argc, char **argv);
+
+	// Pause at generation turnover with breeding after the last car and with
+	// breeding overlapped with the tail of the generation.
+	int RunTurnover(int argc, char **argv);
+
+	// Step and breeding time with the job system at every thread count from
+	// one up to a thread per core.
+	int RunJobs(int argc, char **argv);
+
+	// CPU time to build the draw lists of a large population, from one thread
+	// up to a thread per core
+	int RunDraw(int argc, char **argv);
+
+	// Steps per second and turnover time against population size
+	int RunPopulation(int argc, char **argv);
+
+	// Generations and wall-clock time to reach a target fitness with and
+	// without screening offspring by the fitness surrogate
+	int RunSurrogate(int argc, char **argv);
+
+	// Indexing and scoring time of the novelty archive as it grows, against
+	// scoring by a scan of the whole archive
+	int RunNovelty(int argc, char **argv);
+
+	// Generations, simulated cars and wall-clock time for the genetic
+	// algorithm and CMA-ES to reach a target fitness on a fixed terrain seed
+	int RunOptimizer(int argc, char **argv);
+
+	// Round trips of the evaluation server at increasing batch sizes, and
+	// the time the protocol adds to each genome. Starts a server of its own
+	// over pipes unless given the socket of a running one.
+	int RunServer(int argc, char **argv);
+
+	// Time spent in the wheel controllers and sampling the terrain under
+	// them, as a share of the physics step. Fails over the 10% target.
+	int RunControllers(int argc, char **argv);
+
+	// How many generations of a logged run give the same fitness checksum
+	// when each is rerun from the log on its own
+	int RunReplay(int argc, char **argv);
+}
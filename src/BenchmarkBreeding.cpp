@@ -0,0 +1,238 @@
+#include "Benchmark.h"
+#include "BenchmarkUtils.h"
+
+#include <cstring>
+
+// The generator breeding drew from before RandomStream, a shared mt19937
+class LegacyRandom
+{
+public:
+	LegacyRandom(uint32_t seed)
+		: m_Generator(seed)
+	{
+	}
+
+	bool Bool()
+	{
+		return Float(0.0f, 1.0f) < 0.5f;
+	}
+
+	template<typename I>
+	I Int(I min, I max)
+	{
+		if (min >= max)
+		{
+			return min;
+		}
+
+		return min + static_cast<I>(static_cast<I>(m_Distribution(m_Generator) % std::numeric_limits<I>::max()) % ((max + 1) - min));
+	}
+
+	float Float(float min, float max)
+	{
+		if (min >= max)
+		{
+			return min;
+		}
+
+		return min + (  static_cast<float>(m_Distribution(m_Generator))
+		              / static_cast<float>(std::numeric_limits<uint32_t>::max())) * (max - min);
+	}
+
+private:
+	std::mt19937 m_Generator;
+	std::uniform_int_distribution<uint32_t> m_Distribution;
+};
+
+// Breeding as it was done before the Breeder, one car at a time with a
+// branch and a draw for every gene. The odds and ranges are the Breeder's.
+template<typename R>
+static float MixRatio(R &random)
+{
+	float mixRatio =   std::log(random.Float(0.0f, 1000.0f) + 1.0f)
+	                 / std::log(1000.0f + 1.0f);
+
+	return random.Bool() ? 1.0f - mixRatio : mixRatio;
+}
+
+template<typename R>
+static void MutateGene(float &value, R &random, float amountMin, float amountMax, float min, float max, bool clamp)
+{
+	if (random.Bool())
+	{
+		value += random.Float(amountMin, amountMax);
+
+		if (clamp)
+		{
+			value = std::min(std::max(value, min), max);
+		}
+	}
+}
+
+template<typename R>
+static void BreedOneByOne(const std::vector<CarProto> &parents,
+                          const std::vector<uint32_t> &parents1,
+                          const std::vector<uint32_t> &parents2,
+                          std::vector<CarProto> &children,
+                          R &random)
+{
+	children.resize(parents1.size());
+
+	for (size_t c = 0; c < children.size(); c++)
+	{
+		CarProto &child = children[c];
+
+		const CarProto &parent1 = parents[parents1[c]];
+		const CarProto &parent2 = parents[parents2[c]];
+
+		float mix = MixRatio(random);
+		child.Density = parent1.Density * mix + parent2.Density * (1.0f - mix);
+		MutateGene(child.Density, random, 0.5f, 2.0f, CarConstants::kMinChassisDensity, CarConstants::kMaxChassisDensity, true);
+
+		mix = MixRatio(random);
+		child.Friction = parent1.Friction * mix + parent2.Friction * (1.0f - mix);
+		MutateGene(child.Friction, random, 0.05f, 0.3f, 0.1f, 1.0f, true);
+
+		mix = MixRatio(random);
+		child.Restitution = parent1.Restitution * mix + parent2.Restitution * (1.0f - mix);
+		MutateGene(child.Restitution, random, 0.5f, 2.0f, 0.1f, 1.0f, true);
+
+		for (size_t j = 0; j < CarConstants::kNumVertices; j++)
+		{
+			child.Vertices[j] = random.Bool() ? parent1.Vertices[j] : parent2.Vertices[j];
+
+			if (random.Bool())
+			{
+				child.Vertices[j].x = std::min(child.Vertices[j].x + random.Float(0.5f, 2.0f), CarConstants::kMaxVertexExtent);
+				child.Vertices[j].y = std::min(child.Vertices[j].y + random.Float(0.5f, 2.0f), CarConstants::kMaxVertexExtent);
+			}
+		}
+
+		child.WheelCount = random.Bool() ? parent1.WheelCount : parent2.WheelCount;
+
+		size_t minWheelCount = std::min(parent1.WheelCount, parent2.WheelCount);
+		size_t maxIndex = minWheelCount == 0 ? 0 : minWheelCount - 1;
+
+		auto breedWheelGene = [&](size_t i, float WheelProto::*gene, float min, float max, bool clamp)
+		{
+			float &value = child.Wheels[i].*gene;
+
+			if (i >= minWheelCount)
+			{
+				const CarProto &parent = random.Bool() ? parent1 : parent2;
+				value = parent.Wheels[random.Int(0_zu, maxIndex)].*gene;
+			}
+			else
+			{
+				float wheelMix = MixRatio(random);
+				value = parent1.Wheels[i].*gene * wheelMix + parent2.Wheels[i].*gene * (1.0f - wheelMix);
+			}
+
+			MutateGene(value, random, 0.5f, 2.0f, min, max, clamp);
+		};
+
+		for (size_t i = 0; i < child.WheelCount; i++)
+		{
+			breedWheelGene(i, &WheelProto::Density, CarConstants::kMinWheelDensity, CarConstants::kMaxWheelDensity, true);
+			breedWheelGene(i, &WheelProto::Friction, 0.1f, 1.0f, true);
+			breedWheelGene(i, &WheelProto::Restitution, 0.1f, 1.0f, true);
+			breedWheelGene(i, &WheelProto::Radius, CarConstants::kMinWheelRadius, CarConstants::kMaxWheelRadius, true);
+			breedWheelGene(i, &WheelProto::MotorSpeed, -CarConstants::kMaxWheelMotorSpeed, -CarConstants::kMinWheelMotorSpeed, true);
+
+			const CarProto &parent = random.Bool() ? parent1 : parent2;
+			int vertex = parent.WheelVertices[random.Int(0_zu, maxIndex)];
+
+			if (random.Bool())
+			{
+				vertex = std::clamp(vertex + random.Int(-1, 1), 0, static_cast<int>(CarConstants::kNumVertices) - 1);
+			}
+
+			child.WheelVertices[i] = static_cast<CarProto::VertexIndex>(vertex);
+		}
+	}
+}
+
+int Benchmark::RunBreeding(int argc, char **argv)
+{
+	// [largest population] [repeats]
+	int maxCars = ArgInt(argc, argv, 0, 100000);
+	int repeats = ArgInt(argc, argv, 1, 5);
+
+	// One car at a time as before the Breeder, with the mt19937 it drew from
+	// then and with the stream the Breeder draws from, against the Breeder
+	fprintf(stdout, "Breeding on %zu job system workers, speedup of the Breeder over one car at a time with mt19937\n",
+		JobSystem::GetWorkerCount());
+	fprintf(stdout, "%-12s %12s %12s %12s %12s %10s\n", "Cars", "mt19937 ms", "Per car ms", "Breeder ms", "ns / child", "Speedup");
+
+	int failed = 0;
+
+	for (int numCars = 1000; numCars <= maxCars; numCars *= 10)
+	{
+		std::vector<CarProto> parentProtos(numCars), childProtos;
+		GenomeBatch parents, children;
+		parents.Resize(numCars);
+		RandomStream protoRandom = Random::MakeStream(Random::kPopulationStream);
+		for (int i = 0; i < numCars; i++)
+		{
+			parentProtos[i] = Car::RandomProto(protoRandom);
+			parents.Set(i, parentProtos[i]);
+		}
+
+		std::vector<uint32_t> parents1(numCars), parents2(numCars);
+		for (int i = 0; i < numCars; i++)
+		{
+			parents1[i] = protoRandom.Int(0u, static_cast<uint32_t>(numCars - 1));
+			parents2[i] = protoRandom.Int(0u, static_cast<uint32_t>(numCars - 1));
+		}
+
+		// Each is run once first, so none pays for first touching its children
+		auto time = [repeats](const std::function<void()> &breed)
+		{
+			breed();
+
+			Clock::time_point start = Clock::now();
+			for (int r = 0; r < repeats; r++)
+			{
+				breed();
+			}
+
+			return ElapsedSeconds(start) / static_cast<double>(repeats);
+		};
+
+		LegacyRandom legacyRandom(kSeed);
+		RandomStream random = Random::MakeStream(Random::kGenerationStream);
+		Breeder breeder;
+
+		double legacySeconds = time([&]() { BreedOneByOne(parentProtos, parents1, parents2, childProtos, legacyRandom); });
+		double perCarSeconds = time([&]() { BreedOneByOne(parentProtos, parents1, parents2, childProtos, random); });
+		double seconds = time([&]() { breeder.Breed(parents, parents1, parents2, children, random); });
+
+		fprintf(stdout, "%-12d %12.3f %12.3f %12.3f %12.1f %9.1fx\n", numCars, legacySeconds * 1e3, perCarSeconds * 1e3,
+			seconds * 1e3, seconds * 1e9 / numCars, legacySeconds / seconds);
+
+		// The same draws breed the same children, and every child is a car
+		// the evaluation server would build
+		RandomStream again = random;
+		GenomeBatch first, second;
+		breeder.Breed(parents, parents1, parents2, first, random);
+		breeder.Breed(parents, parents1, parents2, second, again);
+
+		if (std::memcmp(first.Genomes.data(), second.Genomes.data(), first.Genomes.size() * sizeof(CarProto)) != 0)
+		{
+			fprintf(stdout, "Breeding %d cars twice from the same draws gave different children\n", numCars);
+			failed++;
+		}
+
+		size_t numInvalid = static_cast<size_t>(std::count_if(first.Genomes.begin(), first.Genomes.end(),
+			[](const CarProto &carProto) { return !Car::IsValidProto(carProto); }));
+
+		if (numInvalid > 0)
+		{
+			fprintf(stdout, "%zu of %d children are not valid cars\n", numInvalid, numCars);
+			failed++;
+		}
+	}
+
+	return failed > 0 ? 1 : 0;
+}
+
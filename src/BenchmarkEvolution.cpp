@@ -0,0 +1,287 @@
+#include "Benchmark.h"
+#include "BenchmarkUtils.h"
+#include "Log.h"
+
+#include <filesystem>
+
+// How far a run gets towards a target fitness, and how it is replayed
+
+// [target fitness] [max generations] [terrain seed] [number of cars]
+struct ConvergenceArgs
+{
+	int TargetFitness;
+	int MaxGenerations;
+	int Seed;
+	int NumCars;
+
+	ConvergenceArgs(int argc, char **argv)
+		: TargetFitness(Benchmark::ArgInt(argc, argv, 0, 500))
+		, MaxGenerations(Benchmark::ArgInt(argc, argv, 1, 100))
+		, Seed(Benchmark::ArgInt(argc, argv, 2, Benchmark::kSeed))
+		, NumCars(Benchmark::ArgInt(argc, argv, 3, 50))
+	{
+	}
+};
+
+// Settings for the convergence benchmarks, which breed with the fitness
+// cache as a run would and draw their terrain from the seed
+static GenerationSettings MakeConvergenceSettings(const ConvergenceArgs &args)
+{
+	GenerationSettings settings;
+	settings.NumCars = args.NumCars;
+
+	return settings;
+}
+
+static const char *GetOutcome(const Benchmark::Convergence &result)
+{
+	return result.Stalled ? " (a generation stalled)" : result.Reached ? "" : " (target not reached)";
+}
+
+int Benchmark::RunSelection(int argc, char **argv)
+{
+	ConvergenceArgs args(argc, argv);
+
+	fprintf(stdout, "Selection convergence, target %d, seed %d, %d cars, at most %d generations\n",
+		args.TargetFitness, args.Seed, args.NumCars, args.MaxGenerations);
+	fprintf(stdout, "%-12s %12s %12s %14s\n", "Strategy", "Generations", "Best", "Seconds");
+
+	int failed = 0;
+
+	for (int type = 0; type < static_cast<int>(SelectionType::Count); type++)
+	{
+		GenerationSettings settings = MakeConvergenceSettings(args);
+		settings.Selection.Type = static_cast<SelectionType>(type);
+
+		// Same terrain and starting population for every strategy
+		Generation generation;
+		CreateGeneration(generation, settings, static_cast<uint32_t>(args.Seed));
+
+		Convergence result = RunToTarget(generation, args.TargetFitness, args.MaxGenerations);
+		failed += result.Stalled ? 1 : 0;
+
+		fprintf(stdout, "%-12s %12d %12.0f %14.3f%s\n", Selection::GetTypeName(settings.Selection.Type),
+			generation.GetGenerationIndex(), result.Best, result.Seconds, GetOutcome(result));
+	}
+
+	return failed > 0 ? 1 : 0;
+}
+
+int Benchmark::RunSurrogate(int argc, char **argv)
+{
+	// [target fitness] [max generations] [terrain seed] [number of cars] [pool factor]
+	ConvergenceArgs args(argc, argv);
+	int poolFactor = ArgInt(argc, argv, 4, 4);
+
+	fprintf(stdout, "Surrogate screening, target %d, seed %d, %d cars, pool factor %d, at most %d generations\n",
+		args.TargetFitness, args.Seed, args.NumCars, poolFactor, args.MaxGenerations);
+	fprintf(stdout, "%-12s %12s %12s %14s\n", "Surrogate", "Generations", "Best", "Seconds");
+
+	int failed = 0;
+
+	for (bool enabled : { false, true })
+	{
+		GenerationSettings settings = MakeConvergenceSettings(args);
+		settings.Surrogate.Enabled = enabled;
+		settings.Surrogate.PoolFactor = poolFactor;
+
+		// Same terrain and starting population either way
+		Generation generation;
+		CreateGeneration(generation, settings, static_cast<uint32_t>(args.Seed));
+
+		Convergence result = RunToTarget(generation, args.TargetFitness, args.MaxGenerations);
+		failed += result.Stalled ? 1 : 0;
+
+		fprintf(stdout, "%-12s %12d %12.0f %14.3f%s\n", enabled ? "On" : "Off",
+			generation.GetGenerationIndex(), result.Best, result.Seconds, GetOutcome(result));
+	}
+
+	return failed > 0 ? 1 : 0;
+}
+
+int Benchmark::RunOptimizer(int argc, char **argv)
+{
+	ConvergenceArgs args(argc, argv);
+
+	fprintf(stdout, "Optimizer convergence, target %d, seed %d, %d cars, at most %d generations\n",
+		args.TargetFitness, args.Seed, args.NumCars, args.MaxGenerations);
+	fprintf(stdout, "%-12s %12s %12s %12s %14s\n", "Optimizer", "Generations", "Evaluations", "Best", "Seconds");
+
+	int failed = 0;
+
+	for (int type = 0; type < static_cast<int>(OptimizerType::Count); type++)
+	{
+		GenerationSettings settings = MakeConvergenceSettings(args);
+		settings.Optimizer.Type = static_cast<OptimizerType>(type);
+
+		// Same terrain and starting population for every optimizer
+		Generation generation;
+		CreateGeneration(generation, settings, static_cast<uint32_t>(args.Seed));
+
+		Convergence result = RunToTarget(generation, args.TargetFitness, args.MaxGenerations);
+		failed += result.Stalled ? 1 : 0;
+
+		// Cars the fitness cache answered for were not simulated
+		unsigned long long evaluations = generation.GetTotalSimulatedCars();
+
+		fprintf(stdout, "%-12s %12d %12llu %12.0f %14.3f%s\n", Optimizer::GetTypeName(settings.Optimizer.Type),
+			generation.GetGenerationIndex(), evaluations, result.Best, result.Seconds, GetOutcome(result));
+	}
+
+	return failed > 0 ? 1 : 0;
+}
+
+int Benchmark::RunNovelty(int argc, char **argv)
+{
+	// [largest archive] [behaviours per generation]
+	int maxSize = ArgInt(argc, argv, 0, 1000000);
+	int batchSize = ArgInt(argc, argv, 1, 10000);
+
+	static constexpr size_t kBruteForceQueries = 100;
+
+	NoveltySettings settings;
+	settings.MaxArchiveSize = maxSize;
+
+	RandomStream random = Random::MakeStream(Random::kPopulationStream, 0);
+
+	// Spread like a population's, most cars end early and few get far
+	auto makeBehaviours = [&](std::vector<CarBehaviour> &behaviours)
+	{
+		for (CarBehaviour &behaviour : behaviours)
+		{
+			float progress = random.Float(0.0f, 1.0f);
+			behaviour.FinalX = 2000.0f * progress * progress * progress;
+			behaviour.MaxHeight = random.Float(0.0f, 10.0f);
+			behaviour.AirTime = random.Float(0.0f, 5.0f) * progress;
+		}
+	};
+
+	fprintf(stdout, "Novelty archive growing by %d behaviours a generation, %d neighbours\n", batchSize, settings.Neighbours);
+	fprintf(stdout, "%-12s %10s %12s %14s %14s\n", "Archive", "Cells", "Index ms", "Score us", "Scan us");
+
+	NoveltyArchive archive;
+	std::vector<CarBehaviour> behaviours(static_cast<size_t>(batchSize));
+	std::vector<CarBehaviour> archived;
+	std::vector<float> novelty;
+
+	size_t nextReport = static_cast<size_t>(batchSize);
+
+	while (archive.GetSize() + behaviours.size() <= static_cast<size_t>(maxSize))
+	{
+		makeBehaviours(behaviours);
+		archive.AddAndScore(behaviours, settings, novelty);
+		archived.insert(archived.end(), behaviours.begin(), behaviours.end());
+
+		if (archive.GetSize() < nextReport)
+		{
+			continue;
+		}
+		nextReport *= 2;
+
+		// What each score would cost without the grid, a scan of every
+		// archived behaviour
+		Clock::time_point start = Clock::now();
+		float sink = 0.0f;
+		std::vector<float> distances(archived.size());
+		for (size_t q = 0; q < kBruteForceQueries; q++)
+		{
+			const CarBehaviour &query = behaviours[q % behaviours.size()];
+
+			for (size_t i = 0; i < archived.size(); i++)
+			{
+				float dx = archived[i].FinalX - query.FinalX;
+				float dy = archived[i].MaxHeight - query.MaxHeight;
+				float dz = (archived[i].AirTime - query.AirTime) * 10.0f;
+
+				distances[i] = std::sqrt(dx * dx + dy * dy + dz * dz);
+			}
+
+			size_t k = std::min(static_cast<size_t>(settings.Neighbours), distances.size() - 1);
+			std::nth_element(distances.begin(), distances.begin() + k, distances.end());
+			sink += distances[k];
+		}
+		double scanSeconds = ElapsedSeconds(start) / static_cast<double>(kBruteForceQueries);
+
+		const NoveltyStats &stats = archive.GetStats();
+
+		fprintf(stdout, "%-12zu %10zu %12.3f %14.3f %14.3f%s\n", stats.ArchiveSize, stats.CellCount,
+			stats.IndexSeconds * 1e3f, stats.QuerySeconds * 1e6f / static_cast<float>(behaviours.size()),
+			scanSeconds * 1e6, sink < 0.0f ? "!" : "");
+	}
+
+	return 0;
+}
+
+int Benchmark::RunReplay(int argc, char **argv)
+{
+	// [number of cars] [generations]
+	int numCars = ArgInt(argc, argv, 0, 100);
+	int numGenerations = ArgInt(argc, argv, 1, 5);
+
+	std::string logPath = (std::filesystem::temp_directory_path() / "blobolution_replay_bench.bllog").string();
+
+	// The fitness cache and breed quorum are asked for, a logged run has to
+	// turn them off itself
+	struct Config
+	{
+		const char *Name;
+		bool KillLagging;
+		float BreedQuorum;
+	};
+
+	fprintf(stdout, "Run log replay, %d cars, %d generations, each rerun on its own\n", numCars, numGenerations);
+	fprintf(stdout, "%-16s %14s %14s\n", "Run", "Generations", "Exact");
+
+	int failed = 0;
+
+	for (const Config &config : { Config{ "Plain", false, 1.0f }, Config{ "Lagging rule", true, 1.0f },
+	                              Config{ "Breed quorum", false, 0.9f } })
+	{
+		GenerationSettings settings = MakeSettings(numCars);
+		settings.UseFitnessCache = true;
+		settings.BreedQuorum = config.BreedQuorum;
+		settings.Kill.KillLagging = config.KillLagging;
+		settings.RunLogPath = logPath;
+
+		std::vector<uint64_t> logged;
+		{
+			Generation generation;
+			CreateGeneration(generation, settings);
+
+			if (!RunGenerations(generation, numGenerations - 1, logged))
+			{
+				fprintf(stdout, "%-16s did not finish a generation in %d steps\n", config.Name, kMaxStepsPerGeneration);
+				failed++;
+				continue;
+			}
+		}
+
+		int exact = 0;
+		for (int g = 0; g < numGenerations; g++)
+		{
+			GenerationSettings replaySettings = settings;
+			replaySettings.RunLogPath.clear();
+			replaySettings.ReplayLogPath = logPath;
+			replaySettings.ReplayGeneration = g;
+
+			Generation generation;
+			generation.Create(replaySettings);
+
+			std::vector<uint64_t> rerun;
+			if (RunGenerations(generation, g, rerun) && rerun.size() == 1 && rerun.front() == logged[g])
+			{
+				exact++;
+			}
+		}
+
+		failed += exact == numGenerations ? 0 : 1;
+
+		fprintf(stdout, "%-16s %14d %14d\n", config.Name, numGenerations, exact);
+	}
+
+	std::error_code error;
+	std::filesystem::remove(logPath, error);
+
+	// Every generation has to rerun exactly
+	return failed > 0 ? 1 : 0;
+}
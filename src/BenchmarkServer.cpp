@@ -0,0 +1,99 @@
+#include "Benchmark.h"
+#include "BenchmarkUtils.h"
+#include "EvalServer.h"
+
+int Benchmark::RunServer(int argc, char **argv)
+{
+	// [largest batch] [time limit] [socket path]
+	int maxBatch = std::max(ArgInt(argc, argv, 0, 4096), 1);
+	float timeLimit = argc > 1 ? static_cast<float>(std::atof(argv[1])) : 0.5f;
+	const char *socketPath = argc > 2 ? argv[2] : nullptr;
+
+	static constexpr int kRoundTrips = 20;
+
+	EvalClient client;
+
+	if (socketPath)
+	{
+		if (!client.Connect(socketPath))
+		{
+			fprintf(stdout, "Could not connect to %s\n", socketPath);
+			return 1;
+		}
+
+		fprintf(stdout, "Evaluation server on %s\n", socketPath);
+	}
+	else
+	{
+		// Short runs, so the round trip is mostly the protocol's
+		EvalServerSettings settings;
+		settings.TerrainSeed = kSeed;
+		settings.Kill.TimeLimit = timeLimit;
+		settings.MaxBatchSize = static_cast<uint32_t>(maxBatch);
+
+		if (!client.StartLocal(settings))
+		{
+			fprintf(stdout, "Could not start a local server\n");
+			return 1;
+		}
+
+		fprintf(stdout, "Local evaluation server over pipes, %.2fs time limit\n", timeLimit);
+	}
+
+	fprintf(stdout, "%-10s %14s %14s %14s %14s %10s\n", "Batch", "Round trip ms", "Server ms", "Protocol us", "Cars / s", "Invalid");
+
+	RandomStream random = Random::MakeStream(Random::kPopulationStream, 0);
+
+	std::vector<CarProto> genomes;
+	std::vector<EvalProtocol::Result> results;
+	std::vector<EvalProtocol::Summary> summaries;
+
+	int failed = 0;
+
+	for (int batch = 1; batch <= maxBatch; batch *= 4)
+	{
+		genomes.resize(static_cast<size_t>(batch));
+		for (CarProto &genome : genomes)
+		{
+			genome = Car::RandomProto(random);
+		}
+
+		double roundTripSeconds = 0.0;
+		double serverSeconds = 0.0;
+		size_t numInvalid = 0;
+
+		for (int r = 0; r < kRoundTrips; r++)
+		{
+			Clock::time_point start = Clock::now();
+
+			float seconds = 0.0f;
+			if (!client.Evaluate(genomes.data(), nullptr, genomes.size(), 0, true, results, summaries, &seconds))
+			{
+				fprintf(stdout, "The server did not answer a batch of %d\n", batch);
+				return 1;
+			}
+
+			roundTripSeconds += ElapsedSeconds(start);
+			serverSeconds += seconds;
+			numInvalid += static_cast<size_t>(std::count_if(results.begin(), results.end(),
+				[](const EvalProtocol::Result &result) { return result.Code != EvalProtocol::ResultCode::Ok; }));
+		}
+
+		// Random genomes are all valid cars
+		failed += results.size() == genomes.size() && numInvalid == 0 ? 0 : 1;
+
+		// What the round trip cost on top of simulating, per genome
+		double numEvaluated = static_cast<double>(batch) * kRoundTrips;
+		double protocolSeconds = std::max(roundTripSeconds - serverSeconds, 0.0);
+
+		fprintf(stdout, "%-10d %14.3f %14.3f %14.3f %14.0f %10zu\n", batch,
+			roundTripSeconds * 1e3 / kRoundTrips, serverSeconds * 1e3 / kRoundTrips,
+			protocolSeconds * 1e6 / numEvaluated, numEvaluated / roundTripSeconds, numInvalid);
+	}
+
+	// A local server stops when the client closes, one on a socket is left
+	// running for other clients
+	client.Close();
+
+	return failed > 0 ? 1 : 0;
+}
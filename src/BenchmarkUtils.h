@@ -0,0 +1,57 @@
+#pragma once
+
+#include "Generation.h"
+
+#include <chrono>
+
+// What the benchmarks share, see Benchmark.h
+namespace Benchmark
+{
+	using Clock = std::chrono::steady_clock;
+
+	// Terrain and population seed every benchmark runs on unless given another
+	static constexpr uint32_t kSeed = 1234;
+
+	// Stops a generation with a car which never dies from stalling a run
+	static constexpr int kMaxStepsPerGeneration = 60 * 60 * 5;
+
+	inline double ElapsedSeconds(Clock::time_point start)
+	{
+		return std::chrono::duration<double>(Clock::now() - start).count();
+	}
+
+	inline int ArgInt(int argc, char **argv, int index, int fallback)
+	{
+		return index < argc ? std::atoi(argv[index]) : fallback;
+	}
+
+	// A population on the fixed terrain with every car simulated, so runs
+	// which only differ in what is measured simulate the same cars
+	GenerationSettings MakeSettings(int numCars);
+
+	// Seeds the program's random numbers first, so every generation created
+	// with the same seed starts from the same population
+	void CreateGeneration(Generation &generation, const GenerationSettings &settings, uint32_t seed = kSeed);
+
+	// Wall-clock seconds per step over a number of updates
+	double TimeSteps(Generation &generation, int numSteps);
+
+	struct Convergence
+	{
+		float Best = 0.0f;
+		bool Reached = false;
+
+		// A generation ran for more than kMaxStepsPerGeneration
+		bool Stalled = false;
+
+		double Seconds = 0.0;
+	};
+
+	// Runs until a generation's best car reaches the target fitness or the
+	// generation index reaches maxGenerations
+	Convergence RunToTarget(Generation &generation, int targetFitness, int maxGenerations);
+
+	// Runs until the generation after `last` starts, adding the checksum of
+	// the fitness of every generation it finished. False when one stalled.
+	bool RunGenerations(Generation &generation, int last, std::vector<uint64_t> &checksums);
+}
@@ -2,47 +2,83 @@
 #include "Random.h"
 #include "Log.h"
 
-static uint32_t GetNewCarId()
+glm::vec4 WheelProto::GetColour() const
 {
-	static uint32_t sCarId = 0;
-	sCarId += Random::Int(0u, std::numeric_limits<uint32_t>::max() - 1);
-	return sCarId;
+	float r =  (Density                        - CarConstants::kMinWheelDensity)
+	         / (CarConstants::kMaxWheelDensity - CarConstants::kMinWheelDensity);
+	float g = Friction;
+	float b = Restitution;
+
+	return { r, g, b, 1.0f };
+}
+
+glm::vec4 CarProto::GetColour() const
+{
+	float r =  (Density                          - CarConstants::kMinChassisDensity)
+	         / (CarConstants::kMaxChassisDensity - CarConstants::kMinChassisDensity);
+	float g = Friction;
+	float b = Restitution;
+
+	return { r, g, b, 1.0f };
 }
 
 Car::Car()
-	: m_CarId(GetNewCarId())
+	: m_CarId(0)
+	, m_Controller(nullptr)
 	, m_Health(0)
+	, m_SimulatedTime(0.0f)
+	, m_Fitness(0)
+	, m_Cached(false)
+	, m_CachedTime(0.0f)
+	, m_KillReason(KillReason::None)
+	, m_MaxX(0.0f)
+	, m_StalledTime(0.0f)
+	, m_FlippedTime(0.0f)
+	, m_SavedTime(0.0f)
+	, m_TopSpeed(0.0f)
+	, m_MaxHeight(0.0f)
+	, m_AirTime(0.0f)
 	, m_ChassisBody(nullptr)
+	, m_WheelBodies()
+	, m_WheelJoints()
+	, m_WheelCount(0)
+{
+}
+
+void Car::Create(b2World& world, const CarProto& carProto, uint32_t carId, const ControllerProto *controller)
 {
+	Create(world, carProto, carId, MakeChassisShape(carProto), controller);
 }
 
-void Car::Create(b2World& world, const CarProto& carProto)
+void Car::Create(b2World &world, const CarProto &carProto, uint32_t carId, const b2PolygonShape &chassisShape,
+                 const ControllerProto *controller)
 {
 	BL_ASSERT(!m_ChassisBody, "The car has already been created !");
 
 	if (!m_ChassisBody)
 	{
+		m_CarId = carId;
 		m_Proto = carProto;
+		m_Controller = carProto.Controlled ? controller : nullptr;
 		m_Health = 180;
+		m_SimulatedTime = 0.0f;
+		m_Fitness = 0;
+		m_Cached = false;
+		m_KillReason = KillReason::None;
+		m_MaxX = 0.0f;
+		m_StalledTime = 0.0f;
+		m_FlippedTime = 0.0f;
+		m_SavedTime = 0.0f;
+		m_TopSpeed = 0.0f;
+		m_MaxHeight = 0.0f;
+		m_AirTime = 0.0f;
 		m_ChassisBody = nullptr;
-		m_WheelJoints.clear();
-		m_WheelBodies.clear();
-
-		b2Vec2 vertices[CarConstants::kNumVertices] = { b2Vec2_zero };
-
-		for (int i = 0; i < CarConstants::kNumVertices; i++)
-		{
-			vertices[i] = m_Proto.Vertices[i];
-		}
-
-		b2PolygonShape chassisShape;
-		chassisShape.Set(vertices, CarConstants::kNumVertices);
+		m_WheelCount = 0;
 
 		b2BodyDef chassisDef;
 		chassisDef.type = b2_dynamicBody;
 		chassisDef.position.Set(0, 0);
 		chassisDef.angle = 0;
-		chassisDef.userData.pointer = (uintptr_t)&m_Proto.Colour;
 
 		b2FixtureDef chassisFixture;
 		chassisFixture.shape = &chassisShape;
@@ -53,15 +89,16 @@ void Car::Create(b2World& world, const CarProto& carProto)
 		m_ChassisBody = world.CreateBody(&chassisDef);
 		m_ChassisBody->CreateFixture(&chassisFixture);
 
-		for (const WheelProto &wheel : m_Proto.Wheels)
+		for (uint8_t i = 0; i < m_Proto.WheelCount; i++)
 		{
+			const WheelProto &wheel = m_Proto.Wheels[i];
+
 			b2CircleShape wheelShape;
 			wheelShape.m_radius = wheel.Radius;
 
 			b2BodyDef wheelDef;
 			wheelDef.type = b2_dynamicBody;
 			wheelDef.angle = 0;
-			wheelDef.userData.pointer = (uintptr_t)&wheel.Colour;
 
 			b2FixtureDef wheelFixture;
 			wheelFixture.shape = &wheelShape;
@@ -72,7 +109,7 @@ void Car::Create(b2World& world, const CarProto& carProto)
 			b2Body* wheelBody = world.CreateBody(&wheelDef);
 			wheelBody->CreateFixture(&wheelFixture);
 
-			m_WheelBodies.push_back(wheelBody);
+			m_WheelBodies[i] = wheelBody;
 
 			b2RevoluteJointDef jointDef;
 			jointDef.collideConnected = false;
@@ -82,197 +119,272 @@ void Car::Create(b2World& world, const CarProto& carProto)
 			jointDef.bodyB = wheelBody;
 			jointDef.maxMotorTorque = m_ChassisBody->GetMass() / wheel.Radius * 100.0f;
 			jointDef.motorSpeed = wheel.MotorSpeed;
-			jointDef.localAnchorA = vertices[wheel.Vertex];
+			jointDef.localAnchorA = m_Proto.Vertices[m_Proto.WheelVertices[i]];
 			jointDef.localAnchorB.Set(0, 0);
 
-			m_WheelJoints.push_back(world.CreateJoint(&jointDef));
+			m_WheelJoints[i] = world.CreateJoint(&jointDef);
+			m_WheelCount++;
+
+			float throttle = m_Controller ? CarConstants::kMaxThrottle : 1.0f;
+			m_TopSpeed = std::max(m_TopSpeed, std::abs(wheel.MotorSpeed) * throttle * wheel.Radius);
 		}
 	}
 }
 
+void Car::CreateCached(const CarProto &carProto, int fitness, float simulatedTime, uint32_t carId)
+{
+	BL_ASSERT(!m_ChassisBody, "The car has already been created !");
+
+	if (!m_ChassisBody)
+	{
+		m_CarId = carId;
+		m_Proto = carProto;
+		m_Controller = nullptr;
+		m_Health = 0;
+		m_SimulatedTime = 0.0f;
+		m_KillReason = KillReason::None;
+		m_SavedTime = 0.0f;
+		m_MaxHeight = 0.0f;
+		m_AirTime = 0.0f;
+		m_WheelCount = 0;
+
+		SetCachedFitness(fitness, simulatedTime);
+	}
+}
+
+void Car::SetCachedFitness(int fitness, float simulatedTime)
+{
+	m_Cached = true;
+	m_Fitness = fitness;
+	m_CachedTime = simulatedTime;
+}
+
 void Car::Destory()
 {
-	BL_ASSERT(m_ChassisBody, "The car has not been created !");
+	BL_ASSERT(m_ChassisBody || m_Cached, "The car has not been created !");
+
+	m_Cached = false;
 
 	if (m_ChassisBody)
 	{
 		b2World *world = m_ChassisBody->GetWorld();
 
-		for (b2Joint *wJoint : m_WheelJoints)
+		for (uint8_t i = 0; i < m_WheelCount; i++)
 		{
-			world->DestroyJoint(wJoint);
+			world->DestroyJoint(m_WheelJoints[i]);
 		}
 
-		for (b2Body *wBody : m_WheelBodies)
+		for (uint8_t i = 0; i < m_WheelCount; i++)
 		{
-			world->DestroyBody(wBody);
+			world->DestroyBody(m_WheelBodies[i]);
 		}
 
 		world->DestroyBody(m_ChassisBody);
 
 		m_ChassisBody = nullptr;
-		m_WheelJoints.clear();
-		m_WheelBodies.clear();
+		m_WheelCount = 0;
 	}
 }
 
-void Car::Draw() const
+void Car::SetWheelThrottle(uint8_t wheel, float throttle)
 {
+	b2RevoluteJoint *joint = static_cast<b2RevoluteJoint*>(m_WheelJoints[wheel]);
+	joint->SetMotorSpeed(m_Proto.Wheels[wheel].MotorSpeed * throttle);
+}
+
+CarPose Car::GetPose() const
+{
+	CarPose pose;
+	pose.Health = m_Health;
+
 	if (m_ChassisBody)
 	{
-		// Wheels
-		for (const b2Body *wheelBody : m_WheelBodies)
+		pose.Position = m_ChassisBody->GetPosition();
+		pose.Angle = m_ChassisBody->GetAngle();
+
+		for (uint8_t i = 0; i < m_WheelCount; i++)
 		{
-			b2Vec2 position = wheelBody->GetPosition();
-			float  rotation = wheelBody->GetAngle();
+			pose.WheelPositions[i] = m_WheelBodies[i]->GetPosition();
+			pose.WheelAngles[i] = m_WheelBodies[i]->GetAngle();
+		}
+	}
 
-			for (const b2Fixture *f = wheelBody->GetFixtureList(); f;
-			     f = f->GetNext())
-			{
-				const b2PolygonShape *shape = static_cast<const b2PolygonShape*>(f->GetShape());
+	return pose;
+}
 
-				float wheelRadius = shape->m_radius;
+CarBehaviour Car::GetBehaviour() const
+{
+	CarBehaviour behaviour;
+	behaviour.FinalX = GetPosition().x;
+	behaviour.MaxHeight = m_MaxHeight;
+	behaviour.AirTime = m_AirTime;
 
-				glm::vec4 *colour = reinterpret_cast<glm::vec4*>(
-					const_cast<b2Body*>(wheelBody)->GetUserData().pointer
-				);
+	return behaviour;
+}
 
-				glm::vec4 wheelColour;
-				if (colour)
-				{
-					wheelColour = *colour;
-				}
-				else
-				{
-					wheelColour = { 0.8f, 0.4f, 0.4f, 1.0f };
-				}
+void Car::Draw(DrawList &drawList) const
+{
+	if (m_ChassisBody)
+	{
+		const b2PolygonShape *shape = static_cast<const b2PolygonShape*>(m_ChassisBody->GetFixtureList()->GetShape());
 
-				glm::vec4 spokeColour = wheelColour * 0.85f;
+		DrawPose(drawList, m_Proto, *shape, GetPose());
+	}
+}
 
-				float wheelZOffset = 0.0f;
-				float spokeZOffset = 0.1f;
+void Car::DrawPose(DrawList &drawList, const CarProto &carProto, const b2PolygonShape &chassisShape, const CarPose &pose,
+                   const glm::vec4 &tint, float depthOffset)
+{
+	// Skips the trig of every car off screen, most of a large population
+	if (!drawList.IsVisible({ pose.Position.x, pose.Position.y, 0.0f }))
+	{
+		return;
+	}
 
-				if (IsDead())
-				{
-					wheelColour *= 0.5f;
-					spokeColour *= 0.5f;
-					wheelZOffset -= 0.05f;
-					spokeZOffset -= 0.05f;
-				}
+	bool dead = pose.Health <= 0;
 
-				// Wheel
-				Renderer::SubmitFilledCircle(
-					{ position.x, position.y, wheelZOffset }, wheelRadius, wheelColour
-				);
+	// Wheels
+	for (uint8_t i = 0; i < carProto.WheelCount; i++)
+	{
+		b2Vec2 position = pose.WheelPositions[i];
+		float  rotation = pose.WheelAngles[i];
 
-				// Spokes
-				{
-					std::vector<glm::vec3> vertices = {
-						{ position.x, position.y, spokeZOffset },
-						{ wheelRadius * cos(0.00f + rotation) + position.x,
-						  wheelRadius * sin(0.00f + rotation) + position.y,
-						  spokeZOffset },
-						{ 0.5f * wheelRadius * cos(0.79f + rotation) + position.x,
-						  0.5f * wheelRadius * sin(0.79f + rotation) + position.y,
-						  spokeZOffset },
-
-						{ position.x, position.y, spokeZOffset },
-						{ wheelRadius * cos(1.57f + rotation) + position.x,
-						  wheelRadius * sin(1.57f + rotation) + position.y,
-						  spokeZOffset },
-						{ 0.5f * wheelRadius * cos(2.36f + rotation) + position.x,
-						  0.5f * wheelRadius * sin(2.36f + rotation) + position.y,
-						  spokeZOffset },
-
-						{ position.x, position.y, spokeZOffset },
-						{ wheelRadius * cos(3.14f + rotation) + position.x,
-						  wheelRadius * sin(3.14f + rotation) + position.y,
-						  spokeZOffset },
-						{ 0.5f * wheelRadius * cos(3.93f + rotation) + position.x,
-						  0.5f * wheelRadius * sin(3.93f + rotation) + position.y,
-						  spokeZOffset },
-
-						{ position.x, position.y, spokeZOffset },
-						{ wheelRadius * cos(4.71f + rotation) + position.x,
-						  wheelRadius * sin(4.71f + rotation) + position.y,
-						  spokeZOffset },
-						{ 0.5f * wheelRadius * cos(5.50f + rotation) + position.x,
-						  0.5f * wheelRadius * sin(5.50f + rotation) + position.y,
-						  spokeZOffset }
-					};
-					Renderer::SubmitFilledPolygon(vertices, spokeColour);
-				}
-			}
+		float wheelRadius = carProto.Wheels[i].Radius;
+
+		glm::vec4 wheelColour = carProto.Wheels[i].GetColour() * tint;
+
+		glm::vec4 spokeColour = wheelColour * 0.85f;
+
+		float wheelZOffset = 0.0f + depthOffset;
+		float spokeZOffset = 0.1f + depthOffset;
+
+		if (dead)
+		{
+			wheelColour *= 0.5f;
+			spokeColour *= 0.5f;
+			wheelZOffset -= 0.05f;
+			spokeZOffset -= 0.05f;
 		}
 
-		// Chassis
+		// Wheel
+		drawList.SubmitFilledCircle(
+			{ position.x, position.y, wheelZOffset }, wheelRadius, wheelColour
+		);
+
+		// Spokes
 		{
-			b2Vec2 position = m_ChassisBody->GetPosition();
-			float  rotation = m_ChassisBody->GetAngle();
+			glm::vec3 vertices[] = {
+				{ position.x, position.y, spokeZOffset },
+				{ wheelRadius * cos(0.00f + rotation) + position.x,
+				  wheelRadius * sin(0.00f + rotation) + position.y,
+				  spokeZOffset },
+				{ 0.5f * wheelRadius * cos(0.79f + rotation) + position.x,
+				  0.5f * wheelRadius * sin(0.79f + rotation) + position.y,
+				  spokeZOffset },
+
+				{ position.x, position.y, spokeZOffset },
+				{ wheelRadius * cos(1.57f + rotation) + position.x,
+				  wheelRadius * sin(1.57f + rotation) + position.y,
+				  spokeZOffset },
+				{ 0.5f * wheelRadius * cos(2.36f + rotation) + position.x,
+				  0.5f * wheelRadius * sin(2.36f + rotation) + position.y,
+				  spokeZOffset },
+
+				{ position.x, position.y, spokeZOffset },
+				{ wheelRadius * cos(3.14f + rotation) + position.x,
+				  wheelRadius * sin(3.14f + rotation) + position.y,
+				  spokeZOffset },
+				{ 0.5f * wheelRadius * cos(3.93f + rotation) + position.x,
+				  0.5f * wheelRadius * sin(3.93f + rotation) + position.y,
+				  spokeZOffset },
+
+				{ position.x, position.y, spokeZOffset },
+				{ wheelRadius * cos(4.71f + rotation) + position.x,
+				  wheelRadius * sin(4.71f + rotation) + position.y,
+				  spokeZOffset },
+				{ 0.5f * wheelRadius * cos(5.50f + rotation) + position.x,
+				  0.5f * wheelRadius * sin(5.50f + rotation) + position.y,
+				  spokeZOffset }
+			};
+			drawList.SubmitFilledPolygon(vertices, std::size(vertices), spokeColour);
+		}
+	}
 
-			for (const b2Fixture *f = m_ChassisBody->GetFixtureList(); f;
-				f = f->GetNext())
-			{
-				const b2PolygonShape *shape = static_cast<const b2PolygonShape*>(f->GetShape());
+	// Chassis
+	{
+		b2Vec2 position = pose.Position;
+		float  rotation = pose.Angle;
 
-				const b2Vec2 *vertexArray = shape->m_vertices;
-				int32_t vertexCount = shape->m_count;
+		const b2Vec2 *vertexArray = chassisShape.m_vertices;
+		int32_t vertexCount = chassisShape.m_count;
 
-				glm::vec4 *colour = reinterpret_cast<glm::vec4*>(
-					m_ChassisBody->GetUserData().pointer
-				);
+		glm::vec4 bodyColour = carProto.GetColour() * tint;
+		
+		float zOffset = 0.2f + depthOffset;
 
-				glm::vec4 bodyColour;
-				if (colour)
-				{
-					bodyColour = *colour;
-				}
-				else
-				{
-					bodyColour = { 0.8f, 0.4f, 0.4f, 1.0f };
-				}
-				
-				float zOffset = 0.2f;
+		if (dead)
+		{
+			bodyColour *= 0.5f;
+			zOffset -= 0.05f;
+		}
 
-				if (IsDead())
-				{
-					bodyColour *= 0.5f;
-					zOffset -= 0.05f;
-				}
+		float cosRotation = std::cos(rotation);
+		float sinRotation = std::sin(rotation);
 
-				std::vector<glm::vec3> vertices;
-				for (int i = 0; i < vertexCount; ++i)
-				{
-					float x =  (vertexArray[i].x * std::cos(rotation)
-					          - vertexArray[i].y * std::sin(rotation)) + position.x;
-					float y =  (vertexArray[i].x * std::sin(rotation)
-					          + vertexArray[i].y * std::cos(rotation)) + position.y;
+		std::array<glm::vec3, b2_maxPolygonVertices> vertices;
+		for (int i = 0; i < vertexCount; ++i)
+		{
+			float x =  (vertexArray[i].x * cosRotation
+			          - vertexArray[i].y * sinRotation) + position.x;
+			float y =  (vertexArray[i].x * sinRotation
+			          + vertexArray[i].y * cosRotation) + position.y;
 
-					vertices.push_back({ x, y, zOffset });
-				}
-				Renderer::SubmitFilledPolygon(vertices, bodyColour);
-			}
+			vertices[i] = { x, y, zOffset };
 		}
+		drawList.SubmitFilledPolygon(vertices.data(), static_cast<size_t>(vertexCount), bodyColour);
 	}
 }
 
+b2PolygonShape Car::MakeChassisShape(const CarProto &carProto)
+{
+	b2PolygonShape chassisShape;
+	chassisShape.Set(carProto.Vertices.data(), CarConstants::kNumVertices);
+
+	return chassisShape;
+}
+
 void Car::Update(float delta)
 {
 	if (m_ChassisBody)
 	{
 		if (!IsDead())
 		{
+			m_SimulatedTime += delta;
+
 			int ticker = static_cast<int>(100.0f * delta);
 			ticker = ticker <= 0 ? 1 : ticker;
 			if (m_ChassisBody->GetLinearVelocity().x <= CarConstants::kMinSpeed)
 			{
 				m_Health -= ticker;
+
+				if (IsDead())
+				{
+					m_KillReason = KillReason::Health;
+				}
+			}
+
+			if (!m_Cached)
+			{
+				float x = m_ChassisBody->GetPosition().x;
+				m_Fitness = x <= 0.0f ? 0 : static_cast<int>(x);
 			}
 		}
 		else
 		{
-			for (b2Joint *wheelJoint : m_WheelJoints)
+			for (uint8_t i = 0; i < m_WheelCount; i++)
 			{
+				b2Joint *wheelJoint = m_WheelJoints[i];
+
 				if (wheelJoint->GetType() == b2JointType::e_revoluteJoint)
 				{
 					b2RevoluteJoint *revJoint = static_cast<b2RevoluteJoint*>(wheelJoint);
@@ -283,7 +395,158 @@ void Car::Update(float delta)
 	}
 }
 
-CarProto Car::RandomProto()
+void Car::ApplyKillRules(const KillRules &rules, float delta, float floor, float finish, float targetFitness)
+{
+	if (!m_ChassisBody || IsDead() || m_Cached)
+	{
+		return;
+	}
+
+	const b2Vec2 &position = m_ChassisBody->GetPosition();
+
+	if (position.x >= finish)
+	{
+		float timeLeft = std::max(rules.TimeLimit - m_SimulatedTime, 0.0f);
+
+		m_Fitness = static_cast<int>(finish + rules.FinishBonus * timeLeft);
+		m_KillReason = KillReason::Finished;
+		m_Health = 0;
+		return;
+	}
+
+	if (position.x > m_MaxX + rules.StalledDistance)
+	{
+		m_MaxX = position.x;
+		m_StalledTime = 0.0f;
+	}
+	else
+	{
+		m_StalledTime += delta;
+	}
+
+	bool flipped = std::cos(m_ChassisBody->GetAngle()) < 0.0f;
+	m_FlippedTime = flipped ? m_FlippedTime + delta : 0.0f;
+
+	if (rules.TimeLimit > 0.0f && m_SimulatedTime >= rules.TimeLimit)
+	{
+		Kill(KillReason::TimeLimit, delta, rules);
+	}
+	else if (rules.FlippedTime > 0.0f && m_FlippedTime >= rules.FlippedTime)
+	{
+		Kill(KillReason::Flipped, delta, rules);
+	}
+	else if (rules.StalledTime > 0.0f && m_StalledTime >= rules.StalledTime)
+	{
+		Kill(KillReason::Stalled, delta, rules);
+	}
+	else if (rules.FallenDepth > 0.0f && position.y < floor - rules.FallenDepth)
+	{
+		Kill(KillReason::Fallen, delta, rules);
+	}
+	else if (rules.KillLagging && rules.TimeLimit > 0.0f && targetFitness > 0.0f)
+	{
+		float reach = position.x + rules.LaggingSlack * m_TopSpeed * (rules.TimeLimit - m_SimulatedTime);
+
+		if (reach < targetFitness)
+		{
+			Kill(KillReason::Lagging, delta, rules);
+		}
+	}
+}
+
+void Car::TrackBehaviour(float delta, float groundHeight)
+{
+	if (!m_ChassisBody || IsDead())
+	{
+		return;
+	}
+
+	m_MaxHeight = std::max(m_MaxHeight, m_ChassisBody->GetPosition().y - groundHeight);
+
+	if (!IsTouchingGround())
+	{
+		m_AirTime += delta;
+	}
+}
+
+bool Car::IsTouchingGround() const
+{
+	// The parts of a car never collide with each other or other cars, so any
+	// touching contact is with the terrain
+	auto touching = [](const b2Body *body)
+	{
+		for (const b2ContactEdge *edge = body->GetContactList(); edge; edge = edge->next)
+		{
+			if (edge->contact->IsTouching())
+			{
+				return true;
+			}
+		}
+
+		return false;
+	};
+
+	if (touching(m_ChassisBody))
+	{
+		return true;
+	}
+
+	for (uint8_t i = 0; i < m_WheelCount; i++)
+	{
+		if (touching(m_WheelBodies[i]))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void Car::Kill(KillReason reason, float delta, const KillRules &rules)
+{
+	// Health only drains while the car is slow, by at most a ticker a step,
+	// so the health left is a lower bound on how long it had to go.
+	int ticker = static_cast<int>(100.0f * delta);
+	ticker = ticker <= 0 ? 1 : ticker;
+
+	m_SavedTime = static_cast<float>(m_Health / ticker) * delta;
+
+	if (rules.TimeLimit > 0.0f && reason != KillReason::TimeLimit)
+	{
+		m_SavedTime = std::min(m_SavedTime, rules.TimeLimit - m_SimulatedTime);
+	}
+
+	m_KillReason = reason;
+	m_Health = 0;
+}
+
+void Car::CutOff()
+{
+	if (m_ChassisBody && !IsDead() && !m_Cached)
+	{
+		m_KillReason = KillReason::CutOff;
+		m_Health = 0;
+	}
+}
+
+const char *Car::GetKillReasonName(KillReason reason)
+{
+	switch (reason)
+	{
+	case KillReason::None:      return "None";
+	case KillReason::Health:    return "Health";
+	case KillReason::TimeLimit: return "Time Limit";
+	case KillReason::Finished:  return "Finished";
+	case KillReason::Flipped:   return "Flipped";
+	case KillReason::Stalled:   return "Stalled";
+	case KillReason::Fallen:    return "Fallen";
+	case KillReason::Lagging:  return "Lagging";
+	case KillReason::CutOff:    return "Cut Off";
+	default:                    return "Unknown";
+	}
+}
+
+CarProto Car::RandomProto(RandomStream &random)
 {
 	CarProto carProto;
 
@@ -293,41 +556,137 @@ CarProto Car::RandomProto()
 		              * static_cast<float>(i)
 					  / static_cast<float>(CarConstants::kNumVertices);
 
-		carProto.Vertices[i] = { Random::Float(8.0f, 15.0f) * static_cast<float>(cosf(angle)),
-								 Random::Float(8.0f, 15.0f) * static_cast<float>(sinf(angle)) };
+		carProto.Vertices[i] = { random.Float(8.0f, 15.0f) * static_cast<float>(cosf(angle)),
+								 random.Float(8.0f, 15.0f) * static_cast<float>(sinf(angle)) };
 	}
 	carProto.Density =  (  CarConstants::kMaxChassisDensity
-	                     - CarConstants::kMinChassisDensity) * Random::Float(0.0f, 1.0f)
+	                     - CarConstants::kMinChassisDensity) * random.Float(0.0f, 1.0f)
 	                  + CarConstants::kMinChassisDensity;
-	carProto.Friction = Random::Float(0.0f, 1.0f);
-	carProto.Restitution = Random::Float(0.0f, 1.0f);
-	{
-		float r =  (carProto.Density - CarConstants::kMinChassisDensity)
-		         / (CarConstants::kMaxChassisDensity - CarConstants::kMinChassisDensity);
-		float g = carProto.Friction;
-		float b = carProto.Restitution;
-		carProto.Colour = { r, g, b, 1.0f };
-	}
-
-	int wheelCount = Random::Int(1, 5);
-	for (int i = 0; i < wheelCount; i++)
-	{
-		WheelProto wheelProto;
-		wheelProto.Density =  Random::Float(CarConstants::kMinWheelDensity, CarConstants::kMaxWheelDensity);
-		wheelProto.Friction = Random::Float(0.0f, 1.0f);
-		wheelProto.Restitution = Random::Float(0.0f, 1.0f);
-		wheelProto.Radius = Random::Float(CarConstants::kMinWheelRadius, CarConstants::kMaxWheelRadius);
-		wheelProto.MotorSpeed = -Random::Float(CarConstants::kMinWheelMotorSpeed, CarConstants::kMaxWheelMotorSpeed);
-		wheelProto.Vertex = CarConstants::kNumVertices - 1 - i;
+	carProto.Friction = random.Float(0.0f, 1.0f);
+	carProto.Restitution = random.Float(0.0f, 1.0f);
+
+	carProto.WheelCount = random.Int<uint8_t>(1, 5);
+	for (uint8_t i = 0; i < carProto.WheelCount; i++)
+	{
+		WheelProto &wheelProto = carProto.Wheels[i];
+		wheelProto.Density =  random.Float(CarConstants::kMinWheelDensity, CarConstants::kMaxWheelDensity);
+		wheelProto.Friction = random.Float(0.0f, 1.0f);
+		wheelProto.Restitution = random.Float(0.0f, 1.0f);
+		wheelProto.Radius = random.Float(CarConstants::kMinWheelRadius, CarConstants::kMaxWheelRadius);
+		wheelProto.MotorSpeed = -random.Float(CarConstants::kMinWheelMotorSpeed, CarConstants::kMaxWheelMotorSpeed);
+		carProto.WheelVertices[i] = static_cast<CarProto::VertexIndex>(CarConstants::kNumVertices - 1 - i);
+	}
+
+	return carProto;
+}
+
+void Car::RandomController(CarProto &carProto, ControllerProto &controller, RandomStream &random)
+{
+	carProto.Controlled = 1;
+
+	for (float &weight : controller.Weights)
+	{
+		weight = random.Float(-1.0f, 1.0f);
+	}
+}
+
+static bool IsFinite(std::initializer_list<float> values)
+{
+	return std::all_of(values.begin(), values.end(), [](float value) { return std::isfinite(value); });
+}
+
+// False for NaN as well
+static bool IsInRange(float value, float min, float max)
+{
+	return value >= min && value <= max;
+}
+
+bool Car::IsValidProto(const CarProto &carProto)
+{
+	using namespace CarConstants;
+
+	// Every gene within the range the program draws and breeds it in. Box2D
+	// takes the square root of friction, and a car's fitness is its position
+	// as an int, neither of which holds up to anything else.
+	if (   !IsInRange(carProto.Density, kMinChassisDensity, kMaxChassisDensity)
+	    || !IsInRange(carProto.Friction, 0.0f, 1.0f)
+	    || !IsInRange(carProto.Restitution, 0.0f, 1.0f))
+	{
+		return false;
+	}
+
+	if (carProto.WheelCount > kNumVertices)
+	{
+		return false;
+	}
+
+	for (const b2Vec2 &vertex : carProto.Vertices)
+	{
+		if (!IsFinite({ vertex.x, vertex.y }) || std::abs(vertex.x) > kMaxVertexExtent || std::abs(vertex.y) > kMaxVertexExtent)
 		{
-			float r =  (wheelProto.Density - CarConstants::kMinChassisDensity)
-			         / (CarConstants::kMaxChassisDensity - CarConstants::kMinChassisDensity);
-			float g = wheelProto.Friction;
-			float b = wheelProto.Restitution;
-			wheelProto.Colour = { r, g, b, 1.0f };
+			return false;
 		}
-		carProto.Wheels.push_back(wheelProto);
 	}
 
-	return carProto;
+	for (uint8_t i = 0; i < carProto.WheelCount; i++)
+	{
+		const WheelProto &wheel = carProto.Wheels[i];
+
+		// Motors turn backwards, see RandomProto
+		if (   !IsInRange(wheel.Density, kMinWheelDensity, kMaxWheelDensity)
+		    || !IsInRange(wheel.Friction, 0.0f, 1.0f)
+		    || !IsInRange(wheel.Restitution, 0.0f, 1.0f)
+		    || !IsInRange(wheel.Radius, kMinWheelRadius, kMaxWheelRadius)
+		    || !IsInRange(wheel.MotorSpeed, -kMaxWheelMotorSpeed, -kMinWheelMotorSpeed)
+		    || carProto.WheelVertices[i] >= kNumVertices)
+		{
+			return false;
+		}
+	}
+
+	// Area of the convex hull of the vertices, a monotone chain over them
+	std::array<b2Vec2, kNumVertices> points = carProto.Vertices;
+	std::sort(points.begin(), points.end(), [](const b2Vec2 &a, const b2Vec2 &b)
+	{
+		return a.x < b.x || (a.x == b.x && a.y < b.y);
+	});
+
+	auto cross = [](const b2Vec2 &o, const b2Vec2 &a, const b2Vec2 &b)
+	{
+		return (a.x - o.x) * (b.y - o.y) - (a.y - o.y) * (b.x - o.x);
+	};
+
+	std::array<b2Vec2, 2 * kNumVertices> hull;
+	size_t size = 0;
+	for (size_t pass = 0; pass < 2; pass++)
+	{
+		size_t start = size;
+		for (size_t i = 0; i < kNumVertices; i++)
+		{
+			const b2Vec2 &point = points[pass == 0 ? i : kNumVertices - 1 - i];
+
+			while (size >= start + 2 && cross(hull[size - 2], hull[size - 1], point) <= 0.0f)
+			{
+				size--;
+			}
+			hull[size++] = point;
+		}
+		size--;
+	}
+
+	float area = 0.0f;
+	for (size_t i = 0; i < size; i++)
+	{
+		area += cross(b2Vec2_zero, hull[i], hull[(i + 1) % size]);
+	}
+
+	return 0.5f * area >= kMinChassisArea;
+}
+
+bool Car::IsValidController(const ControllerProto &controller)
+{
+	return std::all_of(controller.Weights.begin(), controller.Weights.end(), [](float weight)
+	{
+		return IsInRange(weight, -CarConstants::kMaxControllerWeight, CarConstants::kMaxControllerWeight);
+	});
 }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Renderer.h"
+#include "Random.h"
 
 #include <box2d/box2d.h>
 
@@ -21,6 +22,27 @@ namespace CarConstants
 
 	static constexpr float kMinWheelDensity = 0.5f;
 	static constexpr float kMaxWheelDensity = 50.0f;
+
+	// Coordinates past this are not a car anyone meant to build
+	static constexpr float kMaxVertexExtent = 1000.0f;
+
+	// Smallest chassis box2d can make a polygon of
+	static constexpr float kMinChassisArea = 0.01f;
+
+	// The evolved wheel controller, see ControllerBatch. It senses the
+	// chassis angle as a sine and cosine, the chassis velocity, the height of
+	// the ground at a few points ahead and the angular velocity of every
+	// wheel, and has one hidden layer.
+	static constexpr size_t kNumTerrainSensors = 3;
+	static constexpr size_t kNumControllerInputs = 4 + kNumTerrainSensors + kNumVertices;
+	static constexpr size_t kNumControllerHidden = 6;
+	static constexpr size_t kNumControllerWeights = kNumControllerHidden * (kNumControllerInputs + 1)
+	                                              + kNumVertices * (kNumControllerHidden + 1);
+
+	static constexpr float kMaxControllerWeight = 4.0f;
+
+	// A controlled wheel turns at up to this many times its motor speed
+	static constexpr float kMaxThrottle = 2.0f;
 }
 
 struct WheelProto
@@ -30,34 +52,157 @@ struct WheelProto
 	float Restitution = 1.0f;
 	float Radius = 1.0f;
 	float MotorSpeed = -1.0f;
-	size_t Vertex = 0;
-	glm::vec4 Colour = {1.0f, 1.0f, 1.0f, 1.0f};
+
+	glm::vec4 GetColour() const;
 };
 
+// A plain, fixed size genome which can be copied, hashed and written out as
+// raw bytes. Only the first WheelCount wheels are used, the rest keep their
+// default values so that equal genomes always have equal bytes. A car with
+// Controlled set has a ControllerProto as well, kept apart so that genomes
+// without one do not carry its weights around.
 struct CarProto
 {
+	using VertexIndex = uint8_t;
+
 	using VerticesArr = std::array<b2Vec2, CarConstants::kNumVertices>;
-	using WheelsList = std::vector<WheelProto>;
+	using WheelsArr = std::array<WheelProto, CarConstants::kNumVertices>;
+	using WheelVerticesArr = std::array<VertexIndex, CarConstants::kNumVertices>;
 
 	float Density = 1.0f;
 	float Friction = 1.0f;
 	float Restitution = 1.0f;
-	glm::vec4 Colour = {1.0f, 1.0f, 1.0f, 1.0f};
 	VerticesArr Vertices;
-	WheelsList Wheels;
+	WheelsArr Wheels;
+	WheelVerticesArr WheelVertices = {};
+	uint8_t WheelCount = 0;
+	uint8_t Controlled = 0;
+	uint8_t Padding[2] = {};
+
+	glm::vec4 GetColour() const;
+};
+
+// The weights of a car's wheel controller, see ControllerBatch
+struct ControllerProto
+{
+	using WeightsArr = std::array<float, CarConstants::kNumControllerWeights>;
+
+	WeightsArr Weights = {};
+};
+
+// Where a car and its wheels are at one step, all that is needed to draw it
+struct CarPose
+{
+	using WheelPositionsArr = std::array<b2Vec2, CarConstants::kNumVertices>;
+	using WheelAnglesArr = std::array<float, CarConstants::kNumVertices>;
+
+	b2Vec2 Position = b2Vec2_zero;
+	float Angle = 0.0f;
+	WheelPositionsArr WheelPositions;
+	WheelAnglesArr WheelAngles = {};
+	int Health = 0;
+};
+
+// What a car did over its run rather than how far it got, the behaviour
+// novelty search compares cars by
+struct CarBehaviour
+{
+	float FinalX = 0.0f;
+
+	// Highest the chassis got above the ground under it
+	float MaxHeight = 0.0f;
+
+	// Simulated seconds with none of its bodies touching the ground
+	float AirTime = 0.0f;
 };
 
+// Why a car stopped being simulated
+enum class KillReason : uint8_t
+{
+	None = 0,
+	Health,
+	TimeLimit,
+	Finished,
+	Flipped,
+	Stalled,
+	Fallen,
+	Lagging,
+	CutOff,
+
+	Count
+};
+
+// Ends a car's run early once it can no longer do any better than it has,
+// rather than waiting for it to run out of health. A zero turns a rule off.
+struct KillRules
+{
+	// Cars still running after this many simulated seconds are stopped. As
+	// every car starts together this bounds the length of a generation, and
+	// the lagging rule and finish bonus need it.
+	float TimeLimit = 300.0f;
+
+	// Cars which reach the end of the course are stopped there and given this
+	// much fitness for each simulated second of the time limit left.
+	float FinishBonus = 10.0f;
+
+	// Upside down for this long
+	float FlippedTime = 2.0f;
+
+	// Not beaten its furthest point by StalledDistance for this long
+	float StalledTime = 4.0f;
+	float StalledDistance = 1.0f;
+
+	// This far below the lowest point of the terrain beneath it
+	float FallenDepth = 10.0f;
+
+	// Would not reach the target fitness by the time limit going at the rim
+	// speed of its fastest wheel, scaled by LaggingSlack, the whole way. Only
+	// a heuristic: a car can outrun its wheels falling or bouncing, and the
+	// target is the last generation's median, so some cars it stops would
+	// have caught up. Their fitness is never cached.
+	bool KillLagging = false;
+	float LaggingSlack = 1.0f;
+};
+
+static_assert(std::is_trivially_copyable_v<CarProto>, "CarProto must stay memcpy-able");
+static_assert(sizeof(CarProto) == 3 * sizeof(float)
+                                + sizeof(CarProto::VerticesArr)
+                                + sizeof(CarProto::WheelsArr)
+                                + sizeof(CarProto::WheelVerticesArr) + 4,
+              "CarProto must not contain any implicit padding");
+static_assert(std::is_trivially_copyable_v<ControllerProto>, "ControllerProto must stay memcpy-able");
+
 class Car
 {
 private:
 	uint32_t m_CarId;
 
 	CarProto m_Proto;
+	// Not owned, only read on the car's first step
+	const ControllerProto *m_Controller;
 	int m_Health;
+	float m_SimulatedTime;
+
+	int m_Fitness;
+	bool m_Cached;
+	// How long the run the cached fitness came from lasted
+	float m_CachedTime;
 
+	KillReason m_KillReason;
+	float m_MaxX;
+	float m_StalledTime;
+	float m_FlippedTime;
+	float m_SavedTime;
+	float m_TopSpeed;
+
+	float m_MaxHeight;
+	float m_AirTime;
+
+	// Fixed size, a car allocates nothing of its own besides its bodies
 	b2Body *m_ChassisBody;
-	std::vector<b2Body *> m_WheelBodies;
-	std::vector<b2Joint *> m_WheelJoints;
+	std::array<b2Body *, CarConstants::kNumVertices> m_WheelBodies;
+	std::array<b2Joint *, CarConstants::kNumVertices> m_WheelJoints;
+	uint8_t m_WheelCount;
 
 public:
 	Car();
@@ -65,22 +210,95 @@ public:
 	inline uint32_t GetCarId() const { return m_CarId; }
 
 	inline const CarProto &GetProto() const { return m_Proto; }
+	// Null for a car without a controller
+	inline const ControllerProto *GetController() const { return m_Controller; }
 
 	inline const b2Vec2 &GetPosition() const { return m_ChassisBody ? m_ChassisBody->GetPosition() : b2Vec2_zero; }
 	inline const b2Vec2 &GetVelocity() const { return m_ChassisBody ? m_ChassisBody->GetLinearVelocity() : b2Vec2_zero; }
+	inline float GetAngle() const { return m_ChassisBody ? m_ChassisBody->GetAngle() : 0.0f; }
+
+	inline uint8_t GetWheelCount() const { return m_WheelCount; }
+	inline float GetWheelAngularVelocity(uint8_t wheel) const { return m_WheelBodies[wheel]->GetAngularVelocity(); }
+
+	// Turns a wheel at its motor speed scaled by the throttle
+	void SetWheelThrottle(uint8_t wheel, float throttle);
 
 	inline int GetHealth() const { return m_Health; }
-	inline int GetFitness() const { return GetPosition().x <= 0.0f ? 0 : static_cast<int>(GetPosition().x); }
+	// Frozen when the car dies so that it only depends on the car itself
+	inline int GetFitness() const { return m_Fitness; }
+
+	inline float GetSimulatedTime() const { return m_SimulatedTime; }
 
 	inline bool IsDead() const { return m_Health <= 0; }
 
-	void Create(b2World &world, const CarProto &carProto);
+	inline KillReason GetKillReason() const { return m_KillReason; }
+	// At least how much longer the car would have run without the kill rules
+	inline float GetSavedTime() const { return m_SavedTime; }
+
+	// A cached car's fitness is already known, it only needs simulating
+	// if it is going to be shown.
+	inline bool IsCached() const { return m_Cached; }
+	inline float GetCachedTime() const { return m_CachedTime; }
+
+	// False for a cached car which was never given any bodies
+	inline bool IsSimulated() const { return m_ChassisBody != nullptr; }
+
+	CarPose GetPose() const;
+
+	// As of the last step, only meaningful for a car which was simulated
+	CarBehaviour GetBehaviour() const;
+
+	// Ids are handed out by the generation, so they are the same every time
+	// a run is replayed. A controlled car's controller has to outlive the
+	// car's first step, when its weights are gathered.
+	void Create(b2World &world, const CarProto &carProto, uint32_t carId, const ControllerProto *controller = nullptr);
+	// With the chassis shape already made, see MakeChassisShape
+	void Create(b2World &world, const CarProto &carProto, uint32_t carId, const b2PolygonShape &chassisShape,
+	            const ControllerProto *controller = nullptr);
+	void CreateCached(const CarProto &carProto, int fitness, float simulatedTime, uint32_t carId);
 	void Destory();
 
-	void Draw() const;
+	void SetCachedFitness(int fitness, float simulatedTime);
+
+	void Draw(DrawList &drawList) const;
+
+	// Draws a car without any bodies, e.g. from a recording. The chassis shape
+	// is the convex hull of the genome's vertices, see MakeChassisShape. The
+	// tint multiplies every colour and the depth offset moves the whole car
+	// in front of or behind others.
+	static void DrawPose(DrawList &drawList, const CarProto &carProto, const b2PolygonShape &chassisShape, const CarPose &pose,
+	                     const glm::vec4 &tint = glm::vec4(1.0f), float depthOffset = 0.0f);
+	static b2PolygonShape MakeChassisShape(const CarProto &carProto);
 
 	void Update(float delta);
 
+	// Called after Update. The floor is the lowest point of the terrain under
+	// the car, the finish is where the course ends and the target is the
+	// fitness the lagging rule compares it against.
+	void ApplyKillRules(const KillRules &rules, float delta, float floor, float finish, float targetFitness);
+
+	// Called after Update while the car is running, with the height of the
+	// ground under it
+	void TrackBehaviour(float delta, float groundHeight);
+
+	// Stops a car which is still running when its generation has to end
+	void CutOff();
+
 public:
-	static CarProto RandomProto();
+	static CarProto RandomProto(RandomStream &random);
+	// Gives a genome a controller with random weights
+	static void RandomController(CarProto &carProto, ControllerProto &controller, RandomStream &random);
+
+	// Whether every gene is within the range RandomProto draws it in and the
+	// breeder keeps it in, and the chassis is a polygon box2d can make. The
+	// server and the trajectory reader turn away anything else.
+	static bool IsValidProto(const CarProto &carProto);
+	static bool IsValidController(const ControllerProto &controller);
+
+	static const char *GetKillReasonName(KillReason reason);
+
+private:
+	void Kill(KillReason reason, float delta, const KillRules &rules);
+
+	bool IsTouchingGround() const;
 };
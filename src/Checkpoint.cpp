@@ -0,0 +1,218 @@
+#include "Checkpoint.h"
+#include "MappedFile.h"
+#include "Log.h"
+
+#include <cstring>
+#include <filesystem>
+
+bool Checkpoint::Save(const std::string &path, const State &state)
+{
+	Header header = {};
+	std::memcpy(header.Magic, kMagic, sizeof(kMagic));
+	header.Version = kVersion;
+	header.HeaderSize = sizeof(Header);
+	header.ProtoSize = sizeof(CarProto);
+	header.ControllerSize = sizeof(ControllerProto);
+
+	header.MasterSeed = state.MasterSeed;
+	header.RandomCounter = state.RandomCounter;
+	header.PhysicsProfile = state.PhysicsProfile;
+
+	header.TerrainSeed = state.TerrainSeed;
+	header.GenerationIndex = state.GenerationIndex;
+	header.NextCarId = state.NextCarId;
+	header.NumCars = static_cast<uint32_t>(state.Genomes.size());
+	header.HistorySize = static_cast<uint32_t>(state.BestFitnessHistory.size());
+
+	header.SelectionType = static_cast<uint32_t>(state.Selection.Type);
+	header.TournamentSize = static_cast<uint32_t>(state.Selection.TournamentSize);
+	header.TruncationRatio = state.Selection.TruncationRatio;
+	header.EliteCount = static_cast<uint32_t>(state.EliteCount);
+
+	header.TerrainCount = static_cast<uint32_t>(state.Evaluation.TerrainCount);
+	header.FitnessAggregation = static_cast<uint32_t>(state.Evaluation.Aggregation);
+	header.FitnessQuantile = state.Evaluation.Quantile;
+
+	BL_ASSERT(state.Controllers.empty() || state.Controllers.size() == state.Genomes.size(), "Every genome needs a controller or none does !");
+	header.NumControllers = static_cast<uint32_t>(std::min(state.Controllers.size(), state.Genomes.size()));
+
+	// One for each terrain, whatever the state was given
+	std::vector<float> targetFitness = state.TargetFitness;
+	targetFitness.resize(header.TerrainCount, 0.0f);
+
+	std::string tempPath = path + ".tmp";
+
+	FILE *file = std::fopen(tempPath.c_str(), "wb");
+	if (!file)
+	{
+		BL_LOG("Failed to open checkpoint '%s' for writing", tempPath.c_str());
+		return false;
+	}
+
+	bool written =    std::fwrite(&header, sizeof(header), 1, file) == 1
+	               && std::fwrite(state.Genomes.data(), sizeof(CarProto), header.NumCars, file) == header.NumCars
+	               && std::fwrite(state.Controllers.data(), sizeof(ControllerProto), header.NumControllers, file) == header.NumControllers
+	               && std::fwrite(state.BestFitnessHistory.data(), sizeof(float), header.HistorySize, file) == header.HistorySize
+	               && std::fwrite(targetFitness.data(), sizeof(float), header.TerrainCount, file) == header.TerrainCount;
+
+	written &= std::fclose(file) == 0;
+
+	if (!written)
+	{
+		BL_LOG("Failed to write checkpoint '%s'", tempPath.c_str());
+		return false;
+	}
+
+	std::error_code error;
+	std::filesystem::rename(tempPath, path, error);
+	if (error)
+	{
+		BL_LOG("Failed to replace checkpoint '%s': %s", path.c_str(), error.message().c_str());
+		return false;
+	}
+
+	return true;
+}
+
+bool Checkpoint::Load(const std::string &path, State &state)
+{
+	MappedFile file;
+	if (!file.Open(path))
+	{
+		BL_LOG("Failed to open checkpoint '%s'", path.c_str());
+		return false;
+	}
+
+	const uint8_t *data = file.GetData();
+	size_t size = file.GetSize();
+
+	if (size < sizeof(Header))
+	{
+		BL_LOG("'%s' is not a checkpoint", path.c_str());
+		return false;
+	}
+
+	Header header;
+	std::memcpy(&header, data, sizeof(header));
+
+	if (std::memcmp(header.Magic, kMagic, sizeof(kMagic)) != 0)
+	{
+		BL_LOG("'%s' is not a checkpoint", path.c_str());
+		return false;
+	}
+
+	if (   header.Version != kVersion
+	    || header.HeaderSize != sizeof(Header)
+	    || header.ProtoSize != sizeof(CarProto)
+	    || header.ControllerSize != sizeof(ControllerProto))
+	{
+		BL_LOG("Checkpoint '%s' is version %u, this build reads version %u", path.c_str(), header.Version, kVersion);
+		return false;
+	}
+
+	if (header.NumControllers != 0 && header.NumControllers != header.NumCars)
+	{
+		BL_LOG("Checkpoint '%s' has %u controllers for %u cars", path.c_str(), header.NumControllers, header.NumCars);
+		return false;
+	}
+
+	size_t genomesOffset = sizeof(Header);
+	size_t controllersOffset = genomesOffset + header.NumCars * sizeof(CarProto);
+	size_t historyOffset = controllersOffset + header.NumControllers * sizeof(ControllerProto);
+	size_t targetOffset = historyOffset + header.HistorySize * sizeof(float);
+
+	if (size < targetOffset + header.TerrainCount * sizeof(float))
+	{
+		BL_LOG("Checkpoint '%s' is truncated", path.c_str());
+		return false;
+	}
+
+	state.MasterSeed = header.MasterSeed;
+	state.RandomCounter = header.RandomCounter;
+	state.PhysicsProfile = header.PhysicsProfile;
+
+	state.TerrainSeed = header.TerrainSeed;
+	state.GenerationIndex = header.GenerationIndex;
+	state.NextCarId = header.NextCarId;
+
+	state.Selection.Type = static_cast<SelectionType>(std::min(header.SelectionType, static_cast<uint32_t>(SelectionType::Count) - 1));
+	state.Selection.TournamentSize = static_cast<int>(header.TournamentSize);
+	state.Selection.TruncationRatio = header.TruncationRatio;
+	state.EliteCount = static_cast<int>(header.EliteCount);
+
+	state.Evaluation.TerrainCount = std::max(static_cast<int>(header.TerrainCount), 1);
+	state.Evaluation.Aggregation = static_cast<FitnessAggregation>(std::min(header.FitnessAggregation, static_cast<uint32_t>(FitnessAggregation::Count) - 1));
+	state.Evaluation.Quantile = header.FitnessQuantile;
+
+	state.Genomes.resize(header.NumCars);
+	std::memcpy(state.Genomes.data(), data + genomesOffset, header.NumCars * sizeof(CarProto));
+
+	state.Controllers.resize(header.NumControllers);
+	std::memcpy(state.Controllers.data(), data + controllersOffset, header.NumControllers * sizeof(ControllerProto));
+
+	state.BestFitnessHistory.resize(header.HistorySize);
+	std::memcpy(state.BestFitnessHistory.data(), data + historyOffset, header.HistorySize * sizeof(float));
+
+	state.TargetFitness.resize(header.TerrainCount);
+	std::memcpy(state.TargetFitness.data(), data + targetOffset, header.TerrainCount * sizeof(float));
+
+	return true;
+}
+
+Checkpoint::Writer::Writer()
+	: m_Scheduled(false)
+{
+}
+
+Checkpoint::Writer::~Writer()
+{
+	// Anything still waiting is written first, the last checkpoint of a run
+	// is the one which matters most.
+	Flush();
+}
+
+void Checkpoint::Writer::Submit(const std::string &path, State &&state)
+{
+	bool schedule = false;
+
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+
+		m_PendingPath = path;
+		m_Pending = std::make_unique<State>(std::move(state));
+
+		schedule = !m_Scheduled;
+		m_Scheduled = true;
+	}
+
+	// Outside the lock, without workers the job runs right here
+	if (schedule)
+	{
+		m_Jobs.Run([this]() { Drain(); });
+	}
+}
+
+void Checkpoint::Writer::Flush()
+{
+	m_Jobs.Wait();
+}
+
+void Checkpoint::Writer::Drain()
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+
+	while (m_Pending)
+	{
+		std::unique_ptr<State> state = std::move(m_Pending);
+		std::string path = m_PendingPath;
+
+		lock.unlock();
+		if (Save(path, *state))
+		{
+			BL_LOG("Saved checkpoint of generation %u to '%s'", state->GenerationIndex, path.c_str());
+		}
+		lock.lock();
+	}
+
+	m_Scheduled = false;
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "Car.h"
+#include "Arena.h"
+#include "Selection.h"
+#include "JobSystem.h"
+
+// Periodic snapshots of a population, so a run can be picked up again
+// exactly where it was left rather than evolved again from scratch.
+namespace Checkpoint
+{
+	static constexpr char kMagic[4] = { 'B', 'L', 'C', 'P' };
+	static constexpr uint32_t kVersion = 6;
+
+	// Fixed layout, followed by NumCars CarProtos, NumControllers
+	// ControllerProtos, HistorySize floats and then TerrainCount floats, so
+	// every part of a mapped file can be used where it is. NumControllers is
+	// either NumCars or zero for a population without controllers.
+	struct Header
+	{
+		char Magic[4];
+		uint32_t Version;
+		uint32_t HeaderSize;
+		uint32_t ProtoSize;
+
+		uint64_t MasterSeed;
+		uint64_t RandomCounter;
+		uint64_t PhysicsProfile;
+
+		uint32_t TerrainSeed;
+		uint32_t GenerationIndex;
+		uint32_t NextCarId;
+		uint32_t NumCars;
+		uint32_t HistorySize;
+
+		uint32_t SelectionType;
+		uint32_t TournamentSize;
+		float TruncationRatio;
+		uint32_t EliteCount;
+
+		uint32_t TerrainCount;
+		uint32_t FitnessAggregation;
+		float FitnessQuantile;
+
+		uint32_t ControllerSize;
+		uint32_t NumControllers;
+	};
+
+	static_assert(sizeof(Header) == 96, "The checkpoint header layout must not change without a new version");
+
+	// Everything needed to carry on evolving a population
+	struct State
+	{
+		uint64_t MasterSeed = 0;
+		uint64_t RandomCounter = 0;
+		uint64_t PhysicsProfile = 0;
+
+		uint32_t TerrainSeed = 0;
+		uint32_t GenerationIndex = 0;
+		uint32_t NextCarId = 0;
+
+		SelectionSettings Selection;
+		int EliteCount = 0;
+		EvaluationSettings Evaluation;
+
+		std::vector<CarProto> Genomes;
+		// One for each genome, or none at all, see GenomeBatch
+		std::vector<ControllerProto> Controllers;
+		std::vector<float> BestFitnessHistory;
+
+		// Of the lagging kill rule on each terrain, see Arena::GetTargetFitness
+		std::vector<float> TargetFitness;
+	};
+
+	// Written to a temporary file which then replaces the old checkpoint, so
+	// there is always a complete one on disk.
+	bool Save(const std::string &path, const State &state);
+	bool Load(const std::string &path, State &state);
+
+	// Saves as a background job. Only the latest state matters, so one which
+	// is submitted while another is waiting replaces it.
+	class Writer
+	{
+	public:
+		Writer();
+		~Writer();
+
+		void Submit(const std::string &path, State &&state);
+
+		// Blocks until everything submitted has been written
+		void Flush();
+
+	private:
+		void Drain();
+
+	private:
+		std::mutex m_Mutex;
+		std::string m_PendingPath;
+		std::unique_ptr<State> m_Pending;
+		// Set while a job is queued or saving, it takes any later state too
+		bool m_Scheduled;
+
+		TaskGroup m_Jobs;
+	};
+}
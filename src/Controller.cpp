@@ -0,0 +1,193 @@
+#include "Controller.h"
+#include "Log.h"
+
+// Brings the sensed values to around one
+static constexpr float kVelocityScale = 0.05f;
+static constexpr float kWheelSpeedScale = 1.0f / CarConstants::kMaxWheelMotorSpeed;
+static constexpr float kHeightScale = 0.1f;
+
+// How far ahead of the chassis each terrain sensor looks
+static constexpr std::array<float, CarConstants::kNumTerrainSensors> kSensorDistances = { 5.0f, 10.0f, 20.0f };
+
+static constexpr size_t kFirstTerrainInput = 4;
+static constexpr size_t kFirstWheelInput = kFirstTerrainInput + CarConstants::kNumTerrainSensors;
+
+static constexpr size_t kNumHiddenWeights = CarConstants::kNumControllerHidden * (CarConstants::kNumControllerInputs + 1);
+
+// A rational fit of tanh, exact at zero and reaching one at three. Unlike
+// std::tanh it has no calls or branches, so the loop stays vectorised.
+static void Tanh(float *values, size_t count)
+{
+	for (size_t k = 0; k < count; k++)
+	{
+		float x = std::min(std::max(values[k], -3.0f), 3.0f);
+		float x2 = x * x;
+
+		values[k] = x * (27.0f + x2) / (27.0f + 9.0f * x2);
+	}
+}
+
+ControllerBatch::ControllerBatch()
+	: m_Created(false)
+{
+}
+
+void ControllerBatch::Create(Car *cars, size_t count)
+{
+	BL_ASSERT(!m_Created, "The controllers have already been created !");
+
+	m_Cars.clear();
+	for (size_t i = 0; i < count; i++)
+	{
+		if (cars[i].IsSimulated() && cars[i].GetController())
+		{
+			m_Cars.push_back(&cars[i]);
+		}
+	}
+
+	size_t size = m_Cars.size();
+
+	for (size_t w = 0; w < CarConstants::kNumControllerWeights; w++)
+	{
+		m_Weights[w].resize(size);
+
+		for (size_t k = 0; k < size; k++)
+		{
+			m_Weights[w][k] = m_Cars[k]->GetController()->Weights[w];
+		}
+	}
+
+	for (FloatArr &input : m_Inputs)
+	{
+		input.assign(size, 0.0f);
+	}
+
+	for (FloatArr &hidden : m_Hidden)
+	{
+		hidden.resize(size);
+	}
+
+	for (FloatArr &output : m_Outputs)
+	{
+		output.resize(size);
+	}
+
+	m_SampleX.resize(size * CarConstants::kNumTerrainSensors);
+	m_SampleHeight.resize(size * CarConstants::kNumTerrainSensors);
+
+	m_Created = true;
+}
+
+void ControllerBatch::Update(const Platform &terrain)
+{
+	if (m_Cars.empty())
+	{
+		return;
+	}
+
+	Sense(terrain);
+	Evaluate();
+	Apply();
+}
+
+void ControllerBatch::Sense(const Platform &terrain)
+{
+	size_t count = m_Cars.size();
+
+	for (size_t k = 0; k < count; k++)
+	{
+		const Car &car = *m_Cars[k];
+
+		float angle = car.GetAngle();
+		const b2Vec2 &position = car.GetPosition();
+		const b2Vec2 &velocity = car.GetVelocity();
+
+		m_Inputs[0][k] = std::sin(angle);
+		m_Inputs[1][k] = std::cos(angle);
+		m_Inputs[2][k] = velocity.x * kVelocityScale;
+		m_Inputs[3][k] = velocity.y * kVelocityScale;
+
+		// Heights are taken relative to the chassis once they are sampled
+		for (size_t s = 0; s < CarConstants::kNumTerrainSensors; s++)
+		{
+			m_SampleX[s * count + k] = position.x + kSensorDistances[s];
+			m_Inputs[kFirstTerrainInput + s][k] = position.y;
+		}
+
+		// Missing wheels sense nothing, the inputs start out zero
+		for (uint8_t j = 0; j < car.GetWheelCount(); j++)
+		{
+			m_Inputs[kFirstWheelInput + j][k] = car.GetWheelAngularVelocity(j) * kWheelSpeedScale;
+		}
+	}
+
+	// Every car's sensors in one query rather than a ray cast each
+	terrain.SampleHeights(m_SampleX.data(), m_SampleHeight.data(), m_SampleX.size());
+
+	for (size_t s = 0; s < CarConstants::kNumTerrainSensors; s++)
+	{
+		const float *heights = m_SampleHeight.data() + s * count;
+		float *input = m_Inputs[kFirstTerrainInput + s].data();
+
+		for (size_t k = 0; k < count; k++)
+		{
+			input[k] = (heights[k] - input[k]) * kHeightScale;
+		}
+	}
+}
+
+void ControllerBatch::Evaluate()
+{
+	size_t count = m_Cars.size();
+
+	for (size_t h = 0; h < CarConstants::kNumControllerHidden; h++)
+	{
+		const FloatArr *weights = &m_Weights[h * (CarConstants::kNumControllerInputs + 1)];
+		Layer(m_Inputs.data(), CarConstants::kNumControllerInputs, weights, m_Hidden[h], count);
+	}
+
+	for (size_t o = 0; o < CarConstants::kNumVertices; o++)
+	{
+		const FloatArr *weights = &m_Weights[kNumHiddenWeights + o * (CarConstants::kNumControllerHidden + 1)];
+		Layer(m_Hidden.data(), CarConstants::kNumControllerHidden, weights, m_Outputs[o], count);
+	}
+}
+
+void ControllerBatch::Layer(const FloatArr *inputs, size_t numInputs, const FloatArr *weights, FloatArr &output, size_t count)
+{
+	// The bias follows the input weights
+	float *out = output.data();
+	std::copy_n(weights[numInputs].data(), count, out);
+
+	for (size_t i = 0; i < numInputs; i++)
+	{
+		const float *weight = weights[i].data();
+		const float *input = inputs[i].data();
+
+		for (size_t k = 0; k < count; k++)
+		{
+			out[k] += weight[k] * input[k];
+		}
+	}
+
+	Tanh(out, count);
+}
+
+void ControllerBatch::Apply()
+{
+	for (size_t k = 0; k < m_Cars.size(); k++)
+	{
+		Car &car = *m_Cars[k];
+
+		// A dead car's motors have been stopped
+		if (car.IsDead())
+		{
+			continue;
+		}
+
+		for (uint8_t j = 0; j < car.GetWheelCount(); j++)
+		{
+			car.SetWheelThrottle(j, 1.0f + m_Outputs[j][k]);
+		}
+	}
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "Car.h"
+#include "Platform.h"
+
+// The wheel controllers of one world's cars. Each is a small fixed network,
+// from what its car senses to a throttle for every wheel, with its weights in
+// the car's ControllerProto. A wheel turns at its motor speed scaled by one plus the output,
+// so a controller with all zero weights drives just like no controller.
+//
+// The weights are copied into one array per weight across the cars, so a
+// whole layer of every car is a handful of branch free loops over the batch
+// rather than a small product per car.
+class ControllerBatch
+{
+public:
+	ControllerBatch();
+
+	// Takes the controlled cars of [cars, cars + count), which have to be
+	// created already and stay where they are. Their weights are copied, so
+	// the controllers the cars were given are no longer needed afterwards.
+	void Create(Car *cars, size_t count);
+
+	// Sets the motor speeds of every car still running from its state and
+	// the ground ahead of it on the terrain it is driving over
+	void Update(const Platform &terrain);
+
+	inline bool IsCreated() const { return m_Created; }
+	inline size_t GetSize() const { return m_Cars.size(); }
+
+private:
+	using FloatArr = std::vector<float>;
+
+	void Sense(const Platform &terrain);
+	void Evaluate();
+	void Apply();
+
+	static void Layer(const FloatArr *inputs, size_t numInputs, const FloatArr *weights, FloatArr &output, size_t count);
+
+private:
+	bool m_Created;
+	std::vector<Car *> m_Cars;
+
+	std::array<FloatArr, CarConstants::kNumControllerWeights> m_Weights;
+	std::array<FloatArr, CarConstants::kNumControllerInputs> m_Inputs;
+	std::array<FloatArr, CarConstants::kNumControllerHidden> m_Hidden;
+	std::array<FloatArr, CarConstants::kNumVertices> m_Outputs;
+
+	// Where the ground is sampled for each car, sensor by sensor
+	FloatArr m_SampleX;
+	FloatArr m_SampleHeight;
+};
@@ -0,0 +1,611 @@
+#include "EvalServer.h"
+#include "JobSystem.h"
+#include "Random.h"
+#include "Log.h"
+
+#include <chrono>
+#include <cstring>
+
+#ifdef _WIN32
+	#include <fcntl.h>
+	#include <io.h>
+#else
+	#include <cerrno>
+	#include <csignal>
+	#include <sys/socket.h>
+	#include <sys/un.h>
+	#include <unistd.h>
+#endif
+
+using Clock = std::chrono::steady_clock;
+
+// Stops a batch with a car which never dies from stalling the server
+static constexpr int kMaxStepsPerBatch = 60 * 60 * 5;
+
+static constexpr size_t kGenomesPerJob = 256;
+
+// Reads or writes all of `size` bytes, false once the stream has ended
+static bool ReadAll(int descriptor, void *data, size_t size)
+{
+	uint8_t *bytes = static_cast<uint8_t *>(data);
+
+	while (size > 0)
+	{
+#ifdef _WIN32
+		int result = _read(descriptor, bytes, static_cast<unsigned>(std::min<size_t>(size, 1u << 30)));
+#else
+		ssize_t result = read(descriptor, bytes, size);
+		if (result < 0 && errno == EINTR)
+		{
+			continue;
+		}
+#endif
+		if (result <= 0)
+		{
+			return false;
+		}
+
+		bytes += result;
+		size -= static_cast<size_t>(result);
+	}
+
+	return true;
+}
+
+static bool WriteAll(int descriptor, const void *data, size_t size)
+{
+	const uint8_t *bytes = static_cast<const uint8_t *>(data);
+
+	while (size > 0)
+	{
+#ifdef _WIN32
+		int result = _write(descriptor, bytes, static_cast<unsigned>(std::min<size_t>(size, 1u << 30)));
+#else
+		ssize_t result = write(descriptor, bytes, size);
+		if (result < 0 && errno == EINTR)
+		{
+			continue;
+		}
+#endif
+		if (result <= 0)
+		{
+			return false;
+		}
+
+		bytes += result;
+		size -= static_cast<size_t>(result);
+	}
+
+	return true;
+}
+
+static void CloseDescriptor(int descriptor)
+{
+	if (descriptor >= 0)
+	{
+#ifdef _WIN32
+		_close(descriptor);
+#else
+		close(descriptor);
+#endif
+	}
+}
+
+static bool MakePipe(int descriptors[2])
+{
+#ifdef _WIN32
+	return _pipe(descriptors, 1 << 20, _O_BINARY) == 0;
+#else
+	return pipe(descriptors) == 0;
+#endif
+}
+
+// A peer going away shows up as a failed write instead of ending the process
+static void IgnoreBrokenPipes()
+{
+#ifndef _WIN32
+	signal(SIGPIPE, SIG_IGN);
+#endif
+}
+
+EvalServer::EvalServer()
+	: m_ArenaSeed(0)
+	, m_NextCarId(0)
+{
+}
+
+void EvalServer::Create(const EvalServerSettings &settings)
+{
+	m_Settings = settings;
+	m_Stats = EvalServerStats();
+
+	if (m_Settings.TerrainSeed == 0)
+	{
+		// A local server is created on a thread of its own
+		RandomStream random = Random::MakeStream(Random::kServerStream);
+		m_Settings.TerrainSeed = random.Int(1u, std::numeric_limits<uint32_t>::max() - 1);
+	}
+
+	m_Arenas.clear();
+	m_ArenaSeed = 0;
+	m_NextCarId = 0;
+}
+
+bool EvalServer::IsValidGenome(const CarProto &carProto, const ControllerProto *controller)
+{
+	return Car::IsValidProto(carProto) && (!carProto.Controlled || (controller && Car::IsValidController(*controller)));
+}
+
+void EvalServer::PrepareArenas(uint32_t terrainSeed, size_t count)
+{
+	size_t terrainCount = static_cast<size_t>(std::max(m_Settings.Evaluation.TerrainCount, 1));
+
+	if (terrainSeed == m_ArenaSeed && m_Arenas.size() == terrainCount)
+	{
+		JobSystem::ParallelFor(m_Arenas.size(), 1, [this, count](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+			{
+				m_Arenas[i]->Reset(count);
+			}
+		});
+
+		return;
+	}
+
+	// Another terrain, its arenas are made afresh
+	m_Arenas.clear();
+	m_Arenas.resize(terrainCount);
+	for (size_t i = 0; i < terrainCount; i++)
+	{
+		m_Arenas[i] = std::make_unique<Arena>();
+		m_Arenas[i]->Create(Arena::MakeTerrainSeed(terrainSeed, static_cast<int>(i)), count);
+	}
+
+	m_ArenaSeed = terrainSeed;
+}
+
+void EvalServer::CreateCars(const CarProto *genomes, const ControllerProto *controllers, size_t count)
+{
+	m_Valid.resize(count);
+	m_ChassisShapes.resize(count);
+
+	JobSystem::ParallelFor(count, kGenomesPerJob, [this, genomes, controllers](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			m_Valid[i] = IsValidGenome(genomes[i], controllers ? &controllers[i] : nullptr) ? 1 : 0;
+
+			if (m_Valid[i])
+			{
+				m_ChassisShapes[i] = Car::MakeChassisShape(genomes[i]);
+			}
+		}
+	});
+
+	// A genome has the same car id on every terrain
+	uint32_t firstCarId = m_NextCarId;
+	m_NextCarId += static_cast<uint32_t>(count);
+
+	// Each world only has its own cars added to it, so the worlds are filled
+	// as separate jobs. Genomes which cannot be built stand in as cached cars
+	// which are done at once, their results are errors.
+	for (auto &arena : m_Arenas)
+	{
+		JobSystem::ParallelFor(arena->GetWorldCount(), 1, [&](size_t begin, size_t end)
+		{
+			size_t first = begin * ArenaConstants::kCarsPerWorld;
+			size_t last = std::min(end * ArenaConstants::kCarsPerWorld, count);
+
+			for (size_t i = first; i < last; i++)
+			{
+				Car &car = arena->GetCar(i);
+				uint32_t carId = firstCarId + static_cast<uint32_t>(i);
+
+				if (m_Valid[i])
+				{
+					car.Create(arena->GetWorld(i), genomes[i], carId, m_ChassisShapes[i], controllers ? &controllers[i] : nullptr);
+				}
+				else
+				{
+					car.CreateCached(genomes[i], 0, 0.0f, carId);
+				}
+			}
+		});
+	}
+}
+
+void EvalServer::Simulate()
+{
+	for (int step = 0; step < kMaxStepsPerBatch; step++)
+	{
+		// Arenas share nothing, so each terrain is stepped as its own job
+		JobSystem::ParallelFor(m_Arenas.size(), 1, [this](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+			{
+				if (!m_Arenas[i]->IsDone())
+				{
+					m_Arenas[i]->Step(k_UpdateDeltaTime, m_Settings.Kill);
+				}
+			}
+		});
+
+		if (std::all_of(m_Arenas.begin(), m_Arenas.end(), [](const auto &arena) { return arena->IsDone(); }))
+		{
+			return;
+		}
+	}
+
+	BL_LOG("A batch did not finish in %d steps, cutting its cars off", kMaxStepsPerBatch);
+
+	for (auto &arena : m_Arenas)
+	{
+		arena->CutOff();
+	}
+}
+
+void EvalServer::Evaluate(const CarProto *genomes, const ControllerProto *controllers, size_t count, uint32_t terrainSeed,
+                          EvalProtocol::Result *results, EvalProtocol::Summary *summaries)
+{
+	if (count == 0)
+	{
+		return;
+	}
+
+	Clock::time_point start = Clock::now();
+
+	PrepareArenas(terrainSeed != 0 ? terrainSeed : m_Settings.TerrainSeed, count);
+	CreateCars(genomes, controllers, count);
+	Simulate();
+
+	const Arena &first = *m_Arenas.front();
+	size_t numTerrains = m_Arenas.size();
+
+	std::vector<float> terrainFitness(numTerrains);
+	size_t numInvalid = 0;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		for (size_t t = 0; t < numTerrains; t++)
+		{
+			terrainFitness[t] = static_cast<float>(m_Arenas[t]->GetCar(i).GetFitness());
+		}
+
+		const Car &car = first.GetCar(i);
+
+		EvalProtocol::Result &result = results[i];
+		result = EvalProtocol::Result();
+		result.SimulatedTime = car.GetSimulatedTime();
+		result.Reason = car.GetKillReason();
+
+		if (m_Valid[i])
+		{
+			result.Fitness = m_Settings.Evaluation.Aggregate(terrainFitness.data(), numTerrains);
+		}
+		else
+		{
+			result.Fitness = std::numeric_limits<float>::quiet_NaN();
+			result.Code = EvalProtocol::ResultCode::InvalidGenome;
+		}
+
+		if (summaries)
+		{
+			summaries[i] = car.GetBehaviour();
+		}
+
+		numInvalid += m_Valid[i] ? 0 : 1;
+	}
+
+	m_Stats.Batches++;
+	m_Stats.Genomes += count;
+	m_Stats.InvalidGenomes += numInvalid;
+	m_Stats.EvaluateSeconds += std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+bool EvalServer::Serve(int in, int out)
+{
+	using namespace EvalProtocol;
+
+	RequestHeader request;
+	while (ReadAll(in, &request, sizeof(request)))
+	{
+		ResponseHeader response;
+		response.Flags = request.Flags;
+		response.TerrainSeed = request.TerrainSeed != 0 ? request.TerrainSeed : m_Settings.TerrainSeed;
+
+		// Nothing after a bad header can be trusted to line up, so the
+		// connection is dropped
+		bool wellFormed = request.Magic == kMagic && request.Version == kVersion && request.GenomeSize == sizeof(CarProto)
+		                  && request.ControllerSize == sizeof(ControllerProto)
+		                  && (request.Type == MessageType::Evaluate || request.Type == MessageType::Quit);
+
+		if (!wellFormed || request.Count > m_Settings.MaxBatchSize)
+		{
+			BL_LOG("Refusing a request of %u genomes, closing the connection", request.Count);
+
+			response.Code = wellFormed ? Status::TooManyGenomes : Status::BadRequest;
+			WriteAll(out, &response, sizeof(response));
+			return false;
+		}
+
+		if (request.Type == MessageType::Quit)
+		{
+			WriteAll(out, &response, sizeof(response));
+			return true;
+		}
+
+		size_t count = request.Count;
+		bool wantSummaries = (request.Flags & kWantSummaries) != 0;
+		bool hasControllers = (request.Flags & kHasControllers) != 0;
+
+		m_Genomes.resize(count);
+		m_Controllers.resize(hasControllers ? count : 0);
+		if (   !ReadAll(in, m_Genomes.data(), count * sizeof(CarProto))
+		    || !ReadAll(in, m_Controllers.data(), m_Controllers.size() * sizeof(ControllerProto)))
+		{
+			return false;
+		}
+
+		m_Results.resize(count);
+		m_Summaries.resize(wantSummaries ? count : 0);
+
+		double secondsBefore = m_Stats.EvaluateSeconds;
+		Evaluate(m_Genomes.data(), hasControllers ? m_Controllers.data() : nullptr, count, request.TerrainSeed,
+		         m_Results.data(), wantSummaries ? m_Summaries.data() : nullptr);
+
+		response.Count = request.Count;
+		response.Seconds = static_cast<float>(m_Stats.EvaluateSeconds - secondsBefore);
+
+		if (!WriteAll(out, &response, sizeof(response))
+		    || !WriteAll(out, m_Results.data(), count * sizeof(Result))
+		    || (wantSummaries && !WriteAll(out, m_Summaries.data(), count * sizeof(Summary))))
+		{
+			return false;
+		}
+	}
+
+	return false;
+}
+
+int EvalServer::Run(const EvalServerSettings &settings)
+{
+	EvalServer server;
+	server.Create(settings);
+
+	IgnoreBrokenPipes();
+
+	if (settings.SocketPath.empty())
+	{
+		// Stdout carries the responses, anything logged goes to stderr
+		fflush(stdout);
+#ifdef _WIN32
+		_setmode(_fileno(stdin), _O_BINARY);
+		int in = _fileno(stdin);
+		int out = _dup(_fileno(stdout));
+		_setmode(out, _O_BINARY);
+		_dup2(_fileno(stderr), _fileno(stdout));
+#else
+		int in = STDIN_FILENO;
+		int out = dup(STDOUT_FILENO);
+		dup2(STDERR_FILENO, STDOUT_FILENO);
+#endif
+
+		fprintf(stderr, "Serving evaluations on stdin and stdout, terrain seed %u\n", server.GetTerrainSeed());
+
+		server.Serve(in, out);
+		CloseDescriptor(out);
+	}
+	else
+	{
+#ifdef _WIN32
+		fprintf(stderr, "Serving on a socket is not supported on this platform, serve stdin and stdout instead\n");
+		return 1;
+#else
+		sockaddr_un address = {};
+		address.sun_family = AF_UNIX;
+
+		if (settings.SocketPath.size() >= sizeof(address.sun_path))
+		{
+			fprintf(stderr, "Socket path %s is too long\n", settings.SocketPath.c_str());
+			return 1;
+		}
+		std::strcpy(address.sun_path, settings.SocketPath.c_str());
+
+		// Left behind by a server which did not stop cleanly
+		unlink(settings.SocketPath.c_str());
+
+		int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (listener < 0 || bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 || listen(listener, 1) != 0)
+		{
+			fprintf(stderr, "Could not listen on %s\n", settings.SocketPath.c_str());
+			CloseDescriptor(listener);
+			return 1;
+		}
+
+		fprintf(stderr, "Serving evaluations on %s, terrain seed %u\n", settings.SocketPath.c_str(), server.GetTerrainSeed());
+
+		bool quit = false;
+		while (!quit)
+		{
+			int client = accept(listener, nullptr, nullptr);
+			if (client < 0)
+			{
+				if (errno == EINTR)
+				{
+					continue;
+				}
+				break;
+			}
+
+			quit = server.Serve(client, client);
+			CloseDescriptor(client);
+		}
+
+		CloseDescriptor(listener);
+		unlink(settings.SocketPath.c_str());
+#endif
+	}
+
+	const EvalServerStats &stats = server.GetStats();
+	fprintf(stderr, "Evaluated %llu genomes in %llu batches, %llu invalid, %.3f seconds simulating\n",
+		static_cast<unsigned long long>(stats.Genomes), static_cast<unsigned long long>(stats.Batches),
+		static_cast<unsigned long long>(stats.InvalidGenomes), stats.EvaluateSeconds);
+
+	return 0;
+}
+
+EvalClient::EvalClient()
+	: m_In(-1)
+	, m_Out(-1)
+{
+}
+
+EvalClient::~EvalClient()
+{
+	Close();
+}
+
+bool EvalClient::Connect(const std::string &socketPath)
+{
+	Close();
+
+#ifdef _WIN32
+	return false;
+#else
+	sockaddr_un address = {};
+	address.sun_family = AF_UNIX;
+
+	if (socketPath.size() >= sizeof(address.sun_path))
+	{
+		return false;
+	}
+	std::strcpy(address.sun_path, socketPath.c_str());
+
+	IgnoreBrokenPipes();
+
+	int descriptor = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (descriptor < 0 || connect(descriptor, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0)
+	{
+		CloseDescriptor(descriptor);
+		return false;
+	}
+
+	m_In = descriptor;
+	m_Out = descriptor;
+
+	return true;
+#endif
+}
+
+bool EvalClient::StartLocal(const EvalServerSettings &settings)
+{
+	Close();
+	IgnoreBrokenPipes();
+
+	int toServer[2], toClient[2];
+	if (!MakePipe(toServer))
+	{
+		return false;
+	}
+	if (!MakePipe(toClient))
+	{
+		CloseDescriptor(toServer[0]);
+		CloseDescriptor(toServer[1]);
+		return false;
+	}
+
+	m_In = toClient[0];
+	m_Out = toServer[1];
+
+	// Its ends are closed as soon as it stops, as a process exiting would,
+	// so a client still writing to it fails rather than blocks
+	m_LocalServer = std::thread([settings, in = toServer[0], out = toClient[1]]()
+	{
+		EvalServer server;
+		server.Create(settings);
+		server.Serve(in, out);
+
+		CloseDescriptor(in);
+		CloseDescriptor(out);
+	});
+
+	return true;
+}
+
+void EvalClient::Close()
+{
+	CloseDescriptor(m_Out);
+	if (m_In != m_Out)
+	{
+		CloseDescriptor(m_In);
+	}
+	m_In = -1;
+	m_Out = -1;
+
+	// The local server stops once its end of the request pipe is closed
+	if (m_LocalServer.joinable())
+	{
+		m_LocalServer.join();
+	}
+}
+
+bool EvalClient::Evaluate(const CarProto *genomes, const ControllerProto *controllers, size_t count, uint32_t terrainSeed, bool wantSummaries,
+                          std::vector<EvalProtocol::Result> &results, std::vector<EvalProtocol::Summary> &summaries,
+                          float *serverSeconds)
+{
+	using namespace EvalProtocol;
+
+	RequestHeader request;
+	request.Count = static_cast<uint32_t>(count);
+	request.Flags = (wantSummaries ? kWantSummaries : 0) | (controllers ? kHasControllers : 0);
+	request.TerrainSeed = terrainSeed;
+
+	if (   !WriteAll(m_Out, &request, sizeof(request))
+	    || !WriteAll(m_Out, genomes, count * sizeof(CarProto))
+	    || (controllers && !WriteAll(m_Out, controllers, count * sizeof(ControllerProto))))
+	{
+		return false;
+	}
+
+	ResponseHeader response;
+	if (!ReadAll(m_In, &response, sizeof(response)) || response.Magic != kMagic || response.Code != Status::Ok
+	    || response.Count != request.Count)
+	{
+		return false;
+	}
+
+	results.resize(count);
+	if (!ReadAll(m_In, results.data(), count * sizeof(Result)))
+	{
+		return false;
+	}
+
+	if (wantSummaries)
+	{
+		summaries.resize(count);
+		if (!ReadAll(m_In, summaries.data(), count * sizeof(Summary)))
+		{
+			return false;
+		}
+	}
+
+	if (serverSeconds)
+	{
+		*serverSeconds = response.Seconds;
+	}
+
+	return true;
+}
+
+bool EvalClient::Quit()
+{
+	using namespace EvalProtocol;
+
+	RequestHeader request;
+	request.Type = MessageType::Quit;
+
+	ResponseHeader response;
+	return WriteAll(m_Out, &request, sizeof(request)) && ReadAll(m_In, &response, sizeof(response))
+	       && response.Code == Status::Ok;
+}
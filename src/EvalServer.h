@@ -0,0 +1,219 @@
+#pragma once
+
+#include "Arena.h"
+
+#include <thread>
+
+// Wire format of `Blobolution --serve`. Every message is a header followed by
+// its arrays, in the machine's own byte order and laid out as declared, so
+// genomes and results are copied straight between the stream and the buffers
+// they are used from. Genomes are CarProto and controllers ControllerProto as
+// they are, see Car.h.
+namespace EvalProtocol
+{
+	static constexpr uint32_t kMagic = 0x56454C42; // "BLEV"
+	static constexpr uint32_t kVersion = 3;
+
+	enum class MessageType : uint32_t
+	{
+		Evaluate = 1,
+
+		// Answered with an empty response, then the server stops
+		Quit
+	};
+
+	enum class Status : uint32_t
+	{
+		Ok = 0,
+
+		// The server closes the connection after either of these
+		BadRequest,
+		TooManyGenomes
+	};
+
+	// Why a genome has no fitness, per result
+	enum class ResultCode : uint8_t
+	{
+		Ok = 0,
+
+		// A gene is outside the range the program draws and breeds it in,
+		// or the chassis is not a polygon box2d can make, see
+		// Car::IsValidProto. No car is built and its fitness is NaN.
+		InvalidGenome
+	};
+
+	// Asks for a Summary of every genome's run after the results
+	static constexpr uint32_t kWantSummaries = 1u << 0;
+	// Count controllers follow the genomes, only those of controlled genomes
+	// are used. A controlled genome in a batch without them is invalid.
+	static constexpr uint32_t kHasControllers = 1u << 1;
+
+	// Followed by Count genomes, then Count controllers with kHasControllers
+	struct RequestHeader
+	{
+		uint32_t Magic = kMagic;
+		uint32_t Version = kVersion;
+		MessageType Type = MessageType::Evaluate;
+		uint32_t Count = 0;
+		uint32_t Flags = 0;
+
+		// Zero evaluates on the server's own terrains
+		uint32_t TerrainSeed = 0;
+
+		// sizeof(CarProto) and sizeof(ControllerProto) as the client sees them
+		uint32_t GenomeSize = sizeof(CarProto);
+		uint32_t ControllerSize = sizeof(ControllerProto);
+	};
+
+	// Followed by Count results, then Count summaries when they were asked for
+	struct ResponseHeader
+	{
+		uint32_t Magic = kMagic;
+		uint32_t Version = kVersion;
+		Status Code = Status::Ok;
+		uint32_t Count = 0;
+		uint32_t Flags = 0;
+		uint32_t TerrainSeed = 0;
+
+		// Wall-clock time the server spent simulating, what is left of a
+		// round trip is the protocol's
+		float Seconds = 0.0f;
+	};
+
+	struct Result
+	{
+		// Over every terrain, aggregated as the server was told, NaN unless
+		// the code is Ok
+		float Fitness = 0.0f;
+
+		// On the first terrain
+		float SimulatedTime = 0.0f;
+		KillReason Reason = KillReason::None;
+
+		ResultCode Code = ResultCode::Ok;
+		uint8_t Padding[2] = {};
+	};
+
+	// How the car behaved on the first terrain
+	using Summary = CarBehaviour;
+
+	static_assert(sizeof(RequestHeader) == 8 * sizeof(uint32_t), "RequestHeader must not contain any implicit padding");
+	static_assert(sizeof(ResponseHeader) == 7 * sizeof(uint32_t), "ResponseHeader must not contain any implicit padding");
+	static_assert(sizeof(Result) == 3 * sizeof(uint32_t), "Result must not contain any implicit padding");
+	static_assert(std::is_trivially_copyable_v<Summary>, "Summary must stay memcpy-able");
+}
+
+struct EvalServerSettings
+{
+	// Listens on this Unix domain socket when set, serving one client at a
+	// time, otherwise serves stdin and stdout
+	std::string SocketPath;
+
+	// Zero picks a random terrain when the server starts
+	uint32_t TerrainSeed = 0;
+
+	EvaluationSettings Evaluation;
+	KillRules Kill;
+
+	// Larger batches are refused
+	uint32_t MaxBatchSize = 1 << 16;
+};
+
+struct EvalServerStats
+{
+	uint64_t Batches = 0;
+	uint64_t Genomes = 0;
+	uint64_t InvalidGenomes = 0;
+	double EvaluateSeconds = 0.0;
+};
+
+// Evaluates batches of genomes for tools outside the program. The arenas of
+// the last batch are kept, so a batch on the same terrain only destroys the
+// old cars and creates the new ones. Every genome of a batch is simulated at
+// once, on every terrain, as a generation would be.
+class EvalServer
+{
+public:
+	EvalServer();
+
+	void Create(const EvalServerSettings &settings);
+
+	// Answers requests read from `in` on `out` until asked to quit or the
+	// stream ends. True when it was asked to quit.
+	bool Serve(int in, int out);
+
+	// Results, and summaries when not null, for `count` genomes. Controllers
+	// are either null or one for each genome.
+	void Evaluate(const CarProto *genomes, const ControllerProto *controllers, size_t count, uint32_t terrainSeed,
+	              EvalProtocol::Result *results, EvalProtocol::Summary *summaries);
+
+	inline uint32_t GetTerrainSeed() const { return m_Settings.TerrainSeed; }
+	inline const EvalServerStats &GetStats() const { return m_Stats; }
+
+public:
+	// Serves stdin and stdout, or every client of the socket in turn
+	static int Run(const EvalServerSettings &settings);
+
+	// Whether a car can be built from the genome, which may come from anywhere,
+	// with every gene in the range CarConstants gives it. A controlled genome
+	// needs a controller.
+	static bool IsValidGenome(const CarProto &carProto, const ControllerProto *controller);
+
+private:
+	void PrepareArenas(uint32_t terrainSeed, size_t count);
+	void CreateCars(const CarProto *genomes, const ControllerProto *controllers, size_t count);
+	void Simulate();
+
+private:
+	EvalServerSettings m_Settings;
+	EvalServerStats m_Stats;
+
+	// One per terrain, for the seed they were made for
+	std::vector<std::unique_ptr<Arena>> m_Arenas;
+	uint32_t m_ArenaSeed;
+	uint32_t m_NextCarId;
+
+	// Reused between batches
+	std::vector<CarProto> m_Genomes;
+	std::vector<ControllerProto> m_Controllers;
+	std::vector<uint8_t> m_Valid;
+	std::vector<b2PolygonShape> m_ChassisShapes;
+	std::vector<EvalProtocol::Result> m_Results;
+	std::vector<EvalProtocol::Summary> m_Summaries;
+};
+
+// Stand-in for the tools which drive a server, used by `--bench server`
+class EvalClient
+{
+public:
+	EvalClient();
+	~EvalClient();
+
+	EvalClient(const EvalClient &) = delete;
+	EvalClient &operator=(const EvalClient &) = delete;
+
+	// To a server listening on a socket
+	bool Connect(const std::string &socketPath);
+
+	// To a server of its own, run on another thread and spoken to over pipes
+	// as a child process would be
+	bool StartLocal(const EvalServerSettings &settings);
+
+	void Close();
+
+	// Summaries are only filled when asked for, controllers are sent when not
+	// null. False when the server could not be reached or refused the batch.
+	bool Evaluate(const CarProto *genomes, const ControllerProto *controllers, size_t count, uint32_t terrainSeed, bool wantSummaries,
+	              std::vector<EvalProtocol::Result> &results, std::vector<EvalProtocol::Summary> &summaries,
+	              float *serverSeconds = nullptr);
+
+	// Stops the server
+	bool Quit();
+
+private:
+	// Both the same for a socket
+	int m_In;
+	int m_Out;
+
+	std::thread m_LocalServer;
+};
@@ -0,0 +1,84 @@
+#include "FitnessCache.h"
+#include "Log.h"
+
+template <typename T>
+static uint64_t HashValue(const T &value, uint64_t hash)
+{
+	static_assert(std::is_trivially_copyable_v<T>, "Only plain values can be hashed");
+
+	return FitnessCache::HashBytes(&value, sizeof(T), hash);
+}
+
+FitnessCache::FitnessCache()
+{
+}
+
+void FitnessCache::Clear()
+{
+	m_Entries.clear();
+	m_Stats = Stats();
+}
+
+const FitnessCache::Entry *FitnessCache::Find(Key key)
+{
+	m_Stats.Lookups++;
+
+	auto it = m_Entries.find(key);
+	if (it == m_Entries.end())
+	{
+		return nullptr;
+	}
+
+	m_Stats.Hits++;
+	m_Stats.SimulatedTimeSaved += it->second.SimulatedTime;
+
+	return &it->second;
+}
+
+const FitnessCache::Entry *FitnessCache::Peek(Key key) const
+{
+	auto it = m_Entries.find(key);
+
+	return it != m_Entries.end() ? &it->second : nullptr;
+}
+
+void FitnessCache::Store(Key key, const Entry &entry)
+{
+	if (m_Entries.size() >= kMaxEntries)
+	{
+		BL_LOG("Fitness cache is full, clearing %zu entries", m_Entries.size());
+		m_Entries.clear();
+	}
+
+	m_Entries[key] = entry;
+}
+
+FitnessCache::Key FitnessCache::MakeKey(const CarProto &carProto, const ControllerProto *controller, uint32_t terrainSeed, uint64_t physicsProfile)
+{
+	uint64_t hash = kHashBasis;
+
+	hash = HashValue(terrainSeed, hash);
+	hash = HashValue(physicsProfile, hash);
+	hash = HashValue(carProto, hash);
+
+	if (carProto.Controlled && controller)
+	{
+		hash = HashValue(*controller, hash);
+	}
+
+	return hash;
+}
+
+uint64_t FitnessCache::HashBytes(const void *data, size_t size, uint64_t basis)
+{
+	const uint8_t *bytes = static_cast<const uint8_t*>(data);
+
+	uint64_t hash = basis;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= kHashPrime;
+	}
+
+	return hash;
+}
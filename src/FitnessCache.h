@@ -0,0 +1,60 @@
+#pragma once
+
+#include "Car.h"
+
+#include <unordered_map>
+
+// Physics is deterministic for a given terrain and build, so the fitness of a
+// genome only has to be simulated once. Entries are keyed by a hash of the
+// genome, the terrain seed and the physics profile.
+class FitnessCache
+{
+public:
+	struct Entry
+	{
+		int Fitness = 0;
+		float SimulatedTime = 0.0f;
+	};
+
+	struct Stats
+	{
+		uint64_t Lookups = 0;
+		uint64_t Hits = 0;
+		double SimulatedTimeSaved = 0.0;
+
+		float GetHitRate() const { return Lookups > 0 ? static_cast<float>(Hits) / static_cast<float>(Lookups) : 0.0f; }
+	};
+
+	using Key = uint64_t;
+
+public:
+	FitnessCache();
+
+	void Clear();
+
+	const Entry *Find(Key key);
+	// Find without counting towards the stats
+	const Entry *Peek(Key key) const;
+	void Store(Key key, const Entry &entry);
+
+	inline const Stats &GetStats() const { return m_Stats; }
+	inline size_t GetSize() const { return m_Entries.size(); }
+
+public:
+	// A controlled car's controller is part of the key, see Car::Create
+	static Key MakeKey(const CarProto &carProto, const ControllerProto *controller, uint32_t terrainSeed, uint64_t physicsProfile);
+
+	// 64-bit FNV-1a, pass the previous result as the basis to chain calls
+	static uint64_t HashBytes(const void *data, size_t size, uint64_t basis = kHashBasis);
+
+private:
+	static constexpr uint64_t kHashBasis = 14695981039346656037ull;
+	static constexpr uint64_t kHashPrime = 1099511628211ull;
+
+	// Bounds the memory used by long runs, the cache is simply emptied
+	static constexpr size_t kMaxEntries = 1 << 20;
+
+private:
+	std::unordered_map<Key, Entry> m_Entries;
+	Stats m_Stats;
+};
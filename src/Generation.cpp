@@ -2,83 +2,299 @@
 #include "Random.h"
 #include "Log.h"
 
-#include <box2d/box2d.h>
+#include <chrono>
+#include <filesystem>
 
-template <typename T, typename U>
-static T& mutate(T &value, U amount, T min, T max)
-{
-	value += amount;
+#include <box2d/box2d.h>
 
-	if (value < min)
-		value = min;
-	if (value > max)
-		value = max;
+using namespace ArenaConstants;
 
-	return value;
-}
+// Enough work per job to be worth handing out, few enough lists to merge
+static constexpr size_t kCarsPerDrawList = 128;
 
-template <typename T>
-static T& offset(T &value, T amount)
+Generation::Generation()
+	: m_SparePopulated(false)
+	, m_TerrainSeed(0)
+	, m_PhysicsProfile(0)
+	, m_Replayable(false)
+	, m_Step(0)
+	, m_NextCarId(0)
+	, m_GenerationIndex(0)
+	, m_TotalTimeSaved(0.0)
+	, m_TotalSimulatedCars(0)
+	, m_CutOffCount(0)
+	, m_BreedingStarted(false)
 {
-	value += amount;
-
-	return value;
 }
 
-Generation::Generation()
-	: m_World(nullptr)
-	, m_Platform(nullptr)
-	, m_Cars(0)
+Generation::~Generation()
 {
+	m_Breeding.Wait();
 }
 
-Generation::~Generation()
+void Generation::Create(const GenerationSettings &settings)
 {
-	if (!m_World)
+	// Offspring and spare arenas of the run being replaced are not needed
+	m_Breeding.Wait();
+	m_BreedingStarted = false;
+
+	m_SpareBuild.Wait();
+
+	RetireArenas(std::move(m_SpareArenas));
+	m_SparePopulated = false;
+
+	m_Settings = settings;
+	m_GenerationIndex = 0;
+	m_NextCarId = 0;
+	m_BestFitnessHistory.clear();
+	m_LastFitness.clear();
+	m_ChampionTerrainFitness.clear();
+	m_Ghosts.clear();
+	m_KillStats = KillStats();
+	m_TotalTimeSaved = 0.0;
+	m_TotalSimulatedCars = 0;
+	m_GenerationSeconds.clear();
+	m_TurnoverSeconds.clear();
+	m_CutOffCount = 0;
+	m_Optimizer.reset();
+	m_Surrogate.Reset();
+	m_Novelty.Reset();
+	m_NoveltyStats = NoveltyStats();
+
+	m_PhysicsProfile = MakePhysicsProfile();
+
+	Checkpoint::State state;
+	bool restoring = false;
+	bool resuming = false;
+
+	// A replay is asked for on its own, any checkpoint the run was resumed
+	// from before does not apply to it
+	if (!m_Settings.ReplayLogPath.empty())
 	{
-		return;
+		restoring = LoadReplay(state);
 	}
+	else if (!m_Settings.ResumePath.empty())
+	{
+		auto start = std::chrono::steady_clock::now();
+
+		restoring = Checkpoint::Load(m_Settings.ResumePath, state);
+		resuming = restoring;
 
-	m_Platform->Destory();
-	for (auto &car : m_Cars)
+		if (restoring)
+		{
+			m_Settings.Selection = state.Selection;
+			m_Settings.EliteCount = state.EliteCount;
+
+			BL_LOG("Resumed generation %u from '%s' in %.2fms", state.GenerationIndex, m_Settings.ResumePath.c_str(),
+				std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+		}
+	}
+
+	if (restoring)
 	{
-		car->Destory();
+		if (state.PhysicsProfile != m_PhysicsProfile)
+		{
+			BL_LOG("The population was evolved with different physics settings, it will not carry on the same way");
+		}
+
+		// Every stream is derived from the master seed, so restoring it and the
+		// offset of the generation stream puts the run back where it was.
+		Random::Seed(state.MasterSeed);
+
+		m_Random = Random::MakeStream(Random::kGenerationStream);
+		m_Random.SetCounter(state.RandomCounter);
+
+		m_TerrainSeed = state.TerrainSeed;
+		m_GenerationIndex = static_cast<int>(state.GenerationIndex);
+		m_NextCarId = state.NextCarId;
+		m_BestFitnessHistory = std::move(state.BestFitnessHistory);
+		m_Settings.NumCars = static_cast<int>(state.Genomes.size());
+		m_Settings.Evaluation = state.Evaluation;
 	}
-}
+	else
+	{
+		m_Random = Random::MakeStream(Random::kGenerationStream);
 
-void Generation::Create(int numCars)
-{
-	m_World = std::make_unique<b2World>(b2Vec2{ 0.0f, -10.0f });
+		m_TerrainSeed = m_Settings.TerrainSeed != 0 ? m_Settings.TerrainSeed
+		                                            : m_Random.Int(1u, std::numeric_limits<uint32_t>::max() - 1);
+	}
+
+	if (!m_Settings.TrajectoryDir.empty())
+	{
+		std::error_code error;
+		std::filesystem::create_directories(m_Settings.TrajectoryDir, error);
+	}
+
+	// Replaying into the log being read from would truncate it
+	if (!m_Settings.RunLogPath.empty() && m_Settings.RunLogPath != m_Settings.ReplayLogPath)
+	{
+		if (resuming)
+		{
+			m_RunLog.Resume(m_Settings.RunLogPath, Random::GetSeed(), m_TerrainSeed, m_PhysicsProfile,
+			                static_cast<uint32_t>(m_GenerationIndex));
+		}
+		else
+		{
+			m_RunLog.Open(m_Settings.RunLogPath, Random::GetSeed(), m_TerrainSeed, m_PhysicsProfile);
+		}
+	}
+	else
+	{
+		m_RunLog.Close();
+	}
+
+	CheckRunLogSettings();
+
+	// A rerun has to simulate its generation as the logged run did
+	m_Replayable = m_RunLog.IsOpen() || (restoring && !m_Settings.ReplayLogPath.empty());
+	if (m_Replayable && (m_Settings.UseFitnessCache || m_Settings.BreedQuorum < 1.0f || m_Settings.MaxGenerationSeconds > 0.0f))
+	{
+		BL_LOG("Running without the fitness cache, breed quorum or wall-clock limit so that the run log replays exactly");
+	}
+	else if (m_Settings.BreedQuorum < 1.0f)
+	{
+		BL_LOG("Breeding once %.0f%% of the cars are done", 100.0f * m_Settings.BreedQuorum);
+	}
+
+	bool controllers = restoring ? !state.Controllers.empty() : m_Settings.UseControllers;
+
+	m_Genomes.Resize(m_Settings.NumCars, controllers);
+	for (size_t i = 0; i < m_Genomes.GetSize(); i++)
+	{
+		if (restoring)
+		{
+			m_Genomes.Set(i, state.Genomes[i], controllers ? &state.Controllers[i] : nullptr);
+		}
+		else
+		{
+			RandomStream carRandom = Random::MakeStream(Random::kPopulationStream, i);
+			CarProto carProto = Car::RandomProto(carRandom);
+			ControllerProto controller;
+
+			// Drawn after the body, which stays the same either way
+			if (m_Settings.UseControllers)
+			{
+				Car::RandomController(carProto, controller, carRandom);
+			}
+
+			m_Genomes.Set(i, carProto, &controller);
+		}
+	}
+
+	// Only known for a population which was evolved before
+	std::vector<float> targetFitness;
+	if (restoring)
+	{
+		targetFitness = std::move(state.TargetFitness);
+	}
+
+	LogGeneration(targetFitness);
+
+	m_ChassisShapes.resize(m_Genomes.GetSize());
+	for (size_t i = 0; i < m_ChassisShapes.size(); i++)
+	{
+		m_ChassisShapes[i] = Car::MakeChassisShape(m_Genomes.Get(i));
+	}
+
+	CreateArenas();
+	CreateCars();
 
-	m_Platform = std::make_unique<Platform>();
-	m_Platform->Create(*m_World, 1024);
-	
-	m_Cars.resize(numCars);
-	for (auto &car : m_Cars)
+	for (size_t t = 0; t < m_Arenas.size() && t < targetFitness.size(); t++)
 	{
-		car = std::make_unique<Car>();
-		car->Create(*m_World, Car::RandomProto());
+		m_Arenas[t]->SetTargetFitness(targetFitness[t]);
 	}
+
+	StartSpareBuild();
+	BeginRecording();
+
+	m_GenerationStart = std::chrono::steady_clock::now();
 }
 
 void Generation::Update(float delta)
 {
-	if (!m_World)
+	if (m_Arenas.empty())
 	{
 		return;
 	}
-	
-	m_World->Step(delta, 6, 2);
-	int deadCount = 0;
-	for (auto &car : m_Cars)
+
+	// Arenas share nothing, so each terrain is stepped as its own job
+	JobSystem::ParallelFor(m_Arenas.size(), 1, [this, delta](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			if (!m_Arenas[i]->IsDone())
+			{
+				m_Arenas[i]->Step(delta, m_Settings.Kill);
+			}
+		}
+	});
+
+	m_Step++;
+
+	if (m_Recorder.IsRecording() || !m_Tracks.empty())
+	{
+		RecordPoses();
+	}
+
+	// Tracks start with the pose after the first step
+	for (Ghost &ghost : m_Ghosts)
+	{
+		ghost.Track.GetPose(m_Step - 1, ghost.Pose);
+	}
+
+	// Started on the step the quorum is reached, the tail of the generation
+	// then runs while the next one is bred. Cars still running would only be
+	// ranked by how far they got so far, so the parents are chosen from the
+	// cars which are done, once there are at least two.
+	if (!m_BreedingStarted && m_Settings.BreedQuorum < 1.0f && !m_Replayable)
+	{
+		size_t doneCount = 0;
+		size_t carCount = 0;
+		for (const auto &arena : m_Arenas)
+		{
+			doneCount += arena->GetFinishedCount();
+			carCount += arena->GetNumCars();
+		}
+
+		if (static_cast<float>(doneCount) >= m_Settings.BreedQuorum * static_cast<float>(carCount))
+		{
+			std::vector<uint32_t> parentCars = GatherDoneCars();
+
+			if (parentCars.size() >= 2)
+			{
+				std::vector<float> fitness = GatherFitness();
+
+				for (size_t i = 0; i < parentCars.size(); i++)
+				{
+					fitness[i] = fitness[parentCars[i]];
+				}
+				fitness.resize(parentCars.size());
+
+				StartBreeding(std::move(fitness), std::move(parentCars));
+			}
+		}
+	}
+
+	if (m_Settings.MaxGenerationSeconds > 0.0f && !m_Replayable)
 	{
-		car->Update(delta);
-		if (car->IsDead())
+		float seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - m_GenerationStart).count();
+
+		if (seconds >= m_Settings.MaxGenerationSeconds)
 		{
-			deadCount++;
+			BL_LOG("Generation %d was cut off after %.1f seconds", m_GenerationIndex, seconds);
+
+			for (auto &arena : m_Arenas)
+			{
+				arena->CutOff();
+			}
+
+			m_CutOffCount++;
 		}
 	}
-	if (deadCount == m_Cars.size())
+
+	bool done = std::all_of(m_Arenas.begin(), m_Arenas.end(), [](const auto &arena) { return arena->IsDone(); });
+
+	if (done)
 	{
 		NextGeneration();
 	}
@@ -86,425 +302,1018 @@ void Generation::Update(float delta)
 
 void Generation::Draw() const
 {
-	if (!m_World)
+	if (m_Arenas.empty())
 	{
 		return;
 	}
 
-	m_Platform->Draw();
-	for (const auto &car : m_Cars)
+	BuildDrawLists(Renderer::GetViewProj());
+
+	for (const DrawList &drawList : m_DrawLists)
 	{
-		car->Draw();
+		Renderer::Submit(drawList);
 	}
 }
 
-const Car *Generation::GetBestCar() const
+void Generation::BuildDrawLists(const glm::mat4 &viewProj) const
 {
-	if (!m_World)
+	if (m_Arenas.empty())
 	{
-		return nullptr;
+		m_DrawLists.clear();
+		return;
 	}
 
-	const Car *bestCar = nullptr;
-	glm::vec3 bestPosition = { 0.0, 0.0, 0.0f };
-	for (const auto& car : m_Cars)
-	{
-		b2Vec2 pos = car->GetPosition();
+	const Arena &arena = *m_Arenas.front();
+
+	size_t numRanges = (arena.GetNumCars() + kCarsPerDrawList - 1) / kCarsPerDrawList;
+	m_DrawLists.resize(numRanges + 1);
 
-		if (pos.x > bestPosition.x && !car->IsDead())
+	JobSystem::ParallelFor(m_DrawLists.size(), 1, [this, &arena, &viewProj](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
 		{
-			bestPosition.x = pos.x;
-			bestPosition.y = pos.y;
-			bestCar = car.get();
+			DrawList &drawList = m_DrawLists[i];
+			drawList.Begin(viewProj);
+
+			if (i == 0)
+			{
+				arena.DrawPlatform(drawList);
+			}
+			else
+			{
+				arena.DrawCars(drawList, (i - 1) * kCarsPerDrawList, i * kCarsPerDrawList);
+			}
 		}
+	});
+}
+
+size_t Generation::GetDrawVertexCount() const
+{
+	size_t count = 0;
+	for (const DrawList &drawList : m_DrawLists)
+	{
+		count += drawList.GetVertexCount();
 	}
-	return bestCar;
+
+	return count;
 }
 
-void Generation::NextGeneration()
+void Generation::DrawGhosts() const
 {
-	if (!m_World)
+	m_GhostDrawList.Begin(Renderer::GetViewProj());
+
+	// Faded by age, and behind the live cars so they never hide them
+	for (size_t i = 0; i < m_Ghosts.size(); i++)
 	{
-		return;
+		const Ghost &ghost = m_Ghosts[i];
+
+		float alpha = 0.4f * static_cast<float>(i + 1) / static_cast<float>(m_Ghosts.size());
+
+		Car::DrawPose(m_GhostDrawList, ghost.Track.GetProto(), ghost.ChassisShape, ghost.Pose, {1.0f, 1.0f, 1.0f, alpha}, -0.5f);
 	}
 
-	BL_LOG("Starting to create next generation");
+	Renderer::Submit(m_GhostDrawList);
+}
+
+const Car *Generation::GetBestCar() const
+{
+	int index = GetBestCarIndex();
 
-	using RatioRange       = std::pair<double, double>;
-	using CarProtoRoulette = std::vector<std::pair<RatioRange, CarProto>>;
-	using ProtoList        = std::vector<CarProto>;
+	return index >= 0 ? &m_Arenas.front()->GetCar(static_cast<size_t>(index)) : nullptr;
+}
 
-	BL_LOG("Ranking parents");
+int Generation::GetBestCarIndex() const
+{
+	// Found while stepping, so asking every frame does not scan every car
+	return m_Arenas.empty() ? -1 : m_Arenas.front()->GetLeaderIndex();
+}
 
-	CarProtoRoulette carProtosRoulette;
-	ProtoList        parentProtos;
+uint64_t Generation::MakePhysicsProfile() const
+{
+	// Anything which changes the outcome of simulating a car for a given
+	// terrain, cached fitness is only valid for the same profile. The lagging
+	// rule is left out, the cars it stops are never cached.
+	float deltaTime = k_UpdateDeltaTime;
+	const KillRules &rules = m_Settings.Kill;
+
+	uint64_t profile = FitnessCache::HashBytes(&deltaTime, sizeof(deltaTime));
+	profile = FitnessCache::HashBytes(&kVelocityIterations, sizeof(kVelocityIterations), profile);
+	profile = FitnessCache::HashBytes(&kPositionIterations, sizeof(kPositionIterations), profile);
+	profile = FitnessCache::HashBytes(&kGravity, sizeof(kGravity), profile);
+	profile = FitnessCache::HashBytes(&kPlatformCount, sizeof(kPlatformCount), profile);
+
+	profile = FitnessCache::HashBytes(&rules.TimeLimit, sizeof(rules.TimeLimit), profile);
+	profile = FitnessCache::HashBytes(&rules.FinishBonus, sizeof(rules.FinishBonus), profile);
+	profile = FitnessCache::HashBytes(&rules.FlippedTime, sizeof(rules.FlippedTime), profile);
+	profile = FitnessCache::HashBytes(&rules.StalledTime, sizeof(rules.StalledTime), profile);
+	profile = FitnessCache::HashBytes(&rules.StalledDistance, sizeof(rules.StalledDistance), profile);
+	profile = FitnessCache::HashBytes(&rules.FallenDepth, sizeof(rules.FallenDepth), profile);
+
+	return profile;
+}
 
-	size_t numCars    = m_Cars.size();
-	size_t numParents = numCars / 2;
+std::vector<float> Generation::GatherFitness() const
+{
+	size_t numCars = m_Genomes.GetSize();
+	size_t numTerrains = m_Arenas.size();
 
-	float totalFitness = static_cast<float>(
-		std::accumulate(m_Cars.begin(), m_Cars.end(), 0_zu, [](size_t i, const auto &car)
+	std::vector<float> fitness(numCars);
+	std::vector<float> terrainFitness(numTerrains);
+	for (size_t i = 0; i < numCars; i++)
+	{
+		for (size_t t = 0; t < numTerrains; t++)
 		{
-			return i + car->GetFitness();
-		})
-	);
-	
+			terrainFitness[t] = static_cast<float>(m_Arenas[t]->GetCar(i).GetFitness());
+		}
+
+		fitness[i] = m_Settings.Evaluation.Aggregate(terrainFitness.data(), numTerrains);
+	}
+
+	return fitness;
+}
+
+std::vector<uint32_t> Generation::GatherDoneCars() const
+{
+	std::vector<uint32_t> cars;
+
+	for (size_t i = 0; i < m_Genomes.GetSize(); i++)
 	{
-		float cumlRatio = 0.;
-		for (auto curr = m_Cars.cbegin(); curr != m_Cars.cend(); ++curr)
+		bool done = std::all_of(m_Arenas.begin(), m_Arenas.end(), [i](const auto &arena)
 		{
-			float ratio = static_cast<float>((*curr)->GetFitness()) / totalFitness;
-			cumlRatio += ratio;
+			const Car &car = arena->GetCar(i);
+			return car.IsDead() || car.IsCached();
+		});
 
-			carProtosRoulette.push_back({ {cumlRatio - ratio, cumlRatio}, (*curr)->GetProto() });
+		if (done)
+		{
+			cars.push_back(static_cast<uint32_t>(i));
 		}
 	}
 
-	for (int i = 0; i < numParents; i++)
+	return cars;
+}
+
+void Generation::GatherBehaviours(std::vector<CarBehaviour> &behaviours, std::vector<uint32_t> &carIndices) const
+{
+	// From the run's own terrain, cars whose fitness came from the cache did
+	// nothing this generation to compare
+	const Arena &arena = *m_Arenas.front();
+
+	for (size_t i = 0; i < arena.GetNumCars(); i++)
+	{
+		const Car &car = arena.GetCar(i);
+
+		if (car.IsSimulated())
+		{
+			behaviours.push_back(car.GetBehaviour());
+			carIndices.push_back(static_cast<uint32_t>(i));
+		}
+	}
+}
+
+void Generation::StartBreeding(std::vector<float> fitness, std::vector<uint32_t> parentCars)
+{
+	std::vector<CarBehaviour> behaviours;
+	std::vector<uint32_t> behaviourCars;
+
+	if (m_Settings.Novelty.Enabled)
+	{
+		GatherBehaviours(behaviours, behaviourCars);
+	}
+
+	// Only the behaviours of the parents, indexed as they are
+	if (!parentCars.empty())
 	{
-		float ratio = Random::Float(0.0f, 1.0f);
+		std::vector<int> parentIndex(m_Genomes.GetSize(), -1);
+		for (size_t i = 0; i < parentCars.size(); i++)
+		{
+			parentIndex[parentCars[i]] = static_cast<int>(i);
+		}
 
-		for (const auto& segment : carProtosRoulette)
+		size_t kept = 0;
+		for (size_t i = 0; i < behaviourCars.size(); i++)
 		{
-			if (ratio >= segment.first.first && ratio <= segment.first.second)
+			if (parentIndex[behaviourCars[i]] >= 0)
 			{
-				parentProtos.push_back(segment.second);
-				break;
+				behaviours[kept] = behaviours[i];
+				behaviourCars[kept] = static_cast<uint32_t>(parentIndex[behaviourCars[i]]);
+				kept++;
 			}
 		}
-		
+
+		behaviours.resize(kept);
+		behaviourCars.resize(kept);
 	}
 
-	BL_LOG("Crossing parents");
+	// The settings are copied, they can be changed while it runs
+	m_BreedingStarted = true;
+	m_Breeding.Run([this, fitness = std::move(fitness), parentCars = std::move(parentCars), random = m_Random, selectionSettings = m_Settings.Selection,
+	                optimizerSettings = m_Settings.Optimizer, surrogateSettings = m_Settings.Surrogate,
+	                eliteCount = m_Settings.EliteCount, firstCarId = m_NextCarId,
+	                numChildren = static_cast<size_t>(std::max(m_Settings.NumCars, 1)), noveltySettings = m_Settings.Novelty,
+	                behaviours = std::move(behaviours), behaviourCars = std::move(behaviourCars),
+	                skipCachedBodies = UsesFitnessCache() && !m_Settings.ShowCachedCars]() mutable
+	{
+		m_BredRandom = BreedOffspring(std::move(fitness), std::move(parentCars), random, selectionSettings, optimizerSettings, surrogateSettings,
+		                              eliteCount, firstCarId, numChildren, noveltySettings, std::move(behaviours), std::move(behaviourCars),
+		                              skipCachedBodies);
+	});
+}
+
+RandomStream Generation::BreedOffspring(std::vector<float> fitness, std::vector<uint32_t> parentCars, RandomStream random,
+                                        SelectionSettings selectionSettings, OptimizerSettings optimizerSettings,
+                                        SurrogateSettings surrogateSettings, int eliteCount,
+                                        uint32_t firstCarId, size_t numChildren, NoveltySettings noveltySettings,
+                                        std::vector<CarBehaviour> behaviours, std::vector<uint32_t> behaviourCars,
+                                        bool skipCachedBodies)
+{
+	BL_LOG("Ranking parents with %s selection", Selection::GetTypeName(selectionSettings.Type));
 
-	for (auto& car : m_Cars)
+	size_t numCars = fitness.size();
+
+	// The genomes are not changed until turnover, which waits for this
+	const GenomeBatch *parents = &m_Genomes;
+	if (!parentCars.empty())
 	{
-		CarProto newCarData;
+		BL_LOG("Choosing parents from the %zu of %zu cars which are done", parentCars.size(), m_Genomes.GetSize());
 
-		const CarProto& parentCarData1 = parentProtos[Random::Int(0_zu, numParents - 1)];
-		const CarProto& parentCarData2 = parentProtos[Random::Int(0_zu, numParents - 1)];
+		m_ParentGenomes.Resize(parentCars.size(), m_Genomes.HasControllers());
+		for (size_t i = 0; i < parentCars.size(); i++)
+		{
+			m_ParentGenomes.Copy(i, m_Genomes, parentCars[i]);
+		}
 
-		// Density
+		parents = &m_ParentGenomes;
+	}
+
+	// Parents are selected by fitness plus novelty, the elites and the
+	// surrogate still go by fitness alone
+	std::vector<float> selectionFitness = fitness;
+
+	if (noveltySettings.Enabled)
+	{
+		std::vector<float> novelty;
+		m_Novelty.AddAndScore(behaviours, noveltySettings, novelty);
+
+		for (size_t i = 0; i < behaviourCars.size(); i++)
 		{
-			float mixRatio =   std::log(Random::Float(0.0f, 1000.0f) + 1.0f)
-			                 / std::log(1000.0f + 1.0f);
+			selectionFitness[behaviourCars[i]] += noveltySettings.Weight * novelty[i];
+		}
+
+		const NoveltyStats &stats = m_Novelty.GetStats();
+		BL_LOG("Novelty archive of %zu in %zu cells, indexed in %.3fms, scored in %.3fms", stats.ArchiveSize, stats.CellCount,
+			stats.IndexSeconds * 1e3f, stats.QuerySeconds * 1e3f);
+	}
 
-			if (Random::Bool())
+	// Recreated when another optimizer is picked, it keeps what it learnt
+	// between generations otherwise
+	if (!m_Optimizer || m_Optimizer->GetType() != optimizerSettings.Type)
+	{
+		m_Optimizer = Optimizer::Create(optimizerSettings);
+	}
+
+	m_Optimizer->Tell(*parents, selectionFitness, selectionSettings);
+
+	std::vector<size_t> ranked = Selection::RankByFitness(fitness);
+
+	BL_LOG("Breeding offspring with the %s optimizer", Optimizer::GetTypeName(optimizerSettings.Type));
+
+	size_t numElites = std::min({ static_cast<size_t>(std::max(eliteCount, 0)), numCars, numChildren });
+
+	// The same fitness the parents are chosen by
+	bool screening = false;
+	if (surrogateSettings.Enabled)
+	{
+		m_Surrogate.Train(*parents, fitness, surrogateSettings);
+		screening = m_Surrogate.IsReady(surrogateSettings) && surrogateSettings.PoolFactor > 1;
+	}
+
+	size_t numCandidates = screening ? numChildren * static_cast<size_t>(surrogateSettings.PoolFactor) : numChildren;
+
+	if (screening)
+	{
+		m_Optimizer->Ask(m_CandidateGenomes, numCandidates, random);
+		ScreenCandidates(numElites, numChildren, surrogateSettings);
+	}
+	else
+	{
+		m_Optimizer->Ask(m_ChildGenomes, numCandidates, random);
+	}
+
+	for (size_t i = 0; i < numElites; i++)
+	{
+		m_ChildGenomes.Copy(i, *parents, ranked[i]);
+	}
+
+	// Also checks every hull is valid before any body is made from it
+	m_ChildChassisShapes.resize(numChildren);
+	for (size_t i = 0; i < numChildren; i++)
+	{
+		m_ChildChassisShapes[i] = Car::MakeChassisShape(m_ChildGenomes.Get(i));
+	}
+
+	m_SpareBuild.Wait();
+
+	// Built for another population size when it was changed meanwhile
+	if (m_SpareArenas.empty() || m_SpareArenas.front()->GetNumCars() != numChildren)
+	{
+		return random;
+	}
+
+	// The physics profile only changes during turnover, once this is done
+	std::vector<FitnessCache::Entry> cachedEntries(numChildren);
+	std::vector<uint8_t> cached(numChildren);
+
+	// Each world of each arena is filled as its own job. Children whose
+	// fitness is known on a terrain get no bodies there, turnover looks at
+	// the cache again for the cars which finished after this.
+	for (auto &arena : m_SpareArenas)
+	{
+		std::fill(cached.begin(), cached.end(), 0);
+
+		if (skipCachedBodies)
+		{
+			JobSystem::ParallelFor(numChildren, kCarsPerWorld, [&](size_t begin, size_t end)
 			{
-				mixRatio = 1.0f - mixRatio;
-			}
+				for (size_t i = begin; i < end; i++)
+				{
+					arena->SetCarKey(i, FitnessCache::MakeKey(m_ChildGenomes.Get(i), m_ChildGenomes.GetController(i),
+					                                               arena->GetTerrainSeed(), m_PhysicsProfile));
+				}
+			});
 
-			newCarData.Density =   parentCarData1.Density * mixRatio
-			                     + parentCarData2.Density * (1.0f - mixRatio);
+			std::lock_guard<std::mutex> lock(m_FitnessCacheMutex);
 
-			if (Random::Bool())
+			for (size_t i = 0; i < numChildren; i++)
 			{
-				offset(newCarData.Density, Random::Float(0.5f, 2.0f));
+				if (const FitnessCache::Entry *entry = m_FitnessCache.Peek(arena->GetCarKey(i)))
+				{
+					cachedEntries[i] = *entry;
+					cached[i] = 1;
+				}
 			}
 		}
 
-		// Friction
+		JobSystem::ParallelFor(arena->GetWorldCount(), 1, [&](size_t begin, size_t end)
 		{
-			float mixRatio =   std::log(Random::Float(0.0f, 1000.0f) + 1.0f)
-			                 / std::log(1000.0f + 1.0f);
+			size_t firstCar = begin * kCarsPerWorld;
+			size_t lastCar = std::min(end * kCarsPerWorld, numChildren);
 
-			if (Random::Bool())
+			for (size_t i = firstCar; i < lastCar; i++)
 			{
-				mixRatio = 1.0f - mixRatio;
+				Car &car = arena->GetCar(i);
+				uint32_t carId = firstCarId + static_cast<uint32_t>(i);
+
+				if (cached[i])
+				{
+					car.CreateCached(m_ChildGenomes.Get(i), cachedEntries[i].Fitness, cachedEntries[i].SimulatedTime, carId);
+				}
+				else
+				{
+					car.Create(arena->GetWorld(i), m_ChildGenomes.Get(i), carId, m_ChildChassisShapes[i], m_ChildGenomes.GetController(i));
+				}
 			}
+		});
+	}
+
+	m_SparePopulated = true;
+
+	return random;
+}
+
+void Generation::ScreenCandidates(size_t firstChild, size_t numChildren, const SurrogateSettings &surrogateSettings)
+{
+	size_t numCandidates = m_CandidateGenomes.GetSize();
+
+	std::vector<float> predicted(numCandidates);
+	JobSystem::ParallelFor(numCandidates, 4096, [&](size_t begin, size_t end)
+	{
+		m_Surrogate.Predict(m_CandidateGenomes, begin, end, predicted.data() + begin);
+	});
+
+	std::vector<size_t> ranked = Selection::RankByFitness(predicted);
+
+	// Most children are the best predicted, the rest are the next candidates
+	// in the order they were bred whichever way they were predicted
+	size_t numSlots = numChildren - firstChild;
+	size_t numExplored = static_cast<size_t>(static_cast<float>(numSlots) * std::clamp(surrogateSettings.ExploreRatio, 0.0f, 1.0f));
+	size_t numScreened = numSlots - numExplored;
+
+	std::vector<uint8_t> picked(numCandidates, 0);
+	std::vector<size_t> chosen;
+	chosen.reserve(numSlots);
+
+	for (size_t i = 0; i < numScreened; i++)
+	{
+		chosen.push_back(ranked[i]);
+		picked[ranked[i]] = 1;
+	}
+
+	for (size_t i = 0; i < numCandidates && chosen.size() < numSlots; i++)
+	{
+		if (!picked[i])
+		{
+			chosen.push_back(i);
+		}
+	}
 
-			newCarData.Friction =   parentCarData1.Friction * mixRatio
-			                      + parentCarData2.Friction * (1.0f - mixRatio);
+	m_ChildGenomes.Resize(numChildren, m_CandidateGenomes.HasControllers());
+	for (size_t i = 0; i < numSlots; i++)
+	{
+		m_ChildGenomes.Copy(firstChild + i, m_CandidateGenomes, chosen[i]);
+	}
 
-			if (Random::Bool())
+	BL_LOG("Screened %zu candidates, best predicted %.0f, worst simulated %.0f",
+		numCandidates, predicted[ranked.front()], numScreened > 0 ? predicted[ranked[numScreened - 1]] : 0.0f);
+}
+
+void Generation::StartSpareBuild()
+{
+	// Sized for the next generation, which is only different when the
+	// population is resized before it is bred
+	size_t terrainCount = m_Arenas.size();
+	size_t numCars = static_cast<size_t>(std::max(m_Settings.NumCars, 1));
+
+	m_SparePopulated = false;
+	m_SpareBuild.Run([this, terrainCount, numCars]()
+	{
+		m_SpareArenas.resize(terrainCount);
+		for (size_t i = 0; i < terrainCount; i++)
+		{
+			m_SpareArenas[i] = std::make_unique<Arena>();
+			m_SpareArenas[i]->Create(Arena::MakeTerrainSeed(m_TerrainSeed, static_cast<int>(i)), numCars);
+		}
+	});
+}
+
+void Generation::RetireArenas(std::vector<std::unique_ptr<Arena>> &&arenas)
+{
+	if (arenas.empty())
+	{
+		return;
+	}
+
+	// Tearing down a world with every car in it takes about as long as
+	// building one, so it is not done on the main thread either. A retired
+	// world shares nothing with the live ones.
+	auto retired = std::make_shared<std::vector<std::unique_ptr<Arena>>>(std::move(arenas));
+
+	m_Retiring.Run([retired]()
+	{
+		retired->clear();
+	});
+}
+
+void Generation::CreateArenas()
+{
+	size_t terrainCount = static_cast<size_t>(std::max(m_Settings.Evaluation.TerrainCount, 1));
+
+	m_Arenas.clear();
+	m_Arenas.resize(terrainCount);
+	for (size_t i = 0; i < terrainCount; i++)
+	{
+		m_Arenas[i] = std::make_unique<Arena>();
+		m_Arenas[i]->Create(Arena::MakeTerrainSeed(m_TerrainSeed, static_cast<int>(i)), m_Genomes.GetSize());
+	}
+}
+
+void Generation::CreateCars()
+{
+	// A genome has the same car id on every terrain
+	for (size_t i = 0; i < m_Genomes.GetSize(); i++)
+	{
+		uint32_t carId = m_NextCarId++;
+
+		for (auto &arena : m_Arenas)
+		{
+			CreateCar(*arena, i, carId);
+		}
+	}
+}
+
+const FitnessCache::Entry *Generation::FindCachedFitness(Arena &arena, size_t index)
+{
+	FitnessCache::Key key = FitnessCache::MakeKey(m_Genomes.Get(index), m_Genomes.GetController(index), arena.GetTerrainSeed(), m_PhysicsProfile);
+	arena.SetCarKey(index, key);
+
+	return UsesFitnessCache() ? m_FitnessCache.Find(key) : nullptr;
+}
+
+void Generation::CreateCar(Arena &arena, size_t index, uint32_t carId)
+{
+	Car &car = arena.GetCar(index);
+
+	const CarProto &carProto = m_Genomes.Get(index);
+	const ControllerProto *controller = m_Genomes.GetController(index);
+	const b2PolygonShape &chassisShape = m_ChassisShapes[index];
+
+	const FitnessCache::Entry *entry = FindCachedFitness(arena, index);
+
+	if (!entry)
+	{
+		car.Create(arena.GetWorld(index), carProto, carId, chassisShape, controller);
+	}
+	else if (m_Settings.ShowCachedCars)
+	{
+		car.Create(arena.GetWorld(index), carProto, carId, chassisShape, controller);
+		car.SetCachedFitness(entry->Fitness, entry->SimulatedTime);
+	}
+	else
+	{
+		car.CreateCached(carProto, entry->Fitness, entry->SimulatedTime, carId);
+	}
+}
+
+void Generation::CacheFitness()
+{
+	std::lock_guard<std::mutex> lock(m_FitnessCacheMutex);
+
+	for (const auto &arena : m_Arenas)
+	{
+		for (size_t i = 0; i < arena->GetNumCars(); i++)
+		{
+			const Car &car = arena->GetCar(i);
+
+			// Where a lagging or cut off car was stopped depends on more than
+			// the car and its terrain.
+			KillReason reason = car.GetKillReason();
+
+			if (!car.IsCached() && reason != KillReason::Lagging && reason != KillReason::CutOff)
 			{
-				mutate(newCarData.Friction, Random::Float(0.05f, 0.3f), 0.1f, 1.0f);
+				FitnessCache::Entry entry;
+				entry.Fitness = car.GetFitness();
+				entry.SimulatedTime = car.GetSimulatedTime();
+
+				m_FitnessCache.Store(arena->GetCarKey(i), entry);
 			}
 		}
+	}
+}
+
+bool Generation::LoadReplay(Checkpoint::State &state) const
+{
+	RunLog::Reader replayLog;
+	RunLog::GenerationRecord record = {};
+
+	if (   m_Settings.ReplayGeneration < 0
+	    || !replayLog.Open(m_Settings.ReplayLogPath)
+	    || !replayLog.ReadGeneration(m_Settings.ReplayGeneration, record, state.Genomes, state.Controllers, state.TargetFitness))
+	{
+		BL_LOG("Generation %d is not in '%s', starting a new run", m_Settings.ReplayGeneration, m_Settings.ReplayLogPath.c_str());
+		return false;
+	}
+
+	BL_LOG("Replaying generation %d of '%s'", m_Settings.ReplayGeneration, m_Settings.ReplayLogPath.c_str());
+
+	state.MasterSeed = replayLog.GetHeader().MasterSeed;
+	state.RandomCounter = record.RandomCounter;
+	state.PhysicsProfile = replayLog.GetHeader().PhysicsProfile;
+	state.TerrainSeed = replayLog.GetHeader().TerrainSeed;
+	state.GenerationIndex = record.GenerationIndex;
+	state.NextCarId = record.FirstCarId;
+	state.Evaluation.TerrainCount = std::max(static_cast<int>(record.TerrainCount), 1);
+	state.Evaluation.Aggregation = static_cast<FitnessAggregation>(std::min(record.Aggregation, static_cast<uint32_t>(FitnessAggregation::Count) - 1));
+	state.Evaluation.Quantile = record.Quantile;
+
+	return true;
+}
+
+LatencyStats Generation::MakeLatencyStats(const std::vector<float> &samples)
+{
+	LatencyStats stats;
+	stats.Count = samples.size();
+
+	if (stats.Count == 0)
+	{
+		return stats;
+	}
+
+	std::vector<float> seconds = samples;
+	std::sort(seconds.begin(), seconds.end());
+
+	auto percentile = [&seconds](float p)
+	{
+		size_t index = static_cast<size_t>(std::ceil(p * static_cast<float>(seconds.size()))) - 1;
+		return seconds[std::min(index, seconds.size() - 1)];
+	};
+
+	stats.P50 = percentile(0.50f);
+	stats.P90 = percentile(0.90f);
+	stats.P99 = percentile(0.99f);
+	stats.Max = seconds.back();
+
+	return stats;
+}
+
+Checkpoint::State Generation::GetState() const
+{
+	Checkpoint::State state;
+	state.MasterSeed = Random::GetSeed();
+	state.RandomCounter = m_Random.GetCounter();
+	state.PhysicsProfile = m_PhysicsProfile;
+	state.TerrainSeed = m_TerrainSeed;
+	state.GenerationIndex = static_cast<uint32_t>(m_GenerationIndex);
+	state.NextCarId = m_NextCarId - static_cast<uint32_t>(m_Genomes.GetSize());
+	state.Selection = m_Settings.Selection;
+	state.EliteCount = m_Settings.EliteCount;
+	state.Evaluation = m_Settings.Evaluation;
+	state.BestFitnessHistory = m_BestFitnessHistory;
+
+	for (const auto &arena : m_Arenas)
+	{
+		state.TargetFitness.push_back(arena->GetTargetFitness());
+	}
+
+	state.Genomes = m_Genomes.Genomes;
+	state.Controllers = m_Genomes.Controllers;
+
+	return state;
+}
+
+void Generation::LogGeneration(const std::vector<float> &targetFitness)
+{
+	if (!m_RunLog.IsOpen())
+	{
+		return;
+	}
+
+	RunLog::GenerationRecord record = {};
+	record.GenerationIndex = static_cast<uint32_t>(m_GenerationIndex);
+	record.NumCars = static_cast<uint32_t>(m_Genomes.GetSize());
+	record.RandomCounter = m_Random.GetCounter();
+	record.FirstCarId = m_NextCarId;
+	record.TerrainCount = static_cast<uint32_t>(std::max(m_Settings.Evaluation.TerrainCount, 1));
+	record.Aggregation = static_cast<uint32_t>(m_Settings.Evaluation.Aggregation);
+	record.Quantile = m_Settings.Evaluation.Quantile;
+	record.NumControllers = static_cast<uint32_t>(m_Genomes.Controllers.size());
+
+	// Terrains added since the last generation have none yet
+	std::vector<float> terrainTargets = targetFitness;
+	terrainTargets.resize(record.TerrainCount, 0.0f);
+
+	m_RunLog.Append(record, m_Genomes.Genomes.data(), m_Genomes.Controllers.data(), terrainTargets.data());
+}
+
+const char *Generation::FindUnloggedSetting(const GenerationSettings &settings)
+{
+	if (settings.Surrogate.Enabled)
+	{
+		return "the surrogate";
+	}
+
+	if (settings.Novelty.Enabled)
+	{
+		return "novelty search";
+	}
+
+	if (settings.Optimizer.Type != OptimizerType::Genetic)
+	{
+		return "the CMA-ES optimizer";
+	}
+
+	return nullptr;
+}
+
+void Generation::CheckRunLogSettings()
+{
+	if (!m_RunLog.IsOpen())
+	{
+		return;
+	}
+
+	if (const char *setting = FindUnloggedSetting(m_Settings))
+	{
+		BL_LOG("Stopped writing the run log at generation %d, it cannot be rerun with %s", m_GenerationIndex, setting);
+		m_RunLog.Close();
+	}
+}
+
+void Generation::BeginRecording()
+{
+	m_Recorder.End();
+	m_Step = 0;
+
+	const Arena &arena = *m_Arenas.front();
+
+	if (m_Settings.GhostCount > 0)
+	{
+		m_Tracks.resize(arena.GetNumCars());
+		for (size_t i = 0; i < arena.GetNumCars(); i++)
+		{
+			m_Tracks[i].Begin(arena.GetCar(i).GetProto());
+		}
+	}
+	else
+	{
+		m_Tracks.clear();
+		m_Ghosts.clear();
+	}
+
+	for (Ghost &ghost : m_Ghosts)
+	{
+		ghost.Track.GetPose(0, ghost.Pose);
+	}
+
+	if (m_Settings.TrajectoryDir.empty())
+	{
+		return;
+	}
+
+	char fileName[64];
+	snprintf(fileName, sizeof(fileName), "/generation_%06d.traj", m_GenerationIndex);
+
+	std::vector<CarProto> carProtos(arena.GetNumCars());
+	std::vector<uint32_t> carIds(arena.GetNumCars());
+	for (size_t i = 0; i < arena.GetNumCars(); i++)
+	{
+		carProtos[i] = arena.GetCar(i).GetProto();
+		carIds[i] = arena.GetCar(i).GetCarId();
+	}
+
+	m_Recorder.Begin(m_Settings.TrajectoryDir + fileName, m_GenerationIndex, arena.GetTerrainSeed(), kPlatformCount, carProtos, carIds);
+}
+
+void Generation::RecordPoses()
+{
+	bool recording = m_Recorder.IsRecording();
+	bool tracking = !m_Tracks.empty();
+
+	const Arena &arena = *m_Arenas.front();
+
+	for (size_t i = 0; i < arena.GetNumCars(); i++)
+	{
+		const Car &car = arena.GetCar(i);
+
+		bool record = recording && !m_Recorder.IsFinished(i);
+		bool track = tracking && !m_Tracks[i].IsFinished();
+
+		if (!record && !track)
+		{
+			continue;
+		}
 
-		// Restitution
+		// Cached cars which are not shown have nothing to record. A car's
+		// track ends with the step it died on.
+		bool finished = car.IsDead() || !car.IsSimulated();
+
+		if (car.IsSimulated())
 		{
-			float mixRatio =   std::log(Random::Float(0.0f, 1000.0f) + 1.0f)
-			                 / std::log(1000.0f + 1.0f);
+			CarPose pose = car.GetPose();
 
-			if (Random::Bool())
+			if (record)
 			{
-				mixRatio = 1.0f - mixRatio;
+				m_Recorder.Record(i, pose);
 			}
 
-			newCarData.Restitution =   parentCarData1.Restitution * mixRatio
-			                         + parentCarData2.Restitution * (1.0f - mixRatio);
-
-			if (Random::Bool())
+			if (track)
 			{
-				mutate(newCarData.Restitution, Random::Float(0.5f, 2.0f), 0.1f, 1.0f);
+				m_Tracks[i].Append(pose);
 			}
 		}
 
-		// Colour
+		if (finished && record)
 		{
-			float r =  (newCarData.Density               - CarConstants::kMinChassisDensity)
-			         / (CarConstants::kMaxChassisDensity - CarConstants::kMinChassisDensity);
-			float g = newCarData.Friction;
-			float b = newCarData.Restitution;
-			newCarData.Colour = {r, g, b, 1.0f };
+			m_Recorder.Finish(i);
 		}
 
-		// Vertices
+		if (finished && track)
 		{
-			for (int j = 0; j < CarConstants::kNumVertices; j++)
-			{
-				if (Random::Bool())
-				{
-					newCarData.Vertices[j] = parentCarData1.Vertices[j];
-				}
-				else
-				{
-					newCarData.Vertices[j] = parentCarData2.Vertices[j];
-				}
+			m_Tracks[i].Finish();
+		}
+	}
+}
 
-				if (Random::Bool())
-				{
-					offset(newCarData.Vertices[j].x, Random::Float(0.5f, 2.0f));
-					offset(newCarData.Vertices[j].y, Random::Float(0.5f, 2.0f));
-				}
-			}
+void Generation::AddGhost(size_t carIndex)
+{
+	Trajectory::Track &track = m_Tracks[carIndex];
+
+	// A champion whose fitness came from the cache was not simulated, it is
+	// the same genome as an earlier champion which already has a ghost.
+	if (track.GetLength() == 0)
+	{
+		return;
+	}
+
+	Ghost ghost;
+	ghost.GenerationIndex = m_GenerationIndex;
+	ghost.Fitness = m_Arenas.front()->GetCar(carIndex).GetFitness();
+	ghost.ChassisShape = Car::MakeChassisShape(track.GetProto());
+	ghost.Track = std::move(track);
+
+	m_Ghosts.push_back(std::move(ghost));
+
+	size_t maxGhosts = static_cast<size_t>(m_Settings.GhostCount);
+	if (m_Ghosts.size() > maxGhosts)
+	{
+		m_Ghosts.erase(m_Ghosts.begin(), m_Ghosts.end() - maxGhosts);
+	}
+}
+
+void Generation::NextGeneration()
+{
+	if (m_Arenas.empty())
+	{
+		return;
+	}
+
+	auto turnoverStart = std::chrono::steady_clock::now();
+
+	float seconds = std::chrono::duration<float>(turnoverStart - m_GenerationStart).count();
+	m_GenerationSeconds.push_back(seconds);
+
+	BL_LOG("Generation %d took %.3f seconds", m_GenerationIndex, seconds);
+	BL_LOG("Starting to create next generation");
+
+	if (m_Recorder.IsRecording())
+	{
+		m_Recorder.End();
+
+		const Trajectory::Recorder::Stats &stats = m_Recorder.GetStats();
+		BL_LOG("Recorded %llu poses in %.1fKB, %.2f bytes per pose", static_cast<unsigned long long>(stats.Poses),
+			static_cast<float>(stats.Bytes) / 1024.0f, stats.GetBytesPerPose());
+	}
+
+	if (UsesFitnessCache())
+	{
+		CacheFitness();
+	}
+
+	m_KillStats = KillStats();
+	std::vector<float> targetFitness;
+	for (const auto &arena : m_Arenas)
+	{
+		std::vector<float> arenaFitness(arena->GetNumCars());
+
+		for (size_t i = 0; i < arena->GetNumCars(); i++)
+		{
+			const Car &car = arena->GetCar(i);
+
+			m_KillStats.Counts[static_cast<size_t>(car.GetKillReason())]++;
+			m_KillStats.SimulatedTimeSaved += car.GetSavedTime();
+			m_TotalSimulatedCars += car.IsCached() ? 0 : 1;
+
+			arenaFitness[i] = static_cast<float>(car.GetFitness());
 		}
 
-		// Wheels
+		// The next generation is held to this generation's median
+		if (!arenaFitness.empty())
 		{
-			newCarData.Wheels.resize(Random::Bool() ? parentCarData1.Wheels.size() :
-			                                          parentCarData2.Wheels.size()
-			);
+			auto median = arenaFitness.begin() + arenaFitness.size() / 2;
+			std::nth_element(arenaFitness.begin(), median, arenaFitness.end());
+			targetFitness.push_back(*median);
+		}
+	}
 
-			size_t maxIndex = std::min(parentCarData1.Wheels.size(),
-			                           parentCarData2.Wheels.size()
-			);
-			maxIndex = maxIndex == 0 ? 0 : maxIndex - 1;
+	m_TotalTimeSaved += m_KillStats.SimulatedTimeSaved;
 
-			BL_ASSERT(newCarData.Wheels.size() > 0, "A car has no wheels...");
+	BL_LOG("%u cars finished the course", m_KillStats.Counts[static_cast<size_t>(KillReason::Finished)]);
+	BL_LOG("Kill rules stopped %u flipped, %u stalled, %u fallen, %u lagging and %u timed out cars, %.1f simulated seconds saved",
+		m_KillStats.Counts[static_cast<size_t>(KillReason::Flipped)],
+		m_KillStats.Counts[static_cast<size_t>(KillReason::Stalled)],
+		m_KillStats.Counts[static_cast<size_t>(KillReason::Fallen)],
+		m_KillStats.Counts[static_cast<size_t>(KillReason::Lagging)],
+		m_KillStats.Counts[static_cast<size_t>(KillReason::TimeLimit)],
+		m_KillStats.SimulatedTimeSaved);
 
-			size_t i = 0;
-			for (auto it = newCarData.Wheels.begin(); it != newCarData.Wheels.end(); )
-			{
-				{
-					auto& wheel = *it;
+	size_t numCars = m_Genomes.GetSize();
+	size_t numTerrains = m_Arenas.size();
 
-					// Density
-					{
-						if (   i >= parentCarData1.Wheels.size()
-						    || i >= parentCarData2.Wheels.size())
-						{
-							if (Random::Bool())
-							{
-								wheel.Density = parentCarData1.Wheels[Random::Int(0_zu, maxIndex)].Density;
-							}
-							else
-							{
-								wheel.Density = parentCarData2.Wheels[Random::Int(0_zu, maxIndex)].Density;
-							}
-						}
-						else
-						{
-							float mixRatio =   std::log(Random::Float(0.0f, 1000.0f) + 1.0f)
-							                 / std::log(1000.0f + 1.0f);
-
-							if (Random::Bool())
-							{
-								mixRatio = 1.0f - mixRatio;
-							}
-
-							wheel.Density =   parentCarData1.Wheels[i].Density * mixRatio
-							                + parentCarData2.Wheels[i].Density * (1.0f - mixRatio);
-						}
-
-						if (Random::Bool())
-						{
-							offset(wheel.Density, Random::Float(0.5f, 2.0f));
-						}
-					}
+	std::vector<float> fitness = GatherFitness();
 
-					// Friction
-					{
-						if (   i >= parentCarData1.Wheels.size()
-						    || i >= parentCarData2.Wheels.size())
-						{
-							if (Random::Bool())
-							{
-								wheel.Friction = parentCarData1.Wheels[Random::Int(0_zu, maxIndex)].Friction;
-							}
-							else
-							{
-								wheel.Friction = parentCarData2.Wheels[Random::Int(0_zu, maxIndex)].Friction;
-							}
-						}
-						else
-						{
-							float mixRatio =   std::log(Random::Float(0.0f, 1000.0f) + 1.0f)
-							                 / std::log(1000.0f + 1.0f);
-
-							if (Random::Bool())
-							{
-								mixRatio = 1.0f - mixRatio;
-							}
-
-							wheel.Friction =   parentCarData1.Wheels[i].Friction * mixRatio
-							                 + parentCarData2.Wheels[i].Friction * (1.0f - mixRatio);
-						}
-
-						if (Random::Bool())
-						{
-							mutate(wheel.Friction, Random::Float(0.5f, 2.0f), 0.1f, 1.0f);
-						}
-					}
+	// Without a quorum the parents come from the final fitness
+	if (!m_BreedingStarted)
+	{
+		StartBreeding(fitness, {});
+	}
 
-					// Restitution
-					{
-						if (   i >= parentCarData1.Wheels.size()
-						    || i >= parentCarData2.Wheels.size())
-						{
-							if (Random::Bool())
-							{
-								wheel.Restitution = parentCarData1.Wheels[Random::Int(0_zu, maxIndex)].Restitution;
-							}
-							else
-							{
-								wheel.Restitution = parentCarData2.Wheels[Random::Int(0_zu, maxIndex)].Restitution;
-							}
-						}
-						else
-						{
-							float mixRatio =   std::log(Random::Float(0.0f, 1000.0f) + 1.0f)
-							                 / std::log(1000.0f + 1.0f);
-
-							if (Random::Bool())
-							{
-								mixRatio = 1.0f - mixRatio;
-							}
-
-							wheel.Restitution =   parentCarData1.Wheels[i].Restitution * mixRatio
-							                    + parentCarData2.Wheels[i].Restitution * (1.0f - mixRatio);
-						}
-
-						if (Random::Bool())
-						{
-							mutate(wheel.Restitution, Random::Float(0.5f, 2.0f), 0.1f, 1.0f);
-						}
-					}
+	std::vector<size_t> ranked = Selection::RankByFitness(fitness);
 
-					// Radius
-					{
-						if (   i >= parentCarData1.Wheels.size()
-						    || i >= parentCarData2.Wheels.size())
-						{
-							if (Random::Bool())
-							{
-								wheel.Radius = parentCarData1.Wheels[Random::Int(0_zu, maxIndex)].Radius;
-							}
-							else
-							{
-								wheel.Radius = parentCarData2.Wheels[Random::Int(0_zu, maxIndex)].Radius;
-							}
-						}
-						else
-						{
-							float mixRatio =   std::log(Random::Float(0.0f, 1000.0f) + 1.0f)
-							                 / std::log(1000.0f + 1.0f);
-
-							if (Random::Bool())
-							{
-								mixRatio = 1.0f - mixRatio;
-							}
-
-							wheel.Radius =   parentCarData1.Wheels[i].Radius * mixRatio
-							               + parentCarData2.Wheels[i].Radius * (1.0f - mixRatio);
-						}
-
-						if (Random::Bool())
-						{
-							mutate(
-								wheel.Radius, Random::Float(0.5f, 2.0f),
-								CarConstants::kMinWheelRadius, CarConstants::kMaxWheelRadius
-							);
-						}
-					}
+	m_BestFitnessHistory.push_back(numCars > 0 ? fitness[ranked.front()] : 0.0f);
+	m_LastFitness = fitness;
 
-					// Motor Speed
-					{
-						if (   i >= parentCarData1.Wheels.size()
-						    || i >= parentCarData2.Wheels.size())
-						{
-							if (Random::Bool())
-							{
-								wheel.MotorSpeed = parentCarData1.Wheels[Random::Int(0_zu, maxIndex)].MotorSpeed;
-							}
-							else
-							{
-								wheel.MotorSpeed = parentCarData2.Wheels[Random::Int(0_zu, maxIndex)].MotorSpeed;
-							}
-						}
-						else
-						{
-							float mixRatio =   std::log(Random::Float(0.0f, 1000.0f) + 1.0f)
-							                 / std::log(1000.0f + 1.0f);
-
-							if (Random::Bool())
-							{
-								mixRatio = 1.0f - mixRatio;
-							}
-
-							wheel.MotorSpeed =   parentCarData1.Wheels[i].MotorSpeed * mixRatio
-							                   + parentCarData2.Wheels[i].MotorSpeed * (1.0f - mixRatio);
-						}
-
-						if (Random::Bool())
-						{
-							mutate(
-								wheel.MotorSpeed, Random::Float(0.5f, 2.0f),
-								-CarConstants::kMaxWheelMotorSpeed, -CarConstants::kMinWheelMotorSpeed
-							);
-						}
-					}
+	m_ChampionTerrainFitness.clear();
+	for (size_t t = 0; t < numTerrains && numCars > 0; t++)
+	{
+		m_ChampionTerrainFitness.push_back(static_cast<float>(m_Arenas[t]->GetCar(ranked.front()).GetFitness()));
+	}
+
+	if (numCars > 0 && !m_Tracks.empty() && m_Settings.GhostCount > 0)
+	{
+		AddGhost(ranked.front());
+	}
+
+	auto waitStart = std::chrono::steady_clock::now();
+
+	m_Breeding.Wait();
+	m_SpareBuild.Wait();
+
+	m_Random = m_BredRandom;
+	m_NoveltyStats = m_Novelty.GetStats();
+	m_BreedingStarted = false;
+
+	float waitSeconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - waitStart).count();
+
+	std::swap(m_Genomes, m_ChildGenomes);
+	std::swap(m_ChassisShapes, m_ChildChassisShapes);
+
+	// The population may have been resized
+	numCars = m_Genomes.GetSize();
+
+	m_GenerationIndex++;
+
+	CheckRunLogSettings();
+	LogGeneration(targetFitness);
+
+	// Changes to the settings are picked up here
+	m_PhysicsProfile = MakePhysicsProfile();
+
+	std::vector<std::unique_ptr<Arena>> retired = std::move(m_Arenas);
+	m_Arenas.clear();
 
-					// Vertex
+	size_t terrainCount = static_cast<size_t>(std::max(m_Settings.Evaluation.TerrainCount, 1));
+
+	if (m_SparePopulated && m_SpareArenas.size() == terrainCount)
+	{
+		m_Arenas = std::move(m_SpareArenas);
+		m_SpareArenas.clear();
+
+		// Breeding only gave bodies to the children it did not find in the
+		// cache. Only the cars cached since then, or whose lookup changed with
+		// the settings, are created again.
+		for (auto &arena : m_Arenas)
+		{
+			for (size_t i = 0; i < numCars; i++)
+			{
+				Car &car = arena->GetCar(i);
+				const FitnessCache::Entry *entry = FindCachedFitness(*arena, i);
+				bool wantsBodies = !entry || m_Settings.ShowCachedCars;
+
+				if (wantsBodies != car.IsSimulated())
+				{
+					uint32_t carId = car.GetCarId();
+					car.Destory();
+
+					if (wantsBodies)
 					{
-						if (Random::Bool())
-						{
-							wheel.Vertex = parentCarData1.Wheels[Random::Int(0_zu, maxIndex)].Vertex;
-						}
-						else
-						{
-							wheel.Vertex = parentCarData2.Wheels[Random::Int(0_zu, maxIndex)].Vertex;
-						}
-
-						if (Random::Bool())
-						{
-							mutate(
-								wheel.Vertex, Random::Int(-1, 1), 0_zu,
-								CarConstants::kNumVertices - 1_zu
-							);
-						}
+						car.Create(arena->GetWorld(i), m_Genomes.Get(i), carId, m_ChassisShapes[i], m_Genomes.GetController(i));
 					}
-
-					// Colour
+					else
 					{
-						float r =  (wheel.Density                  - CarConstants::kMinWheelDensity)
-						         / (CarConstants::kMaxWheelDensity - CarConstants::kMinWheelDensity);
-						float g = wheel.Friction;
-						float b = wheel.Restitution;
-						wheel.Colour = {r, g, b, 1.0f };
+						car.CreateCached(m_Genomes.Get(i), entry->Fitness, entry->SimulatedTime, carId);
 					}
-
-					++it;
 				}
 
-				++i;
+				if (entry)
+				{
+					car.SetCachedFitness(entry->Fitness, entry->SimulatedTime);
+				}
 			}
+		}
 
-			car->Destory();
-			car->Create(*m_World, newCarData);
+		m_NextCarId += static_cast<uint32_t>(numCars);
+	}
+	else
+	{
+		// The number of terrains changed since the spare arenas were built
+		for (auto &arena : m_SpareArenas)
+		{
+			retired.push_back(std::move(arena));
 		}
+		m_SpareArenas.clear();
+
+		CreateArenas();
+		CreateCars();
+	}
+
+	for (size_t t = 0; t < m_Arenas.size() && t < targetFitness.size(); t++)
+	{
+		m_Arenas[t]->SetTargetFitness(targetFitness[t]);
 	}
 
-	BL_LOG("Finished creating next generation");
+	RetireArenas(std::move(retired));
+	StartSpareBuild();
+
+	BeginRecording();
+
+	// Taken once the cars are created so it holds the state at the start of
+	// this generation, the same point a run log records.
+	if (!m_Settings.CheckpointPath.empty() && m_Settings.CheckpointInterval > 0 && m_GenerationIndex % m_Settings.CheckpointInterval == 0)
+	{
+		m_CheckpointWriter.Submit(m_Settings.CheckpointPath, GetState());
+	}
+
+	if (UsesFitnessCache())
+	{
+		const FitnessCache::Stats &stats = m_FitnessCache.GetStats();
+		BL_LOG("Fitness cache hit rate %.1f%%, %.1f simulated seconds saved",
+			100.0f * stats.GetHitRate(), stats.SimulatedTimeSaved);
+	}
+
+	m_GenerationStart = std::chrono::steady_clock::now();
+
+	float turnoverSeconds = std::chrono::duration<float>(m_GenerationStart - turnoverStart).count();
+	m_TurnoverSeconds.push_back(turnoverSeconds);
+
+	BL_LOG("Finished creating next generation in %.2fms, %.2fms of it waiting for offspring",
+		turnoverSeconds * 1e3f, waitSeconds * 1e3f);
 }
@@ -2,29 +2,318 @@
 
 #include "Renderer.h"
 #include "Car.h"
-#include "Platform.h"
+#include "Arena.h"
+#include "JobSystem.h"
+#include "Selection.h"
+#include "Optimizer.h"
+#include "FitnessCache.h"
+#include "GenomeBatch.h"
+#include "Surrogate.h"
+#include "Novelty.h"
+#include "RunLog.h"
+#include "Checkpoint.h"
+#include "Trajectory.h"
 
 #include <glm/glm.hpp>
 #include <box2d/box2d.h>
 
+#include <chrono>
+
+// Largest population the UI and command line accept. Every terrain splits its
+// cars over worlds of a few hundred, so a step stays linear in the number of
+// cars and the next generation's worlds are still built in the background.
+static constexpr int kMaxPopulation = 50000;
+
+struct GenerationSettings
+{
+	// Can be changed while running, the next generation bred has this many
+	int NumCars = 50;
+
+	SelectionSettings Selection;
+
+	// What breeds the offspring from the fitness of the parents
+	OptimizerSettings Optimizer;
+
+	// The fittest cars which are carried over to the next generation unchanged
+	int EliteCount = 2;
+
+	// Zero picks a random terrain when the generation is created
+	uint32_t TerrainSeed = 0;
+
+	// Scores every genome on several terrains derived from the terrain seed
+	EvaluationSettings Evaluation;
+
+	// Stops cars which are going nowhere before their health runs out
+	KillRules Kill;
+
+	// Screens offspring with a model of fitness before simulating them
+	SurrogateSettings Surrogate;
+
+	// Rewards behaving unlike every car before when selecting parents
+	NoveltySettings Novelty;
+
+	// Gives every car of a new run an evolved wheel controller, see
+	// ControllerBatch. Children inherit it from their parents, so this only
+	// takes effect when the first generation is created.
+	bool UseControllers = false;
+
+	// Share of the cars which have to be done before the next generation is
+	// bred in the background. Cars from the fitness cache count as done once
+	// they have been simulated for as long as their cached run lasted, so the
+	// step does not depend on what is cached. The parents are then chosen
+	// from the final fitness of the cars which are dead or cached by that
+	// step, the rest are not ranked. The cache is not checkpointed, so below
+	// one a resumed generation can pick other parents unless the cache is
+	// off. Always one for a run which is logged.
+	float BreedQuorum = 1.0f;
+
+	// Hard bound on the wall-clock time of a generation, cars still running
+	// then are cut off where they are. Their fitness depends on how fast the
+	// machine is, so they are never cached and the run will not replay the
+	// same way. Zero means no bound, which a run log needs.
+	float MaxGenerationSeconds = 0.0f;
+
+	// Skips simulating genomes whose fitness is already known, optionally
+	// still simulating them so they are shown. Always off for a run which
+	// is logged.
+	bool UseFitnessCache = true;
+	bool ShowCachedCars = false;
+
+	// Records the master seed, and the genomes and random stream offset of
+	// every generation, when not empty. See RunLog for what a logged run
+	// has to do without.
+	std::string RunLogPath;
+
+	// Starts from a generation of a run log, re-simulating it as it was,
+	// instead of from a random population. See RunLog for when that is exact.
+	std::string ReplayLogPath;
+	int ReplayGeneration = 0;
+
+	// Saves the population every CheckpointInterval generations when not
+	// empty, and starts from a saved population when ResumePath is set.
+	std::string CheckpointPath;
+	int CheckpointInterval = 10;
+	std::string ResumePath;
+
+	// Records every car's poses to a file per generation in this directory
+	// when not empty.
+	std::string TrajectoryDir;
+
+	// Champions of this many previous generations replayed next to the live
+	// cars from their recorded tracks.
+	int GhostCount = 0;
+};
+
+// How many cars each kill rule stopped in a generation, over all terrains
+struct KillStats
+{
+	std::array<uint32_t, static_cast<size_t>(KillReason::Count)> Counts = {};
+	double SimulatedTimeSaved = 0.0;
+};
+
+// Wall-clock seconds taken by the generations of a run
+struct LatencyStats
+{
+	float P50 = 0.0f;
+	float P90 = 0.0f;
+	float P99 = 0.0f;
+	float Max = 0.0f;
+	size_t Count = 0;
+};
+
+// A previous generation's champion, drawn from its track rather than simulated
+struct Ghost
+{
+	int GenerationIndex;
+	int Fitness;
+	b2PolygonShape ChassisShape;
+	Trajectory::Track Track;
+	CarPose Pose;
+};
+
 class Generation
 {
 private:
-	std::unique_ptr<b2World> m_World;
+	// One per terrain, each simulating every genome. The first is the one
+	// which is drawn and recorded.
+	std::vector<std::unique_ptr<Arena>> m_Arenas;
+
+	// The next generation's arenas, built in the background while this one
+	// runs so turnover only has to swap them in. Populated is set once the
+	// offspring's cars have been added.
+	std::vector<std::unique_ptr<Arena>> m_SpareArenas;
+	bool m_SparePopulated;
+
+	RandomStream m_Random;
+
+	GenomeBatch m_Genomes;
+	GenomeBatch m_ChildGenomes;
+	// The cars which were done when breeding started at the quorum
+	GenomeBatch m_ParentGenomes;
+
+	// Made when the first generation is bred, so it starts from that one
+	std::unique_ptr<Optimizer> m_Optimizer;
+
+	// Trained on every generation's fitness, and the pool of offspring it
+	// picks the children from when screening
+	FitnessSurrogate m_Surrogate;
+	GenomeBatch m_CandidateGenomes;
+
+	// Only used while breeding, its stats are copied out at turnover
+	NoveltyArchive m_Novelty;
+	NoveltyStats m_NoveltyStats;
+
+	// Made along with the genomes, so creating the cars only adds bodies
+	std::vector<b2PolygonShape> m_ChassisShapes;
+	std::vector<b2PolygonShape> m_ChildChassisShapes;
+
+	GenerationSettings m_Settings;
+
+	uint32_t m_TerrainSeed;
+	uint64_t m_PhysicsProfile;
+	FitnessCache m_FitnessCache;
+	// Held while the cache is written, breeding looks into it in the background
+	std::mutex m_FitnessCacheMutex;
+
+	RunLog::Writer m_RunLog;
+	// Set while the run is logged or rerun from a log, the fitness cache,
+	// breed quorum and wall-clock bound are then not used
+	bool m_Replayable;
+	Checkpoint::Writer m_CheckpointWriter;
+	Trajectory::Recorder m_Recorder;
+
+	// Tracks of the live cars while ghosts are shown, the best one is kept
+	std::vector<Trajectory::Track> m_Tracks;
+	std::vector<Ghost> m_Ghosts;
+
+	// The platform's, then one per range of cars, refilled every frame
+	mutable std::vector<DrawList> m_DrawLists;
+	mutable DrawList m_GhostDrawList;
+	uint32_t m_Step;
+	uint32_t m_NextCarId;
+
+	int m_GenerationIndex;
+	std::vector<float> m_BestFitnessHistory;
+	std::vector<float> m_LastFitness;
+	std::vector<float> m_ChampionTerrainFitness;
+	KillStats m_KillStats;
+	double m_TotalTimeSaved;
+	uint64_t m_TotalSimulatedCars;
+
+	std::chrono::steady_clock::time_point m_GenerationStart;
+	std::vector<float> m_GenerationSeconds;
+	std::vector<float> m_TurnoverSeconds;
+	int m_CutOffCount;
 
-	std::unique_ptr<Platform> m_Platform;
-	std::vector<std::unique_ptr<Car>> m_Cars;
+	// Breeds into m_ChildGenomes, adds the offspring to the spare arenas and
+	// leaves the generation stream after it in m_BredRandom.
+	RandomStream m_BredRandom;
+	bool m_BreedingStarted;
+
+	// Declared last so they are waited on before anything they use is
+	// destroyed, breeding first as it waits on the spare arenas.
+	TaskGroup m_Retiring;
+	TaskGroup m_SpareBuild;
+	TaskGroup m_Breeding;
 
 public:
 	Generation();
 	~Generation();
 
-	void Create(int numCars);
+	void Create(const GenerationSettings &settings);
 	void Update(float delta);
 	void Draw() const;
+	void DrawGhosts() const;
+
+	// Fills the draw lists of the first arena, ranges of cars are built as
+	// separate jobs. Draw builds them with the scene's view and submits them.
+	void BuildDrawLists(const glm::mat4 &viewProj) const;
+	size_t GetDrawVertexCount() const;
 
 	const Car *GetBestCar() const;
+	// Index of the best car, or -1 when every car is dead
+	int GetBestCarIndex() const;
+
+	// Changes are picked up when the next generation is created
+	GenerationSettings &GetSettings() { return m_Settings; }
+
+	inline int GetGenerationIndex() const { return m_GenerationIndex; }
+	inline const std::vector<Ghost> &GetGhosts() const { return m_Ghosts; }
+	inline const std::vector<float> &GetBestFitnessHistory() const { return m_BestFitnessHistory; }
+	// Fitness of every car of the last finished generation
+	inline const std::vector<float> &GetLastFitness() const { return m_LastFitness; }
+
+	// Fitness of each terrain for the champion of the last finished generation
+	inline const std::vector<float> &GetChampionTerrainFitness() const { return m_ChampionTerrainFitness; }
+
+	// Of the last finished generation, and saved over the whole run
+	inline const KillStats &GetKillStats() const { return m_KillStats; }
+	inline double GetTotalTimeSaved() const { return m_TotalTimeSaved; }
+
+	// Runs of a car on a terrain whose fitness was simulated rather than taken
+	// from the fitness cache, over the whole run
+	inline uint64_t GetTotalSimulatedCars() const { return m_TotalSimulatedCars; }
+
+	// Wall-clock time of whole generations, and of the pause at turnover
+	// while the next generation is created.
+	inline LatencyStats GetGenerationLatency() const { return MakeLatencyStats(m_GenerationSeconds); }
+	inline LatencyStats GetTurnoverLatency() const { return MakeLatencyStats(m_TurnoverSeconds); }
+	// Generations which hit MaxGenerationSeconds
+	inline int GetCutOffCount() const { return m_CutOffCount; }
+
+	inline bool IsReplayable() const { return m_Replayable; }
+
+	// A setting whose state a run log does not hold, so the generations bred
+	// after a rerun would not carry on as the run did, or null
+	static const char *FindUnloggedSetting(const GenerationSettings &settings);
+
+	// Archive size and indexing time of the last generation bred
+	inline const NoveltyStats &GetNoveltyStats() const { return m_NoveltyStats; }
+
+	inline uint32_t GetTerrainSeed() const { return m_TerrainSeed; }
+	inline size_t GetTerrainCount() const { return m_Arenas.size(); }
+	inline const Arena &GetArena(size_t terrainIndex) const { return *m_Arenas[terrainIndex]; }
+	inline const FitnessCache &GetFitnessCache() const { return m_FitnessCache; }
+
+	// The population at the start of the current generation
+	Checkpoint::State GetState() const;
 
 private:
+	uint64_t MakePhysicsProfile() const;
+	std::vector<float> GatherFitness() const;
+	// Cars whose fitness is final on every terrain, as they are dead or it
+	// was taken from the cache
+	std::vector<uint32_t> GatherDoneCars() const;
+	// Parents are only chosen from parentCars, every car when it is empty
+	void StartBreeding(std::vector<float> fitness, std::vector<uint32_t> parentCars);
+	void GatherBehaviours(std::vector<CarBehaviour> &behaviours, std::vector<uint32_t> &carIndices) const;
+	// The fitness and behaviours are of the parents, in the order of
+	// parentCars when it is not empty
+	RandomStream BreedOffspring(std::vector<float> fitness, std::vector<uint32_t> parentCars, RandomStream random,
+	                            SelectionSettings selectionSettings, OptimizerSettings optimizerSettings,
+	                            SurrogateSettings surrogateSettings, int eliteCount,
+	                            uint32_t firstCarId, size_t numChildren, NoveltySettings noveltySettings,
+	                            std::vector<CarBehaviour> behaviours, std::vector<uint32_t> behaviourCars,
+	                            bool skipCachedBodies);
+	void ScreenCandidates(size_t firstChild, size_t numChildren, const SurrogateSettings &surrogateSettings);
+	void StartSpareBuild();
+	void RetireArenas(std::vector<std::unique_ptr<Arena>> &&arenas);
+	// Of the genome at index in the current population
+	const FitnessCache::Entry *FindCachedFitness(Arena &arena, size_t index);
+	void CreateArenas();
+	void CreateCars();
+	void CreateCar(Arena &arena, size_t index, uint32_t carId);
+	void CacheFitness();
+	bool LoadReplay(Checkpoint::State &state) const;
+	void LogGeneration(const std::vector<float> &targetFitness);
+	// Stops logging once a setting the log cannot hold is turned on
+	void CheckRunLogSettings();
+	inline bool UsesFitnessCache() const { return m_Settings.UseFitnessCache && !m_Replayable; }
+	void BeginRecording();
+	void RecordPoses();
+	void AddGhost(size_t carIndex);
+
 	void NextGeneration();
+
+	static LatencyStats MakeLatencyStats(const std::vector<float> &seconds);
 };
@@ -0,0 +1,245 @@
+#include "GenomeBatch.h"
+#include "JobSystem.h"
+#include "Log.h"
+
+static const float kMixScale = 1.0f / std::log(1000.0f + 1.0f);
+
+// How each gene's draw is split, a 24 bit fraction and three coin flips in
+// the low half, another fraction and the pick of a parent's wheel in the
+// high half.
+static constexpr uint32_t kFractionMask = (1u << 24) - 1;
+static constexpr float kFractionScale = 1.0f / static_cast<float>(1 << 24);
+
+static inline uint32_t Low(uint64_t bits) { return static_cast<uint32_t>(bits); }
+static inline uint32_t High(uint64_t bits) { return static_cast<uint32_t>(bits >> 32); }
+
+static inline float Fraction(uint32_t half) { return static_cast<float>(half & kFractionMask) * kFractionScale; }
+static inline bool Flip(uint64_t bits) { return (Low(bits) >> 24) & 1; }
+static inline bool Chance(uint64_t bits) { return (Low(bits) >> 25) & 1; }
+static inline bool Pick(uint64_t bits) { return (Low(bits) >> 26) & 1; }
+
+// One of `count` wheels, at least one
+static inline size_t PickIndex(uint64_t bits, size_t count)
+{
+	return ((High(bits) >> 24) * std::max<size_t>(count, 1)) >> 8;
+}
+
+struct Mutation
+{
+	float AmountMin, AmountMax;
+	float Min, Max;
+};
+
+static constexpr Mutation kDensityMutation = { 0.5f, 2.0f, CarConstants::kMinChassisDensity, CarConstants::kMaxChassisDensity };
+static constexpr Mutation kFrictionMutation = { 0.05f, 0.3f, 0.1f, 1.0f };
+static constexpr Mutation kRestitutionMutation = { 0.5f, 2.0f, 0.1f, 1.0f };
+static constexpr Mutation kWheelDensityMutation = { 0.5f, 2.0f, CarConstants::kMinWheelDensity, CarConstants::kMaxWheelDensity };
+static constexpr Mutation kWheelFrictionMutation = { 0.5f, 2.0f, 0.1f, 1.0f };
+static constexpr Mutation kWheelRestitutionMutation = { 0.5f, 2.0f, 0.1f, 1.0f };
+static constexpr Mutation kWheelRadiusMutation = { 0.5f, 2.0f, CarConstants::kMinWheelRadius, CarConstants::kMaxWheelRadius };
+static constexpr Mutation kWheelMotorSpeedMutation = { 0.5f, 2.0f, -CarConstants::kMaxWheelMotorSpeed, -CarConstants::kMinWheelMotorSpeed };
+static constexpr Mutation kControllerMutation = { -0.5f, 0.5f, -CarConstants::kMaxControllerWeight, CarConstants::kMaxControllerWeight };
+
+// Where each gene's draw is in a child's block, the controller's are only
+// drawn when a parent has one
+static constexpr size_t kFirstVertexDraw = 3;
+static constexpr size_t kWheelCountDraw = kFirstVertexDraw + CarConstants::kNumVertices;
+static constexpr size_t kFirstWheelDraw = kWheelCountDraw + 1;
+static constexpr size_t kDrawsPerWheel = 6;
+static constexpr size_t kControlledDraw = kFirstWheelDraw + kDrawsPerWheel * CarConstants::kNumVertices;
+static constexpr size_t kFirstWeightDraw = kControlledDraw + 1;
+static constexpr size_t kDrawsPerChild = kFirstWeightDraw + CarConstants::kNumControllerWeights;
+
+static const WheelProto kDefaultWheel;
+static const ControllerProto kNoController;
+
+// Smaller batches are bred on the calling thread alone
+static constexpr size_t kChildrenPerJob = 4096;
+
+// Log distributed ratio, biased towards taking most of one parent
+static inline float Blend(float value1, float value2, uint64_t bits)
+{
+	float mix = std::log(1000.0f * Fraction(Low(bits)) + 1.0f) * kMixScale;
+	mix = Flip(bits) ? 1.0f - mix : mix;
+
+	return value1 * mix + value2 * (1.0f - mix);
+}
+
+static inline float Mutate(float value, uint64_t bits, const Mutation &mutation)
+{
+	if (Chance(bits))
+	{
+		value += mutation.AmountMin + (mutation.AmountMax - mutation.AmountMin) * Fraction(High(bits));
+	}
+
+	return std::min(std::max(value, mutation.Min), mutation.Max);
+}
+
+void GenomeBatch::Resize(size_t size, bool controllers)
+{
+	Genomes.resize(size);
+	Controllers.resize(controllers ? size : 0);
+}
+
+void GenomeBatch::Set(size_t index, const CarProto &carProto, const ControllerProto *controller)
+{
+	BL_ASSERT(!carProto.Controlled || HasControllers(), "A controlled genome needs the controller section !");
+
+	Genomes[index] = carProto;
+
+	if (HasControllers())
+	{
+		Controllers[index] = carProto.Controlled && controller ? *controller : kNoController;
+	}
+}
+
+void Breeder::Breed(const GenomeBatch &parents,
+                    const std::vector<uint32_t> &parents1,
+                    const std::vector<uint32_t> &parents2,
+                    GenomeBatch &children,
+                    RandomStream &random)
+{
+	BL_ASSERT(parents1.size() == parents2.size(), "Every child needs two parents !");
+
+	size_t count = parents1.size();
+
+	// Without a parent which has a controller no numbers are drawn for the
+	// controller genes and the children have none either
+	bool breedControllers = std::any_of(parents.Genomes.begin(), parents.Genomes.end(),
+		[](const CarProto &carProto) { return carProto.Controlled != 0; });
+
+	// Sized once, each job only touches its own children
+	children.Resize(count, breedControllers);
+
+	uint64_t firstCounter = random.GetCounter();
+
+	JobSystem::ParallelFor(count, kChildrenPerJob, [&](size_t begin, size_t end)
+	{
+		RandomStream childRandom = random;
+
+		for (size_t i = begin; i < end; i++)
+		{
+			childRandom.SetCounter(firstCounter + i * kDrawsPerChild);
+			BreedChild(parents, parents1[i], parents2[i], children, i, childRandom);
+		}
+	});
+
+	random.SetCounter(firstCounter + count * kDrawsPerChild);
+}
+
+void Breeder::BreedChild(const GenomeBatch &parents, uint32_t parentIndex1, uint32_t parentIndex2,
+                         GenomeBatch &children, size_t childIndex, RandomStream &random)
+{
+	const CarProto &parent1 = parents.Get(parentIndex1);
+	const CarProto &parent2 = parents.Get(parentIndex2);
+	CarProto &child = children.Get(childIndex);
+
+	bool breedController = children.HasControllers();
+
+	uint64_t bits[kDrawsPerChild];
+	random.FillBits(bits, breedController ? kDrawsPerChild : kControlledDraw);
+
+	// Chassis
+	child.Density = Mutate(Blend(parent1.Density, parent2.Density, bits[0]), bits[0], kDensityMutation);
+	child.Friction = Mutate(Blend(parent1.Friction, parent2.Friction, bits[1]), bits[1], kFrictionMutation);
+	child.Restitution = Mutate(Blend(parent1.Restitution, parent2.Restitution, bits[2]), bits[2], kRestitutionMutation);
+
+	// Vertices, each one comes from either parent and is then offset
+	for (size_t j = 0; j < CarConstants::kNumVertices; j++)
+	{
+		uint64_t vertexBits = bits[kFirstVertexDraw + j];
+
+		child.Vertices[j] = Pick(vertexBits) ? parent1.Vertices[j] : parent2.Vertices[j];
+
+		if (Chance(vertexBits))
+		{
+			child.Vertices[j].x = std::min(child.Vertices[j].x + 0.5f + 1.5f * Fraction(Low(vertexBits)), CarConstants::kMaxVertexExtent);
+			child.Vertices[j].y = std::min(child.Vertices[j].y + 0.5f + 1.5f * Fraction(High(vertexBits)), CarConstants::kMaxVertexExtent);
+		}
+	}
+
+	child.WheelCount = Pick(bits[kWheelCountDraw]) ? parent1.WheelCount : parent2.WheelCount;
+
+	BL_ASSERT(child.WheelCount > 0, "A car has no wheels...");
+
+	// Wheels only one parent has take each gene from a random wheel the
+	// parents share instead, and then mutate that
+	size_t minWheelCount = std::min(parent1.WheelCount, parent2.WheelCount);
+
+	auto breedWheelGene = [&](size_t j, float WheelProto::*gene, uint64_t geneBits, const Mutation &mutation)
+	{
+		float value;
+
+		if (j < minWheelCount)
+		{
+			value = Blend(parent1.Wheels[j].*gene, parent2.Wheels[j].*gene, geneBits);
+		}
+		else
+		{
+			const CarProto &parent = Pick(geneBits) ? parent1 : parent2;
+			value = parent.Wheels[PickIndex(geneBits, minWheelCount)].*gene;
+		}
+
+		child.Wheels[j].*gene = Mutate(value, geneBits, mutation);
+	};
+
+	for (size_t j = 0; j < child.WheelCount; j++)
+	{
+		const uint64_t *wheelBits = bits + kFirstWheelDraw + j * kDrawsPerWheel;
+
+		breedWheelGene(j, &WheelProto::Density, wheelBits[0], kWheelDensityMutation);
+		breedWheelGene(j, &WheelProto::Friction, wheelBits[1], kWheelFrictionMutation);
+		breedWheelGene(j, &WheelProto::Restitution, wheelBits[2], kWheelRestitutionMutation);
+		breedWheelGene(j, &WheelProto::Radius, wheelBits[3], kWheelRadiusMutation);
+		breedWheelGene(j, &WheelProto::MotorSpeed, wheelBits[4], kWheelMotorSpeedMutation);
+
+		// A random wheel's vertex of either parent, moved by at most one
+		uint64_t vertexBits = wheelBits[5];
+
+		const CarProto &parent = Pick(vertexBits) ? parent1 : parent2;
+		int vertex = parent.WheelVertices[PickIndex(vertexBits, minWheelCount)];
+
+		if (Chance(vertexBits))
+		{
+			int step = std::min(static_cast<int>(Fraction(Low(vertexBits)) * 3.0f), 2) - 1;
+			vertex = std::clamp(vertex + step, 0, static_cast<int>(CarConstants::kNumVertices) - 1);
+		}
+
+		child.WheelVertices[j] = static_cast<CarProto::VertexIndex>(vertex);
+	}
+
+	// Unused wheels keep the defaults so equal genomes have equal bytes
+	for (size_t j = child.WheelCount; j < CarConstants::kNumVertices; j++)
+	{
+		child.Wheels[j] = kDefaultWheel;
+		child.WheelVertices[j] = 0;
+	}
+
+	// Taken from either parent, weights a parent without one does not have
+	// are blended in as zero. Cars without a controller keep zero weights.
+	child.Controlled = breedController && (Pick(bits[kControlledDraw]) ? parent1.Controlled : parent2.Controlled);
+
+	if (!breedController)
+	{
+		return;
+	}
+
+	ControllerProto &controller = children.Controllers[childIndex];
+
+	if (!child.Controlled)
+	{
+		controller = kNoController;
+		return;
+	}
+
+	const ControllerProto *controller1 = parents.GetController(parentIndex1);
+	const ControllerProto *controller2 = parents.GetController(parentIndex2);
+	const ControllerProto::WeightsArr &weights1 = (controller1 ? *controller1 : kNoController).Weights;
+	const ControllerProto::WeightsArr &weights2 = (controller2 ? *controller2 : kNoController).Weights;
+
+	for (size_t w = 0; w < CarConstants::kNumControllerWeights; w++)
+	{
+		uint64_t weightBits = bits[kFirstWeightDraw + w];
+		controller.Weights[w] = Mutate(Blend(weights1[w], weights2[w], weightBits), weightBits, kControllerMutation);
+	}
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "Car.h"
+#include "Random.h"
+
+// The genomes of a whole population, one after another so that breeding
+// reads each parent from a few cache lines rather than a line per gene. The
+// controllers are a section of their own, one per genome, which is only
+// there while some genome is controlled.
+struct GenomeBatch
+{
+	std::vector<CarProto> Genomes;
+	std::vector<ControllerProto> Controllers;
+
+	void Resize(size_t size, bool controllers = false);
+	inline size_t GetSize() const { return Genomes.size(); }
+	inline bool HasControllers() const { return !Controllers.empty(); }
+
+	inline const CarProto &Get(size_t index) const { return Genomes[index]; }
+	inline CarProto &Get(size_t index) { return Genomes[index]; }
+
+	// Null for a genome without a controller
+	inline const ControllerProto *GetController(size_t index) const
+	{
+		return Genomes[index].Controlled && HasControllers() ? &Controllers[index] : nullptr;
+	}
+
+	// A null controller leaves zero weights, the section has to be there for
+	// a controlled genome.
+	void Set(size_t index, const CarProto &carProto, const ControllerProto *controller = nullptr);
+	inline void Copy(size_t index, const GenomeBatch &other, size_t otherIndex)
+	{
+		Set(index, other.Get(otherIndex), other.GetController(otherIndex));
+	}
+};
+
+// Blend crossover followed by offset and clamp mutation, one child at a
+// time. Every child draws from its own block of the stream, one value per
+// gene at a fixed offset, so large batches are split into jobs without the
+// children depending on the split and without drawing more than is used.
+class Breeder
+{
+public:
+	// children[i] is bred from parents[parents1[i]] and parents[parents2[i]],
+	// the results only depend on the inputs and the stream.
+	void Breed(const GenomeBatch &parents,
+	           const std::vector<uint32_t> &parents1,
+	           const std::vector<uint32_t> &parents2,
+	           GenomeBatch &children,
+	           RandomStream &random);
+
+private:
+	static void BreedChild(const GenomeBatch &parents, uint32_t parent1, uint32_t parent2,
+	                       GenomeBatch &children, size_t child, RandomStream &random);
+};
@@ -0,0 +1,67 @@
+#include "Headless.h"
+#include "Random.h"
+#include "Log.h"
+
+#include <chrono>
+
+using Clock = std::chrono::steady_clock;
+
+// Stops a generation with a car which never dies from stalling the run
+static constexpr int kMaxStepsPerGeneration = 60 * 60 * 5;
+
+int Headless::Run(const GenerationSettings &settings, int numGenerations, bool printCars)
+{
+	Generation generation;
+	generation.Create(settings);
+
+	fprintf(stdout, "Master seed %llu, terrain seed %u, %zu terrains by %s\n",
+		static_cast<unsigned long long>(Random::GetSeed()), generation.GetTerrainSeed(), generation.GetTerrainCount(),
+		EvaluationSettings::GetAggregationName(generation.GetSettings().Evaluation.Aggregation));
+	fprintf(stdout, "%-12s %12s %12s %14s %12s %18s\n", "Generation", "Steps", "Best", "Seconds", "Saved", "Checksum");
+
+	for (int i = 0; i < numGenerations; i++)
+	{
+		int generationIndex = generation.GetGenerationIndex();
+		int steps = 0;
+
+		Clock::time_point start = Clock::now();
+
+		while (generation.GetGenerationIndex() == generationIndex)
+		{
+			if (++steps > kMaxStepsPerGeneration)
+			{
+				fprintf(stdout, "Generation %d did not finish in %d steps\n", generationIndex, kMaxStepsPerGeneration);
+				return 1;
+			}
+
+			generation.Update(k_UpdateDeltaTime);
+		}
+
+		double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+		const std::vector<float> &fitness = generation.GetLastFitness();
+
+		fprintf(stdout, "%-12d %12d %12.0f %14.3f %12.1f %18llx\n",
+			generationIndex, steps, generation.GetBestFitnessHistory().back(), seconds,
+			generation.GetKillStats().SimulatedTimeSaved,
+			static_cast<unsigned long long>(FitnessCache::HashBytes(fitness.data(), fitness.size() * sizeof(float))));
+
+		if (printCars)
+		{
+			for (size_t c = 0; c < fitness.size(); c++)
+			{
+				fprintf(stdout, "    car %-6zu %12.0f\n", c, fitness[c]);
+			}
+		}
+	}
+
+	LatencyStats latency = generation.GetGenerationLatency();
+	fprintf(stdout, "Generation seconds p50 %.3f, p90 %.3f, p99 %.3f, max %.3f, %d of %zu cut off\n",
+		latency.P50, latency.P90, latency.P99, latency.Max, generation.GetCutOffCount(), latency.Count);
+
+	LatencyStats turnover = generation.GetTurnoverLatency();
+	fprintf(stdout, "Turnover milliseconds p50 %.3f, p90 %.3f, p99 %.3f, max %.3f\n",
+		turnover.P50 * 1e3f, turnover.P90 * 1e3f, turnover.P99 * 1e3f, turnover.Max * 1e3f);
+
+	return 0;
+}
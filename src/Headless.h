@@ -0,0 +1,11 @@
+#pragma once
+
+#include "Generation.h"
+
+// Runs generations without a window, `Blobolution --headless [generations]`
+namespace Headless
+{
+	// Prints the best fitness, wall-clock time and a checksum of every car's
+	// fitness for each generation, so two runs can be compared exactly.
+	int Run(const GenerationSettings &settings, int numGenerations, bool printCars);
+}
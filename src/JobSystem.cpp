@@ -0,0 +1,304 @@
+#include "JobSystem.h"
+#include "Log.h"
+
+#include <chrono>
+
+std::vector<std::unique_ptr<JobSystem::Worker>> JobSystem::s_Workers;
+std::atomic<size_t> JobSystem::s_Queued = 0;
+std::atomic<size_t> JobSystem::s_NextWorker = 0;
+std::mutex JobSystem::s_SleepMutex;
+std::condition_variable JobSystem::s_SleepCondition;
+bool JobSystem::s_Quit = false;
+
+static constexpr size_t kNoWorker = std::numeric_limits<size_t>::max();
+
+// Index of the worker running on this thread, none for any other thread
+static thread_local size_t s_WorkerIndex = kNoWorker;
+
+TaskGroup::TaskGroup()
+	: m_Pending(0)
+{
+}
+
+TaskGroup::~TaskGroup()
+{
+	Wait();
+}
+
+void TaskGroup::Run(Job job)
+{
+	JobSystem::Submit(std::move(job), this);
+}
+
+void TaskGroup::Then(Job continuation)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+
+		if (m_Pending > 0)
+		{
+			m_Continuations.push_back(std::move(continuation));
+			return;
+		}
+	}
+
+	JobSystem::Submit(std::move(continuation), this);
+}
+
+void TaskGroup::Wait()
+{
+	while (!IsDone())
+	{
+		// Only with jobs of this group, anything else queued may be a long
+		// background job which would hold up the waiting thread
+		if (JobSystem::RunOne(this))
+		{
+			continue;
+		}
+
+		// Nothing to help with, the jobs left are running elsewhere. Woken
+		// when they finish, or after a moment to look for new jobs.
+		std::unique_lock<std::mutex> lock(m_Mutex);
+		m_DoneCondition.wait_for(lock, std::chrono::milliseconds(1), [this]() { return m_Pending == 0; });
+	}
+
+	// A job finishing may still hold the lock after the count reaches zero
+	std::lock_guard<std::mutex> lock(m_Mutex);
+}
+
+void TaskGroup::Finish()
+{
+	std::vector<Job> continuations;
+
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+
+		// The last job queues the continuations before the count can reach
+		// zero, so the group is never seen done in between.
+		if (m_Pending == 1 && !m_Continuations.empty())
+		{
+			continuations.swap(m_Continuations);
+		}
+
+		m_Pending += static_cast<uint32_t>(continuations.size());
+
+		if (--m_Pending == 0)
+		{
+			m_DoneCondition.notify_all();
+		}
+	}
+
+	for (Job &continuation : continuations)
+	{
+		JobSystem::Enqueue({ std::move(continuation), this });
+	}
+}
+
+void JobSystem::Create(size_t numWorkers)
+{
+	BL_ASSERT(s_Workers.empty(), "The job system was already created !");
+
+	s_Quit = false;
+
+	// Every deque exists before any worker starts stealing from them
+	for (size_t i = 0; i < numWorkers; i++)
+	{
+		s_Workers.push_back(std::make_unique<Worker>());
+	}
+
+	for (size_t i = 0; i < numWorkers; i++)
+	{
+		s_Workers[i]->Thread = std::thread(&JobSystem::WorkerMain, i);
+	}
+
+	BL_LOG("Job system started with %zu workers", numWorkers);
+}
+
+void JobSystem::Destroy()
+{
+	{
+		std::lock_guard<std::mutex> lock(s_SleepMutex);
+		s_Quit = true;
+	}
+	s_SleepCondition.notify_all();
+
+	for (auto &worker : s_Workers)
+	{
+		worker->Thread.join();
+	}
+
+	s_Workers.clear();
+	s_Quit = false;
+}
+
+size_t JobSystem::GetDefaultWorkerCount()
+{
+	return std::max(std::thread::hardware_concurrency(), 1u) - 1;
+}
+
+void JobSystem::Submit(Job job, TaskGroup *group)
+{
+	if (group)
+	{
+		group->m_Pending++;
+	}
+
+	Enqueue({ std::move(job), group });
+}
+
+void JobSystem::Enqueue(Task task)
+{
+	if (s_Workers.empty())
+	{
+		Execute(task);
+		return;
+	}
+
+	// Workers push to their own deque, any other thread spreads its jobs
+	size_t index = s_WorkerIndex != kNoWorker ? s_WorkerIndex : s_NextWorker++ % s_Workers.size();
+
+	// Counted first so a worker never sees the count drop below zero
+	s_Queued++;
+
+	{
+		std::lock_guard<std::mutex> lock(s_Workers[index]->Mutex);
+		s_Workers[index]->Tasks.push_back(std::move(task));
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(s_SleepMutex);
+	}
+	s_SleepCondition.notify_one();
+}
+
+void JobSystem::ParallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)> &body)
+{
+	if (count == 0)
+	{
+		return;
+	}
+
+	grain = std::max<size_t>(grain, 1);
+
+	if (s_Workers.empty() || count <= grain)
+	{
+		body(0, count);
+		return;
+	}
+
+	TaskGroup group;
+	for (size_t begin = grain; begin < count; begin += grain)
+	{
+		size_t end = std::min(begin + grain, count);
+		group.Run([&body, begin, end]() { body(begin, end); });
+	}
+
+	body(0, grain);
+
+	group.Wait();
+}
+
+bool JobSystem::RunOne(TaskGroup *group)
+{
+	Task task;
+
+	if ((s_WorkerIndex != kNoWorker && Pop(s_WorkerIndex, group, task)) || Steal(s_WorkerIndex, group, task))
+	{
+		Execute(task);
+		return true;
+	}
+
+	return false;
+}
+
+void JobSystem::WorkerMain(size_t index)
+{
+	s_WorkerIndex = index;
+
+	while (true)
+	{
+		if (RunOne())
+		{
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(s_SleepMutex);
+		s_SleepCondition.wait(lock, []() { return s_Queued > 0 || s_Quit; });
+
+		// Only once everything queued has run
+		if (s_Quit && s_Queued == 0)
+		{
+			return;
+		}
+	}
+}
+
+bool JobSystem::Pop(size_t index, TaskGroup *group, Task &task)
+{
+	Worker &worker = *s_Workers[index];
+	std::lock_guard<std::mutex> lock(worker.Mutex);
+
+	// Newest first
+	for (auto it = worker.Tasks.rbegin(); it != worker.Tasks.rend(); ++it)
+	{
+		if (group && it->Group != group)
+		{
+			continue;
+		}
+
+		task = std::move(*it);
+		worker.Tasks.erase(std::next(it).base());
+		s_Queued--;
+
+		return true;
+	}
+
+	return false;
+}
+
+bool JobSystem::Steal(size_t thief, TaskGroup *group, Task &task)
+{
+	size_t numWorkers = s_Workers.size();
+	size_t first = thief != kNoWorker ? thief + 1 : 0;
+
+	for (size_t i = 0; i < numWorkers; i++)
+	{
+		size_t victim = (first + i) % numWorkers;
+
+		if (victim == thief)
+		{
+			continue;
+		}
+
+		Worker &worker = *s_Workers[victim];
+
+		std::lock_guard<std::mutex> lock(worker.Mutex);
+
+		// Oldest first
+		for (auto it = worker.Tasks.begin(); it != worker.Tasks.end(); ++it)
+		{
+			if (group && it->Group != group)
+			{
+				continue;
+			}
+
+			task = std::move(*it);
+			worker.Tasks.erase(it);
+			s_Queued--;
+
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void JobSystem::Execute(Task &task)
+{
+	task.Function();
+
+	if (task.Group)
+	{
+		task.Group->Finish();
+	}
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+
+using Job = std::function<void()>;
+
+// Counts the jobs run through it. Continuations added with Then are queued
+// once every job before them is done, and count as jobs of the group too.
+class TaskGroup
+{
+public:
+	TaskGroup();
+	~TaskGroup();
+
+	TaskGroup(const TaskGroup &) = delete;
+	TaskGroup &operator=(const TaskGroup &) = delete;
+
+	void Run(Job job);
+	void Then(Job continuation);
+
+	// Runs queued jobs of this group on the calling thread until it is done,
+	// it never picks up anyone else's
+	void Wait();
+
+	inline bool IsDone() const { return m_Pending == 0; }
+
+private:
+	friend class JobSystem;
+
+	void Finish();
+
+private:
+	std::atomic<uint32_t> m_Pending;
+	std::vector<Job> m_Continuations;
+	std::mutex m_Mutex;
+	std::condition_variable m_DoneCondition;
+};
+
+// One pool of threads for everything which runs in the background or is
+// split across cores. Each worker has its own deque, it takes the newest job
+// from the back of its own and steals the oldest from the front of another's
+// when it runs dry. Threads waiting on a group help with its queued jobs.
+//
+// Without workers every job runs on the thread which submits it.
+class JobSystem
+{
+public:
+	// Workers besides the main thread, by default one less than the cores
+	static void Create(size_t numWorkers = GetDefaultWorkerCount());
+	// Runs whatever is still queued before the workers are joined
+	static void Destroy();
+
+	static size_t GetDefaultWorkerCount();
+	static size_t GetWorkerCount() { return s_Workers.size(); }
+
+	static void Submit(Job job, TaskGroup *group = nullptr);
+
+	// Calls body(begin, end) over ranges of at most `grain` indices in
+	// [0, count), and returns once all of them are done. The calling thread
+	// runs the first range itself.
+	static void ParallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)> &body);
+
+	// Runs one queued job on the calling thread, only one of `group` when it
+	// is given, false if there was none
+	static bool RunOne(TaskGroup *group = nullptr);
+
+private:
+	friend class TaskGroup;
+
+	struct Task
+	{
+		Job Function;
+		TaskGroup *Group = nullptr;
+	};
+
+	struct Worker
+	{
+		std::mutex Mutex;
+		std::deque<Task> Tasks;
+		std::thread Thread;
+	};
+
+	static void WorkerMain(size_t index);
+
+	static void Enqueue(Task task);
+
+	static bool Pop(size_t index, TaskGroup *group, Task &task);
+	static bool Steal(size_t thief, TaskGroup *group, Task &task);
+	static void Execute(Task &task);
+
+private:
+	static std::vector<std::unique_ptr<Worker>> s_Workers;
+	static std::atomic<size_t> s_Queued;
+	static std::atomic<size_t> s_NextWorker;
+	static std::mutex s_SleepMutex;
+	static std::condition_variable s_SleepCondition;
+	static bool s_Quit;
+};
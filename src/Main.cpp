@@ -1,11 +1,304 @@
 #include "Application.h"
 #include "SimLayer.h"
+#include "ReplayLayer.h"
+#include "Benchmark.h"
+#include "Headless.h"
+#include "EvalServer.h"
+#include "Random.h"
+#include "JobSystem.h"
 
-int main()
+#include <cstring>
+
+static void PrintUsage()
+{
+	fprintf(stdout,
+		"Usage: Blobolution [options]\n"
+		"       Blobolution --bench <name> [args...]\n"
+		"\n"
+		"  --seed <seed>               Master seed of the run, random when not given\n"
+		"  --cars <count>              Number of cars in each generation, 50 by default\n"
+		"  --massive [cars]            A population of 10000 cars or more, without ghosts or shown cached cars,\n"
+		"                              best with --breed-quorum 0.95 so a tail of slow cars does not hold up breeding\n"
+		"  --log <file>                Record a run log any generation can be replayed from, without the fitness cache\n"
+		"  --rerun <file> <generation> Re-simulate a generation of a run log and carry on from it\n"
+		"  --checkpoint <file> [every] Save the population every few generations, 10 by default\n"
+		"  --resume <file>             Carry on from a saved population, and the run log given with --log\n"
+		"  --record <directory>        Record every car's trajectory, a file per generation\n"
+		"  --replay <file>             Play back a recorded trajectory file\n"
+		"  --ghosts <count>            Show the champions of this many previous generations\n"
+		"  --terrains <count> [mean|min|<quantile>]\n"
+		"                              Score every car on several terrains, by the mean by default\n"
+		"  --time-limit <seconds>      Stop every car after this much simulated time, 300 by default\n"
+		"  --breed-quorum <fraction>   Breed the next generation once this share of cars is done\n"
+		"  --max-seconds <seconds>     Cut a generation off after this much wall-clock time\n"
+		"  --surrogate [pool factor]   Breed several times the population and only simulate the most promising\n"
+		"  --novelty [weight]          Select parents by fitness plus how unlike every earlier car they behaved\n"
+		"  --optimizer <ga|cmaes> [sigma]\n"
+		"                              Breed with the genetic algorithm, or sample the genes with CMA-ES\n"
+		"  --controllers               Evolve a controller for every car's wheels instead of constant motor speeds\n"
+		"  --kill-lagging              Stop cars too far behind the last median to likely catch up in time,\n"
+		"                              a heuristic which is off by default\n"
+		"  --no-kill-rules             Only stop cars when they run out of health\n"
+		"  --headless [generations]    Run without a window for a number of generations\n"
+		"  --serve [socket]            Evaluate batches of genomes sent over stdin or a Unix domain socket\n"
+		"  --print-cars                Print the fitness of every car when headless\n");
+}
+
+int main(int argc, char **argv)
 {
+	if (argc > 1 && std::strcmp(argv[1], "--bench") == 0)
+	{
+		JobSystem::Create();
+		int result = Benchmark::Run(argc - 2, argv + 2);
+		JobSystem::Destroy();
+
+		return result;
+	}
+
+	GenerationSettings settings;
+	uint64_t seed = 0;
+	bool headless = false;
+	int headlessGenerations = 1;
+	bool printCars = false;
+	bool serve = false;
+	std::string socketPath;
+	std::string replayPath;
+
+	// Given on the command line, a run log can not be written with either
+	bool breedQuorumGiven = false;
+	bool maxSecondsGiven = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		const char *arg = argv[i];
+
+		if (std::strcmp(arg, "--seed") == 0 && i + 1 < argc)
+		{
+			seed = std::strtoull(argv[++i], nullptr, 10);
+		}
+		else if (std::strcmp(arg, "--cars") == 0 && i + 1 < argc)
+		{
+			settings.NumCars = std::clamp(std::atoi(argv[++i]), 2, kMaxPopulation);
+		}
+		else if (std::strcmp(arg, "--massive") == 0)
+		{
+			settings.NumCars = 10000;
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+			{
+				settings.NumCars = std::clamp(std::atoi(argv[++i]), 2, kMaxPopulation);
+			}
+
+			// Per car work which is not needed to evolve. A breed quorum and
+			// the lagging rule, a heuristic which can stop cars that would
+			// have caught up, are asked for on their own.
+			settings.GhostCount = 0;
+			settings.ShowCachedCars = false;
+		}
+		else if (std::strcmp(arg, "--log") == 0 && i + 1 < argc)
+		{
+			settings.RunLogPath = argv[++i];
+		}
+		else if (std::strcmp(arg, "--rerun") == 0 && i + 2 < argc)
+		{
+			settings.ReplayLogPath = argv[++i];
+			settings.ReplayGeneration = std::atoi(argv[++i]);
+		}
+		else if (std::strcmp(arg, "--checkpoint") == 0 && i + 1 < argc)
+		{
+			settings.CheckpointPath = argv[++i];
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+			{
+				settings.CheckpointInterval = std::atoi(argv[++i]);
+			}
+		}
+		else if (std::strcmp(arg, "--resume") == 0 && i + 1 < argc)
+		{
+			settings.ResumePath = argv[++i];
+		}
+		else if (std::strcmp(arg, "--record") == 0 && i + 1 < argc)
+		{
+			settings.TrajectoryDir = argv[++i];
+		}
+		else if (std::strcmp(arg, "--replay") == 0 && i + 1 < argc)
+		{
+			replayPath = argv[++i];
+		}
+		else if (std::strcmp(arg, "--ghosts") == 0 && i + 1 < argc)
+		{
+			settings.GhostCount = std::atoi(argv[++i]);
+		}
+		else if (std::strcmp(arg, "--terrains") == 0 && i + 1 < argc)
+		{
+			settings.Evaluation.TerrainCount = std::max(std::atoi(argv[++i]), 1);
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+			{
+				const char *aggregation = argv[++i];
+
+				if (std::strcmp(aggregation, "mean") == 0)
+				{
+					settings.Evaluation.Aggregation = FitnessAggregation::Mean;
+				}
+				else if (std::strcmp(aggregation, "min") == 0)
+				{
+					settings.Evaluation.Aggregation = FitnessAggregation::Min;
+				}
+				else
+				{
+					settings.Evaluation.Aggregation = FitnessAggregation::Quantile;
+					settings.Evaluation.Quantile = static_cast<float>(std::atof(aggregation));
+				}
+			}
+		}
+		else if (std::strcmp(arg, "--time-limit") == 0 && i + 1 < argc)
+		{
+			settings.Kill.TimeLimit = static_cast<float>(std::atof(argv[++i]));
+		}
+		else if (std::strcmp(arg, "--breed-quorum") == 0 && i + 1 < argc)
+		{
+			settings.BreedQuorum = std::clamp(static_cast<float>(std::atof(argv[++i])), 0.0f, 1.0f);
+			breedQuorumGiven = settings.BreedQuorum < 1.0f;
+		}
+		else if (std::strcmp(arg, "--max-seconds") == 0 && i + 1 < argc)
+		{
+			settings.MaxGenerationSeconds = static_cast<float>(std::atof(argv[++i]));
+			maxSecondsGiven = settings.MaxGenerationSeconds > 0.0f;
+		}
+		else if (std::strcmp(arg, "--surrogate") == 0)
+		{
+			settings.Surrogate.Enabled = true;
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+			{
+				settings.Surrogate.PoolFactor = std::max(std::atoi(argv[++i]), 2);
+			}
+		}
+		else if (std::strcmp(arg, "--novelty") == 0)
+		{
+			settings.Novelty.Enabled = true;
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+			{
+				settings.Novelty.Weight = static_cast<float>(std::atof(argv[++i]));
+			}
+		}
+		else if (std::strcmp(arg, "--optimizer") == 0 && i + 1 < argc)
+		{
+			const char *optimizer = argv[++i];
+
+			if (std::strcmp(optimizer, "cmaes") == 0)
+			{
+				settings.Optimizer.Type = OptimizerType::CmaEs;
+				if (i + 1 < argc && argv[i + 1][0] != '-')
+				{
+					settings.Optimizer.CmaSigma = static_cast<float>(std::atof(argv[++i]));
+				}
+			}
+			else
+			{
+				settings.Optimizer.Type = OptimizerType::Genetic;
+			}
+		}
+		else if (std::strcmp(arg, "--controllers") == 0)
+		{
+			settings.UseControllers = true;
+		}
+		else if (std::strcmp(arg, "--kill-lagging") == 0)
+		{
+			settings.Kill.KillLagging = true;
+		}
+		else if (std::strcmp(arg, "--no-kill-rules") == 0)
+		{
+			settings.Kill.FlippedTime = 0.0f;
+			settings.Kill.StalledTime = 0.0f;
+			settings.Kill.FallenDepth = 0.0f;
+			settings.Kill.KillLagging = false;
+		}
+		else if (std::strcmp(arg, "--headless") == 0)
+		{
+			headless = true;
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+			{
+				headlessGenerations = std::atoi(argv[++i]);
+			}
+		}
+		else if (std::strcmp(arg, "--serve") == 0)
+		{
+			serve = true;
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+			{
+				socketPath = argv[++i];
+			}
+		}
+		else if (std::strcmp(arg, "--print-cars") == 0)
+		{
+			printCars = true;
+		}
+		else
+		{
+			PrintUsage();
+			return 1;
+		}
+	}
+
+	// A logged run has to rerun exactly, see RunLog. The fitness cache is on
+	// by default, so it is turned off rather than refused.
+	if (!settings.RunLogPath.empty() || !settings.ReplayLogPath.empty())
+	{
+		const char *unlogged = breedQuorumGiven ? "--breed-quorum"
+		                     : maxSecondsGiven ? "--max-seconds"
+		                     : Generation::FindUnloggedSetting(settings);
+
+		if (unlogged)
+		{
+			fprintf(stderr, "A run log cannot be written or rerun with %s\n", unlogged);
+			return 1;
+		}
+
+		settings.UseFitnessCache = false;
+		settings.BreedQuorum = 1.0f;
+	}
+
+	if (serve)
+	{
+		EvalServerSettings serverSettings;
+		serverSettings.SocketPath = socketPath;
+		serverSettings.TerrainSeed = settings.TerrainSeed;
+		serverSettings.Evaluation = settings.Evaluation;
+		serverSettings.Kill = settings.Kill;
+
+		Random::Create(seed);
+		JobSystem::Create();
+		int result = EvalServer::Run(serverSettings);
+		JobSystem::Destroy();
+		Random::Destroy();
+
+		return result;
+	}
+
+	if (headless)
+	{
+		Random::Create(seed);
+		JobSystem::Create();
+		int result = Headless::Run(settings, headlessGenerations, printCars);
+		JobSystem::Destroy();
+		Random::Destroy();
+
+		return result;
+	}
+
 	auto &app = Application::Get();
 
-	app.PushLayer(std::make_unique<SimLayer>());
+	if (seed != 0)
+	{
+		Random::Seed(seed);
+	}
+
+	if (!replayPath.empty())
+	{
+		app.PushLayer(std::make_unique<ReplayLayer>(replayPath));
+	}
+	else
+	{
+		app.PushLayer(std::make_unique<SimLayer>(settings));
+	}
 	app.Run();
 
 	return 0;
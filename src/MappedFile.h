@@ -0,0 +1,31 @@
+#pragma once
+
+// Read-only view of a whole file, mapped into memory rather than read
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	MappedFile(const MappedFile &) = delete;
+	MappedFile &operator=(const MappedFile &) = delete;
+
+	bool Open(const std::string &path);
+	void Close();
+
+	inline const uint8_t *GetData() const { return m_Data; }
+	inline size_t GetSize() const { return m_Size; }
+
+	inline bool IsOpen() const { return m_Data != nullptr; }
+
+private:
+	const uint8_t *m_Data;
+	size_t m_Size;
+
+#ifdef _WIN32
+	void *m_File;
+	void *m_Mapping;
+#else
+	int m_File;
+#endif
+};
@@ -0,0 +1,265 @@
+#include "Novelty.h"
+#include "JobSystem.h"
+#include "Log.h"
+
+#include <chrono>
+
+// Air time is scaled so a tenth of a second counts about as much as a metre
+static constexpr float kAirTimeScale = 10.0f;
+
+static constexpr float kInitialCellSize = 16.0f;
+static constexpr float kMinCellSize = 0.25f;
+
+// The grid is rebuilt finer once its cells hold this many on average
+static constexpr size_t kMaxPerCell = 32;
+
+// Nearest neighbours a behaviour can be scored by
+static constexpr size_t kMaxNeighbours = 64;
+
+static constexpr size_t kScoresPerJob = 256;
+
+static float Distance(const std::array<float, 3> &a, const std::array<float, 3> &b)
+{
+	float dx = a[0] - b[0];
+	float dy = a[1] - b[1];
+	float dz = a[2] - b[2];
+
+	return std::sqrt(dx * dx + dy * dy + dz * dz);
+}
+
+NoveltyArchive::NoveltyArchive()
+{
+	Reset();
+}
+
+void NoveltyArchive::Reset()
+{
+	m_Points.clear();
+	m_Cells.clear();
+	m_CellSize = kInitialCellSize;
+	m_MinCell = { 0, 0, 0 };
+	m_MaxCell = { 0, 0, 0 };
+	m_Stats = NoveltyStats();
+}
+
+NoveltyArchive::Point NoveltyArchive::MakePoint(const CarBehaviour &behaviour)
+{
+	return { behaviour.FinalX, behaviour.MaxHeight, behaviour.AirTime * kAirTimeScale };
+}
+
+NoveltyArchive::Cell NoveltyArchive::GetCell(const Point &point) const
+{
+	Cell cell;
+	for (size_t a = 0; a < 3; a++)
+	{
+		cell[a] = static_cast<int32_t>(std::floor(point[a] / m_CellSize));
+	}
+
+	return cell;
+}
+
+uint64_t NoveltyArchive::MakeKey(const Cell &cell)
+{
+	// 21 bits an axis, far more cells than any course is long
+	uint64_t key = 0;
+	for (size_t a = 0; a < 3; a++)
+	{
+		key = (key << 21) | (static_cast<uint64_t>(cell[a]) & 0x1FFFFF);
+	}
+
+	return key;
+}
+
+void NoveltyArchive::Insert(uint32_t index)
+{
+	Cell cell = GetCell(m_Points[index]);
+
+	if (m_Cells.empty())
+	{
+		m_MinCell = cell;
+		m_MaxCell = cell;
+	}
+
+	for (size_t a = 0; a < 3; a++)
+	{
+		m_MinCell[a] = std::min(m_MinCell[a], cell[a]);
+		m_MaxCell[a] = std::max(m_MaxCell[a], cell[a]);
+	}
+
+	m_Cells[MakeKey(cell)].push_back(index);
+}
+
+void NoveltyArchive::Rebuild(float cellSize)
+{
+	m_CellSize = cellSize;
+	m_Cells.clear();
+
+	for (size_t i = 0; i < m_Points.size(); i++)
+	{
+		Insert(static_cast<uint32_t>(i));
+	}
+}
+
+size_t NoveltyArchive::Add(const CarBehaviour *behaviours, size_t count, size_t maxSize)
+{
+	size_t first = m_Points.size();
+	count = std::min(count, maxSize > first ? maxSize - first : 0);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		m_Points.push_back(MakePoint(behaviours[i]));
+		Insert(static_cast<uint32_t>(first + i));
+	}
+
+	while (m_Points.size() > kMaxPerCell * m_Cells.size() && m_CellSize * 0.5f >= kMinCellSize)
+	{
+		Rebuild(m_CellSize * 0.5f);
+	}
+
+	return first;
+}
+
+float NoveltyArchive::Score(const CarBehaviour &behaviour, size_t k, size_t self) const
+{
+	size_t others = m_Points.size() - (self < m_Points.size() ? 1 : 0);
+	k = std::min({ k, others, kMaxNeighbours });
+
+	if (k == 0)
+	{
+		return 0.0f;
+	}
+
+	Point point = MakePoint(behaviour);
+
+	// Max-heap of the k nearest so far
+	std::array<float, kMaxNeighbours> nearest;
+	size_t numNearest = 0;
+
+	auto consider = [&](uint32_t index)
+	{
+		if (index == self)
+		{
+			return;
+		}
+
+		float distance = Distance(point, m_Points[index]);
+
+		if (numNearest < k)
+		{
+			nearest[numNearest++] = distance;
+			std::push_heap(nearest.begin(), nearest.begin() + numNearest);
+		}
+		else if (distance < nearest[0])
+		{
+			std::pop_heap(nearest.begin(), nearest.begin() + numNearest);
+			nearest[numNearest - 1] = distance;
+			std::push_heap(nearest.begin(), nearest.begin() + numNearest);
+		}
+	};
+
+	Cell centre = GetCell(point);
+
+	int32_t maxRing = 0;
+	for (size_t a = 0; a < 3; a++)
+	{
+		maxRing = std::max({ maxRing, centre[a] - m_MinCell[a], m_MaxCell[a] - centre[a] });
+	}
+
+	// Rings of cells around the behaviour's own, until nothing further out
+	// can be nearer than the kth nearest found. A behaviour far from the
+	// rest would visit a great many empty cells, so past as many cells as
+	// there are behaviours it is cheaper to look at every one.
+	size_t cellsVisited = 0;
+	bool exhaustive = false;
+
+	for (int32_t ring = 0; ring <= maxRing; ring++)
+	{
+		for (int32_t dx = -ring; dx <= ring; dx++)
+		{
+			for (int32_t dy = -ring; dy <= ring; dy++)
+			{
+				// Only the shell of the ring, the inside was visited already
+				bool onShell = std::abs(dx) == ring || std::abs(dy) == ring;
+				int32_t stepZ = onShell || ring == 0 ? 1 : 2 * ring;
+
+				for (int32_t dz = -ring; dz <= ring; dz += stepZ)
+				{
+					cellsVisited++;
+
+					auto it = m_Cells.find(MakeKey({ centre[0] + dx, centre[1] + dy, centre[2] + dz }));
+					if (it == m_Cells.end())
+					{
+						continue;
+					}
+
+					for (uint32_t index : it->second)
+					{
+						consider(index);
+					}
+				}
+			}
+		}
+
+		if (numNearest == k && nearest[0] <= static_cast<float>(ring) * m_CellSize)
+		{
+			break;
+		}
+
+		if (cellsVisited > m_Points.size())
+		{
+			exhaustive = true;
+			break;
+		}
+	}
+
+	if (exhaustive)
+	{
+		numNearest = 0;
+		for (size_t i = 0; i < m_Points.size(); i++)
+		{
+			consider(static_cast<uint32_t>(i));
+		}
+	}
+
+	float total = 0.0f;
+	for (size_t i = 0; i < numNearest; i++)
+	{
+		total += nearest[i];
+	}
+
+	return total / static_cast<float>(numNearest);
+}
+
+void NoveltyArchive::AddAndScore(const std::vector<CarBehaviour> &behaviours, const NoveltySettings &settings, std::vector<float> &novelty)
+{
+	using Clock = std::chrono::steady_clock;
+
+	Clock::time_point start = Clock::now();
+
+	size_t sizeBefore = m_Points.size();
+	size_t first = Add(behaviours.data(), behaviours.size(), static_cast<size_t>(std::max(settings.MaxArchiveSize, 0)));
+	size_t numAdded = m_Points.size() - sizeBefore;
+
+	Clock::time_point indexed = Clock::now();
+
+	size_t k = static_cast<size_t>(std::max(settings.Neighbours, 1));
+
+	// The archive is only read while scoring, so ranges are scored as jobs
+	novelty.resize(behaviours.size());
+	JobSystem::ParallelFor(behaviours.size(), kScoresPerJob, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			size_t self = i < numAdded ? first + i : std::numeric_limits<size_t>::max();
+			novelty[i] = Score(behaviours[i], k, self);
+		}
+	});
+
+	Clock::time_point scored = Clock::now();
+
+	m_Stats.ArchiveSize = m_Points.size();
+	m_Stats.CellCount = m_Cells.size();
+	m_Stats.CellSize = m_CellSize;
+	m_Stats.IndexSeconds = std::chrono::duration<float>(indexed - start).count();
+	m_Stats.QuerySeconds = std::chrono::duration<float>(scored - indexed).count();
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "Car.h"
+
+#include <unordered_map>
+
+struct NoveltySettings
+{
+	// Adds how unlike everything seen before a car behaved to the fitness
+	// parents are selected by
+	bool Enabled = false;
+
+	// A behaviour's novelty is its mean distance to this many neighbours
+	int Neighbours = 15;
+
+	// Fitness added for each unit of novelty, about a metre
+	float Weight = 1.0f;
+
+	// Behaviours are no longer archived past this many
+	int MaxArchiveSize = 1000000;
+};
+
+// Time spent on the archive by the last generation
+struct NoveltyStats
+{
+	size_t ArchiveSize = 0;
+	size_t CellCount = 0;
+	float CellSize = 0.0f;
+	float IndexSeconds = 0.0f;
+	float QuerySeconds = 0.0f;
+};
+
+// Every behaviour seen so far, with a uniform grid over them to find the
+// nearest neighbours of a behaviour without a scan of the whole archive.
+// Adding a behaviour only touches its cell. When the cells get crowded the
+// grid is rebuilt with half the cell size, so the archive can grow to
+// millions of behaviours and a query still only visits a few cells.
+class NoveltyArchive
+{
+public:
+	NoveltyArchive();
+
+	void Reset();
+
+	// Archives the behaviours, then scores each one by its mean distance to
+	// its nearest neighbours in the archive besides itself
+	void AddAndScore(const std::vector<CarBehaviour> &behaviours, const NoveltySettings &settings, std::vector<float> &novelty);
+
+	// Returns the index of the first behaviour added, behaviours past the
+	// archive's limit are dropped
+	size_t Add(const CarBehaviour *behaviours, size_t count, size_t maxSize);
+
+	// Mean distance from a behaviour to its k nearest archived ones, leaving
+	// out the archived behaviour at `self` if it is one of them
+	float Score(const CarBehaviour &behaviour, size_t k, size_t self = std::numeric_limits<size_t>::max()) const;
+
+	inline size_t GetSize() const { return m_Points.size(); }
+	inline const NoveltyStats &GetStats() const { return m_Stats; }
+
+private:
+	using Point = std::array<float, 3>;
+	using Cell = std::array<int32_t, 3>;
+
+	static Point MakePoint(const CarBehaviour &behaviour);
+
+	Cell GetCell(const Point &point) const;
+	static uint64_t MakeKey(const Cell &cell);
+
+	void Insert(uint32_t index);
+	void Rebuild(float cellSize);
+
+private:
+	std::vector<Point> m_Points;
+
+	std::unordered_map<uint64_t, std::vector<uint32_t>> m_Cells;
+	float m_CellSize;
+	Cell m_MinCell;
+	Cell m_MaxCell;
+
+	NoveltyStats m_Stats;
+};
@@ -0,0 +1,589 @@
+#include "Optimizer.h"
+#include "JobSystem.h"
+#include "Log.h"
+
+// Tiles of the blocked products, a tile of each operand fits in L1
+static constexpr size_t kTile = 32;
+
+// Samples are drawn as jobs of this many rows
+static constexpr size_t kSamplesPerJob = 256;
+
+static constexpr size_t kMaxJacobiSweeps = 50;
+
+// Vertices are kept at least this far from the centre, so the hull never
+// collapses whatever the sample
+static constexpr float kMinVertexRadius = 2.0f;
+
+// out[rows x n] = a[rows x n] * b[n x n], all row-major
+static void MultiplyBlocked(const double *a, const double *b, double *out, size_t rows, size_t n)
+{
+	std::fill_n(out, rows * n, 0.0);
+
+	for (size_t i0 = 0; i0 < rows; i0 += kTile)
+	{
+		size_t i1 = std::min(i0 + kTile, rows);
+
+		for (size_t k0 = 0; k0 < n; k0 += kTile)
+		{
+			size_t k1 = std::min(k0 + kTile, n);
+
+			for (size_t j0 = 0; j0 < n; j0 += kTile)
+			{
+				size_t j1 = std::min(j0 + kTile, n);
+
+				for (size_t i = i0; i < i1; i++)
+				{
+					for (size_t k = k0; k < k1; k++)
+					{
+						double aik = a[i * n + k];
+						const double *bk = &b[k * n];
+						double *outi = &out[i * n];
+
+						for (size_t j = j0; j < j1; j++)
+						{
+							outi[j] += aik * bk[j];
+						}
+					}
+				}
+			}
+		}
+	}
+}
+
+// c[n x n] += scale * y^T * y for y[count x n], the upper triangle of tiles
+// is worked out and then mirrored
+static void AddOuterProductsBlocked(const double *y, size_t count, size_t n, double scale, double *c)
+{
+	for (size_t i0 = 0; i0 < n; i0 += kTile)
+	{
+		size_t i1 = std::min(i0 + kTile, n);
+
+		for (size_t j0 = i0; j0 < n; j0 += kTile)
+		{
+			size_t j1 = std::min(j0 + kTile, n);
+
+			for (size_t r = 0; r < count; r++)
+			{
+				const double *row = &y[r * n];
+
+				for (size_t i = i0; i < i1; i++)
+				{
+					double yi = scale * row[i];
+					double *ci = &c[i * n];
+
+					for (size_t j = std::max(j0, i); j < j1; j++)
+					{
+						ci[j] += yi * row[j];
+					}
+				}
+			}
+		}
+	}
+
+	for (size_t i = 0; i < n; i++)
+	{
+		for (size_t j = i + 1; j < n; j++)
+		{
+			c[j * n + i] = c[i * n + j];
+		}
+	}
+}
+
+std::unique_ptr<Optimizer> Optimizer::Create(const OptimizerSettings &settings)
+{
+	switch (settings.Type)
+	{
+	case OptimizerType::CmaEs:
+		return std::make_unique<CmaEsOptimizer>(settings.CmaSigma);
+	case OptimizerType::Genetic:
+	default:
+		return std::make_unique<GeneticOptimizer>();
+	}
+}
+
+const char *Optimizer::GetTypeName(OptimizerType type)
+{
+	switch (type)
+	{
+	case OptimizerType::Genetic: return "Genetic";
+	case OptimizerType::CmaEs:   return "CMA-ES";
+	default:                     return "Unknown";
+	}
+}
+
+GeneticOptimizer::GeneticOptimizer()
+	: Optimizer(OptimizerType::Genetic)
+	, m_Parents(nullptr)
+{
+}
+
+void GeneticOptimizer::Tell(const GenomeBatch &genomes, const std::vector<float> &fitness, const SelectionSettings &selectionSettings)
+{
+	m_Parents = &genomes;
+
+	m_Selection = Selection::Create(selectionSettings);
+	m_Selection->Prepare(fitness);
+}
+
+void GeneticOptimizer::Ask(GenomeBatch &children, size_t count, RandomStream &random)
+{
+	BL_ASSERT(m_Parents && m_Selection, "The optimizer has not been told anything !");
+
+	// The population can be resized between generations, every child still
+	// picks its parents from the whole of the last one
+	m_Parents1.resize(count);
+	m_Parents2.resize(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		m_Parents1[i] = static_cast<uint32_t>(m_Selection->Select(random));
+		m_Parents2[i] = static_cast<uint32_t>(m_Selection->Select(random));
+	}
+
+	m_Breeder.Breed(*m_Parents, m_Parents1, m_Parents2, children, random);
+}
+
+CmaEsOptimizer::CmaEsOptimizer(float sigma)
+	: Optimizer(OptimizerType::CmaEs)
+	, m_InitialSigma(sigma)
+	, m_Controlled(false)
+	, m_Started(false)
+	, m_Generation(0)
+	, m_Dimension(0)
+	, m_Sigma(sigma)
+{
+}
+
+void CmaEsOptimizer::Initialise(bool controlled)
+{
+	using namespace CarConstants;
+
+	m_Controlled = controlled;
+	m_Genes.clear();
+
+	m_Genes.push_back({ GeneField::Density, 0, kMinChassisDensity, kMaxChassisDensity });
+	m_Genes.push_back({ GeneField::Friction, 0, 0.1f, 1.0f });
+	m_Genes.push_back({ GeneField::Restitution, 0, 0.1f, 1.0f });
+
+	for (uint8_t j = 0; j < kNumVertices; j++)
+	{
+		m_Genes.push_back({ GeneField::VertexX, j, -30.0f, 30.0f });
+		m_Genes.push_back({ GeneField::VertexY, j, -30.0f, 30.0f });
+	}
+
+	for (uint8_t j = 0; j < kNumVertices; j++)
+	{
+		m_Genes.push_back({ GeneField::WheelDensity, j, kMinWheelDensity, kMaxWheelDensity });
+		m_Genes.push_back({ GeneField::WheelFriction, j, 0.1f, 1.0f });
+		m_Genes.push_back({ GeneField::WheelRestitution, j, 0.1f, 1.0f });
+		m_Genes.push_back({ GeneField::WheelRadius, j, kMinWheelRadius, kMaxWheelRadius });
+		m_Genes.push_back({ GeneField::WheelMotorSpeed, j, -kMaxWheelMotorSpeed, -kMinWheelMotorSpeed });
+	}
+
+	// Only searched over once the population has controllers
+	if (controlled)
+	{
+		for (size_t w = 0; w < kNumControllerWeights; w++)
+		{
+			m_Genes.push_back({ GeneField::ControllerWeight, static_cast<uint8_t>(w), -kMaxControllerWeight, kMaxControllerWeight });
+		}
+	}
+
+	size_t n = m_Genes.size();
+	m_Dimension = n;
+
+	m_Mean.assign(n, 0.5);
+	m_Sigma = m_InitialSigma;
+	m_PathC.assign(n, 0.0);
+	m_PathSigma.assign(n, 0.0);
+
+	m_Covariance.assign(n * n, 0.0);
+	m_Basis.assign(n * n, 0.0);
+	for (size_t i = 0; i < n; i++)
+	{
+		m_Covariance[i * n + i] = 1.0;
+		m_Basis[i * n + i] = 1.0;
+	}
+	m_Scales.assign(n, 1.0);
+
+	m_Generation = 0;
+	m_Started = false;
+}
+
+const float &CmaEsOptimizer::GetGene(const CarProto &carProto, const ControllerProto &controller, const Gene &gene)
+{
+	switch (gene.Field)
+	{
+	case GeneField::Density:          return carProto.Density;
+	case GeneField::Friction:         return carProto.Friction;
+	case GeneField::Restitution:      return carProto.Restitution;
+	case GeneField::VertexX:          return carProto.Vertices[gene.Index].x;
+	case GeneField::VertexY:          return carProto.Vertices[gene.Index].y;
+	case GeneField::WheelDensity:     return carProto.Wheels[gene.Index].Density;
+	case GeneField::WheelFriction:    return carProto.Wheels[gene.Index].Friction;
+	case GeneField::WheelRestitution: return carProto.Wheels[gene.Index].Restitution;
+	case GeneField::WheelRadius:      return carProto.Wheels[gene.Index].Radius;
+	case GeneField::WheelMotorSpeed:  return carProto.Wheels[gene.Index].MotorSpeed;
+	case GeneField::ControllerWeight:
+	default:                          return controller.Weights[gene.Index];
+	}
+}
+
+float &CmaEsOptimizer::GetGene(CarProto &carProto, ControllerProto &controller, const Gene &gene)
+{
+	return const_cast<float &>(GetGene(static_cast<const CarProto &>(carProto), static_cast<const ControllerProto &>(controller), gene));
+}
+
+void CmaEsOptimizer::Encode(const GenomeBatch &genomes, size_t index, double *x) const
+{
+	static const ControllerProto kNoController;
+
+	const CarProto &carProto = genomes.Get(index);
+	const ControllerProto *controller = genomes.GetController(index);
+
+	for (size_t d = 0; d < m_Dimension; d++)
+	{
+		const Gene &gene = m_Genes[d];
+		x[d] = (static_cast<double>(GetGene(carProto, controller ? *controller : kNoController, gene)) - gene.Min) / (gene.Max - gene.Min);
+	}
+}
+
+void CmaEsOptimizer::Decode(const double *x, GenomeBatch &genomes, size_t index) const
+{
+	CarProto &carProto = genomes.Get(index);
+
+	uint8_t wheelCount = carProto.WheelCount;
+	bool controlled = genomes.GetController(index) != nullptr;
+
+	// Only written to for a controlled genome
+	ControllerProto unused;
+	ControllerProto &controller = controlled ? genomes.Controllers[index] : unused;
+
+	for (size_t d = 0; d < m_Dimension; d++)
+	{
+		const Gene &gene = m_Genes[d];
+
+		// Unused wheels keep their defaults and uncontrolled cars their zero
+		// weights, so equal genomes have equal bytes
+		bool wheelGene = gene.Field >= GeneField::WheelDensity && gene.Field <= GeneField::WheelMotorSpeed;
+		if ((wheelGene && gene.Index >= wheelCount) || (gene.Field == GeneField::ControllerWeight && !controlled))
+		{
+			continue;
+		}
+
+		float value = gene.Min + static_cast<float>(x[d]) * (gene.Max - gene.Min);
+		GetGene(carProto, controller, gene) = std::clamp(value, gene.Min, gene.Max);
+	}
+
+	for (size_t j = 0; j < CarConstants::kNumVertices; j++)
+	{
+		b2Vec2 &vertex = carProto.Vertices[j];
+
+		float radius = std::sqrt(vertex.x * vertex.x + vertex.y * vertex.y);
+		if (radius < kMinVertexRadius)
+		{
+			float angle = 6.2831853f * static_cast<float>(j) / static_cast<float>(CarConstants::kNumVertices);
+
+			vertex = { kMinVertexRadius * std::cos(angle), kMinVertexRadius * std::sin(angle) };
+		}
+	}
+}
+
+void CmaEsOptimizer::Tell(const GenomeBatch &genomes, const std::vector<float> &fitness, const SelectionSettings &selectionSettings)
+{
+	m_Genetic.Tell(genomes, fitness, selectionSettings);
+
+	bool controlled = std::any_of(genomes.Genomes.begin(), genomes.Genomes.end(), [](const CarProto &carProto) { return carProto.Controlled != 0; });
+	if (m_Dimension == 0 || controlled != m_Controlled)
+	{
+		Initialise(controlled);
+	}
+
+	size_t n = m_Dimension;
+	size_t lambda = fitness.size();
+	size_t mu = std::max<size_t>(lambda / 2, 1);
+
+	if (lambda == 0)
+	{
+		return;
+	}
+
+	// Log weights over the fittest half, the fittest first
+	std::vector<size_t> ranked = Selection::RankByFitness(fitness);
+
+	std::vector<double> weights(mu);
+	for (size_t i = 0; i < mu; i++)
+	{
+		weights[i] = std::log(static_cast<double>(mu) + 0.5) - std::log(static_cast<double>(i) + 1.0);
+	}
+	double weightSum = std::accumulate(weights.begin(), weights.end(), 0.0);
+	double weightSquares = 0.0;
+	for (double &weight : weights)
+	{
+		weight /= weightSum;
+		weightSquares += weight * weight;
+	}
+	double mueff = 1.0 / weightSquares;
+
+	std::vector<double> selected(mu * n);
+	for (size_t i = 0; i < mu; i++)
+	{
+		Encode(genomes, ranked[i], &selected[i * n]);
+	}
+
+	// Told about for the first time, the distribution starts around the
+	// fittest genomes rather than from any step
+	if (!m_Started)
+	{
+		std::fill(m_Mean.begin(), m_Mean.end(), 0.0);
+		for (size_t i = 0; i < mu; i++)
+		{
+			for (size_t d = 0; d < n; d++)
+			{
+				m_Mean[d] += weights[i] * selected[i * n + d];
+			}
+		}
+
+		m_Started = true;
+		return;
+	}
+
+	double dn = static_cast<double>(n);
+	double cc = (4.0 + mueff / dn) / (dn + 4.0 + 2.0 * mueff / dn);
+	double cs = (mueff + 2.0) / (dn + mueff + 5.0);
+	double c1 = 2.0 / ((dn + 1.3) * (dn + 1.3) + mueff);
+	double cmu = std::min(1.0 - c1, 2.0 * (mueff - 2.0 + 1.0 / mueff) / ((dn + 2.0) * (dn + 2.0) + mueff));
+	double damps = 1.0 + 2.0 * std::max(0.0, std::sqrt((mueff - 1.0) / (dn + 1.0)) - 1.0) + cs;
+	double chiN = std::sqrt(dn) * (1.0 - 1.0 / (4.0 * dn) + 1.0 / (21.0 * dn * dn));
+
+	// C^-1/2 * v by the eigen decomposition
+	std::vector<double> projected(n);
+	auto whiten = [&](const double *v, double *out)
+	{
+		for (size_t k = 0; k < n; k++)
+		{
+			const double *basis = &m_Basis[k * n];
+			double dot = 0.0;
+			for (size_t d = 0; d < n; d++)
+			{
+				dot += basis[d] * v[d];
+			}
+			projected[k] = dot / m_Scales[k];
+		}
+
+		std::fill_n(out, n, 0.0);
+		for (size_t k = 0; k < n; k++)
+		{
+			const double *basis = &m_Basis[k * n];
+			for (size_t d = 0; d < n; d++)
+			{
+				out[d] += projected[k] * basis[d];
+			}
+		}
+	};
+
+	// Steps from the mean, clipped to a length a sample could have had
+	double maxLength = std::sqrt(dn) + 2.0 * dn / (dn + 2.0);
+	std::vector<double> whitened(n);
+	for (size_t i = 0; i < mu; i++)
+	{
+		double *step = &selected[i * n];
+		for (size_t d = 0; d < n; d++)
+		{
+			step[d] = (step[d] - m_Mean[d]) / m_Sigma;
+		}
+
+		whiten(step, whitened.data());
+
+		double length = std::sqrt(std::inner_product(whitened.begin(), whitened.end(), whitened.begin(), 0.0));
+		if (length > maxLength)
+		{
+			for (size_t d = 0; d < n; d++)
+			{
+				step[d] *= maxLength / length;
+			}
+		}
+	}
+
+	std::vector<double> meanStep(n, 0.0);
+	for (size_t i = 0; i < mu; i++)
+	{
+		for (size_t d = 0; d < n; d++)
+		{
+			meanStep[d] += weights[i] * selected[i * n + d];
+		}
+	}
+
+	for (size_t d = 0; d < n; d++)
+	{
+		m_Mean[d] += m_Sigma * meanStep[d];
+	}
+
+	// Evolution paths
+	whiten(meanStep.data(), whitened.data());
+
+	double sigmaScale = std::sqrt(cs * (2.0 - cs) * mueff);
+	for (size_t d = 0; d < n; d++)
+	{
+		m_PathSigma[d] = (1.0 - cs) * m_PathSigma[d] + sigmaScale * whitened[d];
+	}
+
+	m_Generation++;
+
+	double pathSigmaLength = std::sqrt(std::inner_product(m_PathSigma.begin(), m_PathSigma.end(), m_PathSigma.begin(), 0.0));
+	double pathSigmaNorm = pathSigmaLength / std::sqrt(1.0 - std::pow(1.0 - cs, 2.0 * m_Generation)) / chiN;
+	bool stalled = pathSigmaNorm >= 1.4 + 2.0 / (dn + 1.0);
+
+	double covarianceScale = stalled ? 0.0 : std::sqrt(cc * (2.0 - cc) * mueff);
+	for (size_t d = 0; d < n; d++)
+	{
+		m_PathC[d] = (1.0 - cc) * m_PathC[d] + covarianceScale * meanStep[d];
+	}
+
+	// Rank one and rank mu updates, the rank mu one over the weighted steps
+	double decay = 1.0 - c1 - cmu + (stalled ? c1 * cc * (2.0 - cc) : 0.0);
+	for (double &value : m_Covariance)
+	{
+		value *= decay;
+	}
+
+	AddOuterProductsBlocked(m_PathC.data(), 1, n, c1, m_Covariance.data());
+
+	for (size_t i = 0; i < mu; i++)
+	{
+		double root = std::sqrt(weights[i]);
+		for (size_t d = 0; d < n; d++)
+		{
+			selected[i * n + d] *= root;
+		}
+	}
+	AddOuterProductsBlocked(selected.data(), mu, n, cmu, m_Covariance.data());
+
+	m_Sigma *= std::exp((cs / damps) * (pathSigmaLength / chiN - 1.0));
+	m_Sigma = std::clamp(m_Sigma, 1e-8, 1.0);
+
+	Decompose();
+}
+
+void CmaEsOptimizer::Decompose()
+{
+	// Cyclic Jacobi rotations, simple and plenty fast at a few hundred genes
+	size_t n = m_Dimension;
+
+	std::vector<double> a = m_Covariance;
+	std::vector<double> v(n * n, 0.0);
+	for (size_t i = 0; i < n; i++)
+	{
+		v[i * n + i] = 1.0;
+	}
+
+	for (size_t sweep = 0; sweep < kMaxJacobiSweeps; sweep++)
+	{
+		double offDiagonal = 0.0;
+		double diagonal = 0.0;
+		for (size_t p = 0; p < n; p++)
+		{
+			diagonal += a[p * n + p] * a[p * n + p];
+			for (size_t q = p + 1; q < n; q++)
+			{
+				offDiagonal += a[p * n + q] * a[p * n + q];
+			}
+		}
+
+		if (offDiagonal <= 1e-24 * diagonal)
+		{
+			break;
+		}
+
+		for (size_t p = 0; p < n; p++)
+		{
+			for (size_t q = p + 1; q < n; q++)
+			{
+				double apq = a[p * n + q];
+				if (std::abs(apq) < 1e-300)
+				{
+					continue;
+				}
+
+				double theta = (a[q * n + q] - a[p * n + p]) / (2.0 * apq);
+				double t = (theta >= 0.0 ? 1.0 : -1.0) / (std::abs(theta) + std::sqrt(theta * theta + 1.0));
+				double c = 1.0 / std::sqrt(t * t + 1.0);
+				double s = t * c;
+
+				for (size_t k = 0; k < n; k++)
+				{
+					double akp = a[k * n + p];
+					double akq = a[k * n + q];
+					a[k * n + p] = c * akp - s * akq;
+					a[k * n + q] = s * akp + c * akq;
+				}
+
+				for (size_t k = 0; k < n; k++)
+				{
+					double apk = a[p * n + k];
+					double aqk = a[q * n + k];
+					a[p * n + k] = c * apk - s * aqk;
+					a[q * n + k] = s * apk + c * aqk;
+				}
+
+				for (size_t k = 0; k < n; k++)
+				{
+					double vkp = v[k * n + p];
+					double vkq = v[k * n + q];
+					v[k * n + p] = c * vkp - s * vkq;
+					v[k * n + q] = s * vkp + c * vkq;
+				}
+			}
+		}
+	}
+
+	// Eigenvectors are the columns of v, stored as rows
+	for (size_t k = 0; k < n; k++)
+	{
+		m_Scales[k] = std::sqrt(std::max(a[k * n + k], 1e-20));
+
+		for (size_t d = 0; d < n; d++)
+		{
+			m_Basis[k * n + d] = v[d * n + k];
+		}
+	}
+}
+
+void CmaEsOptimizer::Ask(GenomeBatch &children, size_t count, RandomStream &random)
+{
+	// The discrete genes, and a complete genome to write the samples into
+	m_Genetic.Ask(children, count, random);
+
+	if (!m_Started)
+	{
+		return;
+	}
+
+	size_t n = m_Dimension;
+
+	// Drawn in order on this thread, so the samples do not depend on the split
+	std::vector<double> scaled(count * n);
+	for (size_t i = 0; i < count; i++)
+	{
+		for (size_t k = 0; k < n; k++)
+		{
+			scaled[i * n + k] = m_Scales[k] * random.Normal<double>();
+		}
+	}
+
+	std::vector<double> samples(count * n);
+	JobSystem::ParallelFor(count, kSamplesPerJob, [&](size_t begin, size_t end)
+	{
+		MultiplyBlocked(&scaled[begin * n], m_Basis.data(), &samples[begin * n], end - begin, n);
+
+		for (size_t i = begin; i < end; i++)
+		{
+			double *x = &samples[i * n];
+			for (size_t d = 0; d < n; d++)
+			{
+				x[d] = m_Mean[d] + m_Sigma * x[d];
+			}
+
+			Decode(x, children, i);
+		}
+	});
+}
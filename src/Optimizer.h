@@ -0,0 +1,147 @@
+#pragma once
+
+#include "GenomeBatch.h"
+#include "Selection.h"
+
+enum class OptimizerType
+{
+	Genetic = 0,
+	CmaEs,
+	Count
+};
+
+struct OptimizerSettings
+{
+	OptimizerType Type = OptimizerType::Genetic;
+
+	// Starting step size of CMA-ES, as a share of each gene's range
+	float CmaSigma = 0.2f;
+};
+
+// Searches the space of genomes by ask and tell. The generation tells it how
+// the genomes it simulated did, then asks it for the ones to simulate next.
+// What an optimizer has learnt, the whole search distribution for CMA-ES, is
+// neither checkpointed nor recorded in the run log, so a resumed run starts
+// it afresh.
+class Optimizer
+{
+public:
+	virtual ~Optimizer() {}
+
+	// Higher fitness is better. The genomes have to stay as they are until
+	// the next Ask.
+	virtual void Tell(const GenomeBatch &genomes, const std::vector<float> &fitness, const SelectionSettings &selectionSettings) = 0;
+
+	// Fills the first `count` genomes of children
+	virtual void Ask(GenomeBatch &children, size_t count, RandomStream &random) = 0;
+
+	inline OptimizerType GetType() const { return m_Type; }
+
+public:
+	static std::unique_ptr<Optimizer> Create(const OptimizerSettings &settings);
+
+	static const char *GetTypeName(OptimizerType type);
+
+protected:
+	Optimizer(OptimizerType type) : m_Type(type) {}
+
+protected:
+	OptimizerType m_Type;
+};
+
+// The genetic algorithm, parents picked by a selection strategy and bred by
+// blend crossover and mutation, see Breeder.
+class GeneticOptimizer : public Optimizer
+{
+public:
+	GeneticOptimizer();
+
+	virtual void Tell(const GenomeBatch &genomes, const std::vector<float> &fitness, const SelectionSettings &selectionSettings) override;
+	virtual void Ask(GenomeBatch &children, size_t count, RandomStream &random) override;
+
+private:
+	const GenomeBatch *m_Parents;
+	std::unique_ptr<Selection> m_Selection;
+	Breeder m_Breeder;
+
+	std::vector<uint32_t> m_Parents1;
+	std::vector<uint32_t> m_Parents2;
+};
+
+// CMA-ES over the continuous genes, each scaled by its range. The discrete
+// genes, how many wheels there are and which vertex each one is on, are left
+// to the genetic algorithm, which breeds every child before its continuous
+// genes are replaced by a sample of the search distribution.
+//
+// The genomes told about are used as they are rather than matched up with
+// the samples they came from, so elites and screened offspring are fine.
+// Steps further than a sample could plausibly be are clipped.
+//
+// Sampling and the rank-mu update are products of a whole batch with the
+// covariance, done in tiles which stay in cache.
+class CmaEsOptimizer : public Optimizer
+{
+public:
+	CmaEsOptimizer(float sigma);
+
+	virtual void Tell(const GenomeBatch &genomes, const std::vector<float> &fitness, const SelectionSettings &selectionSettings) override;
+	virtual void Ask(GenomeBatch &children, size_t count, RandomStream &random) override;
+
+	inline size_t GetDimension() const { return m_Dimension; }
+	inline double GetSigma() const { return m_Sigma; }
+
+private:
+	enum class GeneField : uint8_t
+	{
+		Density,
+		Friction,
+		Restitution,
+		VertexX,
+		VertexY,
+		WheelDensity,
+		WheelFriction,
+		WheelRestitution,
+		WheelRadius,
+		WheelMotorSpeed,
+		ControllerWeight
+	};
+
+	struct Gene
+	{
+		GeneField Field;
+		uint8_t Index;
+		float Min, Max;
+	};
+
+	void Initialise(bool controlled);
+	void Encode(const GenomeBatch &genomes, size_t index, double *x) const;
+	void Decode(const double *x, GenomeBatch &genomes, size_t index) const;
+	void Decompose();
+
+	static const float &GetGene(const CarProto &carProto, const ControllerProto &controller, const Gene &gene);
+	static float &GetGene(CarProto &carProto, ControllerProto &controller, const Gene &gene);
+
+private:
+	GeneticOptimizer m_Genetic;
+
+	float m_InitialSigma;
+	bool m_Controlled;
+	bool m_Started;
+	int m_Generation;
+
+	std::vector<Gene> m_Genes;
+	size_t m_Dimension;
+
+	// Mean and step size of the search distribution, in scaled genes
+	std::vector<double> m_Mean;
+	double m_Sigma;
+
+	std::vector<double> m_PathC;
+	std::vector<double> m_PathSigma;
+
+	// Covariance, and its eigenvectors as rows with the square roots of the
+	// eigenvalues, all row-major
+	std::vector<double> m_Covariance;
+	std::vector<double> m_Basis;
+	std::vector<double> m_Scales;
+};
@@ -5,45 +5,130 @@
 Platform::Platform()
 	: m_PlatformBody(nullptr)
 	, m_PlatformCount(0)
+	, m_Position(b2Vec2_zero)
+	, m_HeightStart(0.0f)
 {
 }
 
-void Platform::Create(b2World &world, int platformCount)
+void Platform::Create(int platformCount, uint32_t seed)
 {
-	BL_ASSERT(!m_PlatformBody, "The platform has already been created !");
+	m_PlatformCount = platformCount;
+	m_Position = {-50.0f, -20.0f};
+	m_Segments.resize(m_PlatformCount);
 
-	if (!m_PlatformBody)
+	// The terrain has its own stream so the same seed always builds the
+	// same course, whatever else has drawn from Random.
+	RandomStream random(RandomStream::MakeKey(seed, 0));
+
+	float angle = 0.0f, prevAngle = 0.0f, x = 0.0f, y = 0.0f;
+
+	for (int i = 0; i < m_PlatformCount; i++)
 	{
-		m_PlatformCount = platformCount;
+		angle = 1.05f * random.Float(-0.5f, 0.5f) * std::powf(
+			2.0f, static_cast<float>(i) / static_cast<float>(m_PlatformCount)
+		);
 
-		b2BodyDef def;
-		def.type = b2_staticBody;
-		def.position = {-50.0f, -20.0f};
+		x += 10.0f * (cos(prevAngle) + sin(3.14159f / 2.0f - angle));
+		y += 10.0f * (cos(3.14159f / 2.0f - angle) + sin(prevAngle));
 
-		m_PlatformBody = world.CreateBody(&def);
+		prevAngle = angle;
+
+		b2Vec2 p1 = {-5.0f * std::cos(angle) - 1.0f * std::sin(angle) + x / 2.0f, -5.0f * std::sin(angle) + 1.0f * std::cos(angle) + y / 2.0f};
+		b2Vec2 p2 = {-5.0f * std::cos(angle) + 1.0f * std::sin(angle) + x / 2.0f, -5.0f * std::sin(angle) - 1.0f * std::cos(angle) + y / 2.0f};
+		b2Vec2 p3 = {5.0f * std::cos(angle) + 1.0f * std::sin(angle) + x / 2.0f, 5.0f * std::sin(angle) - 1.0f * std::cos(angle) + y / 2.0f};
+		b2Vec2 p4 = {5.0f * std::cos(angle) - 1.0f * std::sin(angle) + x / 2.0f, 5.0f * std::sin(angle) + 1.0f * std::cos(angle) + y / 2.0f};
+
+		m_Segments[i] = {p1, p2, p3, p4};
+	}
+
+	BuildHeightField();
+}
+
+void Platform::BuildHeightField()
+{
+	m_Heights.clear();
 
-		float angle = 0.0f, prevAngle = 0.0f, x = 0.0f, y = 0.0f;
+	if (m_Segments.empty())
+	{
+		return;
+	}
 
-		for (int i = 0; i < m_PlatformCount; i++)
+	float minX = std::numeric_limits<float>::max();
+	float maxX = -std::numeric_limits<float>::max();
+	for (const Segment &segment : m_Segments)
+	{
+		for (const b2Vec2 &corner : segment)
 		{
-			angle = 1.05f * Random::Float(-0.5f, 0.5f) * std::powf(
-				2.0f, static_cast<float>(i) / static_cast<float>(m_PlatformCount)
-			);
+			minX = std::min(minX, corner.x);
+			maxX = std::max(maxX, corner.x);
+		}
+	}
 
-			x += 10.0f * (cos(prevAngle) + sin(3.14159f / 2.0f - angle));
-			y += 10.0f * (cos(3.14159f / 2.0f - angle) + sin(prevAngle));
+	m_HeightStart = minX + m_Position.x;
 
-			prevAngle = angle;
+	size_t numSamples = static_cast<size_t>((maxX - minX) / kHeightStep) + 2;
+	m_Heights.assign(numSamples, -std::numeric_limits<float>::max());
 
-			b2Vec2 p1 = {-5.0f * std::cos(angle) - 1.0f * std::sin(angle) + x / 2.0f, -5.0f * std::sin(angle) + 1.0f * std::cos(angle) + y / 2.0f};
-			b2Vec2 p2 = {-5.0f * std::cos(angle) + 1.0f * std::sin(angle) + x / 2.0f, -5.0f * std::sin(angle) - 1.0f * std::cos(angle) + y / 2.0f};
-			b2Vec2 p3 = {5.0f * std::cos(angle) + 1.0f * std::sin(angle) + x / 2.0f, 5.0f * std::sin(angle) - 1.0f * std::cos(angle) + y / 2.0f};
-			b2Vec2 p4 = {5.0f * std::cos(angle) - 1.0f * std::sin(angle) + x / 2.0f, 5.0f * std::sin(angle) + 1.0f * std::cos(angle) + y / 2.0f};
+	// The top of a plank runs from its first to its last corner, planks
+	// overlap so each sample takes the highest one above it.
+	for (const Segment &segment : m_Segments)
+	{
+		b2Vec2 left = segment[0];
+		b2Vec2 right = segment[3];
 
-			b2Vec2 points[] = {p1, p2, p3, p4};
+		if (left.x > right.x)
+		{
+			std::swap(left, right);
+		}
 
+		size_t first = static_cast<size_t>(std::ceil((left.x - minX) / kHeightStep));
+		size_t last = std::min(static_cast<size_t>((right.x - minX) / kHeightStep), numSamples - 1);
+		float slope = (right.y - left.y) / std::max(right.x - left.x, 1e-6f);
+
+		for (size_t i = first; i <= last; i++)
+		{
+			float x = minX + static_cast<float>(i) * kHeightStep;
+			m_Heights[i] = std::max(m_Heights[i], left.y + slope * (x - left.x));
+		}
+	}
+
+	// Samples no plank's top covers take the last one which was
+	float last = -std::numeric_limits<float>::max();
+	for (float &height : m_Heights)
+	{
+		last = height > -std::numeric_limits<float>::max() ? height : last;
+		height = last;
+	}
+
+	float first = *std::find_if(m_Heights.begin(), m_Heights.end(), [](float height)
+	{
+		return height > -std::numeric_limits<float>::max();
+	});
+
+	for (float &height : m_Heights)
+	{
+		height = (height > -std::numeric_limits<float>::max() ? height : first) + m_Position.y;
+	}
+}
+
+void Platform::Create(b2World &world, int platformCount, uint32_t seed)
+{
+	BL_ASSERT(!m_PlatformBody, "The platform has already been created !");
+
+	if (!m_PlatformBody)
+	{
+		Create(platformCount, seed);
+
+		b2BodyDef def;
+		def.type = b2_staticBody;
+		def.position = m_Position;
+
+		m_PlatformBody = world.CreateBody(&def);
+
+		for (const Segment &segment : m_Segments)
+		{
 			b2PolygonShape shape;
-			shape.Set(points, 4);
+			shape.Set(segment.data(), 4);
 
 			b2FixtureDef fixture;
 			fixture.shape = &shape;
@@ -66,30 +151,98 @@ void Platform::Destory()
 	}
 }
 
-void Platform::Draw()
+float Platform::GetFloor(float x) const
 {
-	if (m_PlatformBody)
+	if (m_Segments.empty())
 	{
-		b2Vec2 pos = m_PlatformBody->GetPosition();
-		float rot = m_PlatformBody->GetAngle();
+		return -std::numeric_limits<float>::max();
+	}
+
+	// The course only ever moves forwards, so segments are in order of x
+	float localX = x - m_Position.x;
+	auto it = std::lower_bound(m_Segments.begin(), m_Segments.end(), localX, [](const Segment &segment, float x)
+	{
+		return 0.5f * (segment[0].x + segment[2].x) < x;
+	});
 
-		for (b2Fixture *f = m_PlatformBody->GetFixtureList(); f; f = f->GetNext())
+	size_t index = std::min(static_cast<size_t>(it - m_Segments.begin()), m_Segments.size() - 1);
+	size_t first = index > 0 ? index - 1 : 0;
+	size_t last = std::min(index + 1, m_Segments.size() - 1);
+
+	float floor = std::numeric_limits<float>::max();
+	for (size_t i = first; i <= last; i++)
+	{
+		for (const b2Vec2 &corner : m_Segments[i])
 		{
-			auto vertexArray = ((b2PolygonShape *)f->GetShape())->m_vertices;
-			auto vertexCount = ((b2PolygonShape *)f->GetShape())->m_count;
+			floor = std::min(floor, corner.y);
+		}
+	}
+
+	return floor + m_Position.y;
+}
+
+void Platform::SampleHeights(const float *xs, float *heights, size_t count) const
+{
+	if (m_Heights.empty())
+	{
+		std::fill_n(heights, count, -std::numeric_limits<float>::max());
+		return;
+	}
+
+	const float *samples = m_Heights.data();
+	float maxPosition = static_cast<float>(m_Heights.size() - 1);
+	float scale = 1.0f / kHeightStep;
+
+	// Clamped rather than branched on, so the loop vectorises
+	for (size_t k = 0; k < count; k++)
+	{
+		float position = std::min(std::max((xs[k] - m_HeightStart) * scale, 0.0f), maxPosition);
+
+		size_t index = std::min(static_cast<size_t>(position), m_Heights.size() - 2);
+		float t = position - static_cast<float>(index);
 
-			std::vector<glm::vec3> vertices;
-			glm::vec4 colour = {0.8f, 0.2, 0.2f, 1.0f};
+		heights[k] = samples[index] + t * (samples[index + 1] - samples[index]);
+	}
+}
 
-			for (int i = 0; i < vertexCount; i++)
-			{
-				float x = (vertexArray[i].x * std::cosf(rot) - vertexArray[i].y * std::sinf(rot)) + pos.x;
-				float y = (vertexArray[i].x * std::sinf(rot) + vertexArray[i].y * std::cosf(rot)) + pos.y;
+float Platform::SampleHeight(float x) const
+{
+	float height;
+	SampleHeights(&x, &height, 1);
 
-				vertices.push_back({x, y, 0.0f});
-			}
+	return height;
+}
 
-			Renderer::SubmitFilledPolygon(vertices, colour);
+float Platform::GetFinish() const
+{
+	if (m_Segments.empty())
+	{
+		return std::numeric_limits<float>::max();
+	}
+
+	float finish = -std::numeric_limits<float>::max();
+	for (const b2Vec2 &corner : m_Segments.back())
+	{
+		finish = std::max(finish, corner.x);
+	}
+
+	return finish + m_Position.x;
+}
+
+void Platform::Draw(DrawList &drawList) const
+{
+	// The platform is static, so its shape never moves from where it was built
+	glm::vec4 colour = {0.8f, 0.2, 0.2f, 1.0f};
+
+	std::array<glm::vec3, 4> vertices;
+
+	for (const Segment &segment : m_Segments)
+	{
+		for (size_t i = 0; i < segment.size(); i++)
+		{
+			vertices[i] = {segment[i].x + m_Position.x, segment[i].y + m_Position.y, 0.0f};
 		}
+
+		drawList.SubmitFilledPolygon(vertices.data(), vertices.size(), colour);
 	}
 }
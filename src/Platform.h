@@ -4,17 +4,50 @@
 
 #include <box2d/box2d.h>
 
+// The course cars drive along, a chain of planks each a little steeper than
+// the last. Along with the planks it keeps a height-field of their top
+// surface, so the ground under many points can be looked up at once without
+// ray casts against the world.
 class Platform
 {
 public:
 	Platform();
 
-	void Create(b2World &world, int platformCount);
+	// Only builds the terrain's shape, enough to draw it without a world
+	void Create(int platformCount, uint32_t seed);
+	void Create(b2World &world, int platformCount, uint32_t seed);
 	void Destory();
 
-	void Draw();
+	void Draw(DrawList &drawList) const;
+
+	// Lowest point of the terrain around x, in world space. Past either end
+	// of the course this is the lowest point of the end segments.
+	float GetFloor(float x) const;
+
+	// Where the course ends, in world space
+	float GetFinish() const;
+
+	// Height of the top of the terrain at each of xs, in world space. Past
+	// either end of the course this is the height at that end. Only reads
+	// the height-field, so any number of threads can sample at once.
+	void SampleHeights(const float *xs, float *heights, size_t count) const;
+	float SampleHeight(float x) const;
+
+private:
+	void BuildHeightField();
 
 private:
+	using Segment = std::array<b2Vec2, 4>;
+
+	// Distance between the samples of the height-field
+	static constexpr float kHeightStep = 0.5f;
+
 	b2Body *m_PlatformBody;
 	int m_PlatformCount;
+	b2Vec2 m_Position;
+	std::vector<Segment> m_Segments;
+
+	// Highest top surface at evenly spaced x from m_HeightStart, in world space
+	std::vector<float> m_Heights;
+	float m_HeightStart;
 };
@@ -1,4 +1,34 @@
 #include "Random.h"
 
-std::mt19937 Random::s_RandomGenerator;
-std::uniform_int_distribution<Random::DistType> Random::s_Distribution;
\ No newline at end of file
+#include <thread>
+
+std::atomic<uint64_t> Random::s_Seed = 0;
+RandomStream Random::s_MainStream;
+
+static std::atomic<std::thread::id> s_SeedingThread;
+
+void Random::Create(uint64_t seed)
+{
+	if (seed == 0)
+	{
+		std::random_device device;
+		seed = (static_cast<uint64_t>(device()) << 32) | device();
+	}
+
+	Seed(seed);
+}
+
+void Random::Seed(uint64_t seed)
+{
+	s_SeedingThread.store(std::this_thread::get_id(), std::memory_order_relaxed);
+	s_Seed.store(seed, std::memory_order_release);
+	s_MainStream = MakeStream(kMainStream);
+}
+
+RandomStream &Random::GetMainStream()
+{
+	BL_ASSERT(std::this_thread::get_id() == s_SeedingThread.load(std::memory_order_relaxed),
+		"Only the thread which seeded may use the main stream, others need a stream of their own !");
+
+	return s_MainStream;
+}
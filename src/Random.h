@@ -1,74 +1,249 @@
 #pragma once
 
-class Random
+#include <atomic>
+
+// Counter based generator, the n-th value of a stream is a hash of the
+// stream's key and n. Streams are plain values which can be copied, stored
+// and restarted from any offset, and never share any state.
+class RandomStream
 {
 private:
-	using DistType = std::mt19937::result_type;
-	
-	static constexpr DistType kMaxDistTypeValue = std::numeric_limits<DistType>::max();
+	static constexpr uint64_t kGamma = 0x9e3779b97f4a7c15ull;
 
 public:
-	static void Create()
+	RandomStream(uint64_t key = 0, uint64_t counter = 0)
+		: m_Key(key)
+		, m_Counter(counter)
 	{
-		s_RandomGenerator.seed(std::random_device()());
 	}
 
-	static void Destroy() {}
+	inline uint64_t GetKey() const { return m_Key; }
+	inline uint64_t GetCounter() const { return m_Counter; }
+	inline void SetCounter(uint64_t counter) { m_Counter = counter; }
 
-	static bool Bool()
+	uint64_t Next()
 	{
-		return Float<float>() < 0.5f;
+		return At(m_Counter++);
+	}
+
+	bool Bool()
+	{
+		return (Next() >> 63) != 0;
 	}
 
 	template<
 		typename I,
 		std::enable_if_t<std::is_integral_v<I>, bool> = true
 	>
-	static I Int(I min, I max)
+	I Int(I min, I max)
 	{
-		static constexpr I kMaxValue = std::numeric_limits<I>::max();
-
-		I retVal;
-
 		if (min >= max)
 		{
-			retVal = min;
+			return min;
 		}
-		else
+
+		return static_cast<I>(min + Bounded(Next(), static_cast<uint64_t>(max) - static_cast<uint64_t>(min)));
+	}
+
+	template<
+		typename F,
+		std::enable_if_t<std::is_floating_point_v<F>, bool> = true
+	>
+	F Float(F min = 0, F max = 1)
+	{
+		if (min >= max)
 		{
-			retVal = min + (static_cast<I>(
-				GetFromDist() % kMaxValue) % ((max + 1) - min)
-			);
+			return min;
 		}
 
-		return retVal;
+		return min + ToUnit<F>(Next()) * (max - min);
 	}
 
+	// Standard normal by Box-Muller, takes two values of the stream
 	template<
 		typename F,
 		std::enable_if_t<std::is_floating_point_v<F>, bool> = true
 	>
-	static F Float(F min = 0, F max = 1)
+	F Normal()
 	{
-		F retVal;
+		F u1 = F(1) - ToUnit<F>(Next());
+		F u2 = ToUnit<F>(Next());
 
-		if (min >= max)
+		return std::sqrt(F(-2) * std::log(u1)) * std::cos(F(6.283185307179586) * u2);
+	}
+
+	// Bulk versions, each fills `count` values and advances the stream by
+	// `count`. The values are identical to calling the single versions.
+	template<
+		typename F,
+		std::enable_if_t<std::is_floating_point_v<F>, bool> = true
+	>
+	void Fill(F *out, size_t count, F min = 0, F max = 1)
+	{
+		F range = max > min ? max - min : F(0);
+
+		for (size_t i = 0; i < count; i++)
+		{
+			out[i] = min + ToUnit<F>(At(m_Counter + i)) * range;
+		}
+
+		m_Counter += count;
+	}
+
+	// Raw values, for callers which split each one into several draws
+	void FillBits(uint64_t *out, size_t count)
+	{
+		for (size_t i = 0; i < count; i++)
 		{
-			retVal = min;
+			out[i] = At(m_Counter + i);
+		}
+
+		m_Counter += count;
+	}
+
+	void FillBool(uint8_t *out, size_t count)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			out[i] = static_cast<uint8_t>(At(m_Counter + i) >> 63);
+		}
+
+		m_Counter += count;
+	}
+
+	template<
+		typename I,
+		std::enable_if_t<std::is_integral_v<I>, bool> = true
+	>
+	void FillInt(I *out, size_t count, I min, I max)
+	{
+		uint64_t range = max > min ? static_cast<uint64_t>(max) - static_cast<uint64_t>(min) : 0;
+
+		for (size_t i = 0; i < count; i++)
+		{
+			out[i] = static_cast<I>(min + Bounded(At(m_Counter + i), range));
+		}
+
+		m_Counter += count;
+	}
+
+public:
+	// Key of a stream derived from a seed, different ids give unrelated streams
+	static uint64_t MakeKey(uint64_t seed, uint64_t streamId)
+	{
+		return Mix(Mix(seed + kGamma) ^ (streamId * kGamma + 1));
+	}
+
+private:
+	inline uint64_t At(uint64_t counter) const
+	{
+		return Mix(m_Key + counter * kGamma);
+	}
+
+	// SplitMix64 finaliser
+	static inline uint64_t Mix(uint64_t z)
+	{
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+		return z ^ (z >> 31);
+	}
+
+	// Uniform in [0, 1) from the top bits, no division
+	template <typename F>
+	static inline F ToUnit(uint64_t bits)
+	{
+		if constexpr (sizeof(F) <= sizeof(float))
+		{
+			return static_cast<F>(bits >> 40) * static_cast<F>(1.0f / 16777216.0f);
 		}
 		else
 		{
-			retVal = min + ( static_cast<F>(GetFromDist())
-			               / static_cast<F>(kMaxDistTypeValue)) * (max - min);
+			return static_cast<F>(bits >> 11) * static_cast<F>(1.0 / 9007199254740992.0);
 		}
+	}
 
-		return retVal;
+	// Uniform in [0, range], a multiply and shift rather than a modulo
+	static inline uint64_t Bounded(uint64_t bits, uint64_t range)
+	{
+		if (range >= std::numeric_limits<uint32_t>::max())
+		{
+			return range == std::numeric_limits<uint64_t>::max() ? bits : bits % (range + 1);
+		}
+
+		return ((bits >> 32) * (range + 1)) >> 32;
 	}
 
 private:
-	static DistType GetFromDist() { return s_Distribution(s_RandomGenerator); }
+	uint64_t m_Key;
+	uint64_t m_Counter;
+};
+
+// Every stream is derived from one master seed. Work run on the job system
+// takes an explicit stream from MakeStream, keyed by what it is working on
+// (a car, a generation...), so what it draws never depends on the thread
+// which happened to run it. The static helpers draw from the main stream and
+// may only be called from the thread which seeded.
+class Random
+{
+public:
+	enum StreamId : uint64_t
+	{
+		kMainStream = 0,
+		kGenerationStream,
+		kPopulationStream,
+		kServerStream,
+	};
+
+public:
+	// A seed of zero picks one from std::random_device
+	static void Create(uint64_t seed = 0);
+	static void Destroy() {}
+
+	// Not while any work is running which makes streams
+	static void Seed(uint64_t seed);
+	static uint64_t GetSeed() { return s_Seed.load(std::memory_order_acquire); }
+
+	// e.g. MakeStream(kPopulationStream, carIndex) for a stream per car
+	static RandomStream MakeStream(uint64_t streamId, uint64_t subId = 0)
+	{
+		return RandomStream(RandomStream::MakeKey(RandomStream::MakeKey(GetSeed(), streamId), subId));
+	}
+
+	static RandomStream &GetMainStream();
+
+	static bool Bool()
+	{
+		return GetMainStream().Bool();
+	}
+
+	template<
+		typename I,
+		std::enable_if_t<std::is_integral_v<I>, bool> = true
+	>
+	static I Int(I min, I max)
+	{
+		return GetMainStream().Int(min, max);
+	}
+
+	template<
+		typename F,
+		std::enable_if_t<std::is_floating_point_v<F>, bool> = true
+	>
+	static F Float(F min = 0, F max = 1)
+	{
+		return GetMainStream().Float(min, max);
+	}
+
+	template<
+		typename F,
+		std::enable_if_t<std::is_floating_point_v<F>, bool> = true
+	>
+	static void Fill(F *out, size_t count, F min = 0, F max = 1)
+	{
+		GetMainStream().Fill(out, count, min, max);
+	}
 
 private:
-	static std::mt19937 s_RandomGenerator;
-	static std::uniform_int_distribution<DistType> s_Distribution;
-};
\ No newline at end of file
+	static std::atomic<uint64_t> s_Seed;
+	static RandomStream s_MainStream;
+};
@@ -3,15 +3,11 @@
 
 #include <glm/ext.hpp>
 
-// TODO: Get capabilities
-static constexpr size_t kMaxVertices = 8 * 1024;
+#include <cstring>
 
-struct Vertex
-{
-	glm::vec3 WorldPosition;
-	glm::vec2 LocalPosition;
-	glm::vec4 Colour;
-};
+// TODO: Get capabilities
+// Large enough that a big population only needs a handful of draws a batch
+static constexpr size_t kMaxVertices = 64 * 1024;
 
 struct BatchRendererData
 {
@@ -482,83 +478,89 @@ void Renderer::FlushScene()
 	FlushLineVertices();
 }
 
-void Renderer::SubmitFilledCircle(const glm::vec3 &position, float radius, const glm::vec4 &colour)
+const glm::mat4 &Renderer::GetViewProj()
 {
-	// Improve this optimization.
-	auto v = s_ViewProj * glm::vec4(position, 1.0f);
-	if (std::abs(v.x) > 1.5f || std::abs(v.y) > 1.5f)
-		return;
+	return s_ViewProj;
+}
 
-	// If there is insufficient room, flush the current batch.
-	if (kMaxVertices - s_CircleRendererData.VerticesCount < 6)
-	{
-		Renderer::FlushCircleVertices();
-		Renderer::MapCircleBuffer();
-	}
+// Copies whole primitives of `primitiveSize` vertices, flushing the batch
+// whenever it fills up
+static void CopyVertices(BatchRendererData &data, const std::vector<Vertex> &vertices, size_t primitiveSize,
+                         void (*flush)(), void (*map)())
+{
+	const Vertex *source = vertices.data();
+	size_t remaining = vertices.size();
 
-	glm::vec3 p1 = glm::vec3(-1.0, -1.0, position.z);
-	glm::vec3 p2 = glm::vec3(-1.0, 1.0, position.z);
-	glm::vec3 p3 = glm::vec3(1.0, 1.0, position.z);
-	glm::vec3 p4 = glm::vec3(1.0, -1.0, position.z);
+	while (remaining > 0)
+	{
+		size_t room = (kMaxVertices - data.VerticesCount) / primitiveSize * primitiveSize;
 
-	s_CircleRendererData.BatchDataPtr->WorldPosition = position + p1 * radius;
-	s_CircleRendererData.BatchDataPtr->LocalPosition = p1;
-	s_CircleRendererData.BatchDataPtr->Colour = colour;
+		if (room == 0)
+		{
+			flush();
+			map();
+			continue;
+		}
 
-	s_CircleRendererData.BatchDataPtr++;
+		size_t count = std::min(room, remaining);
 
-	s_CircleRendererData.BatchDataPtr->WorldPosition = position + p2 * radius;
-	s_CircleRendererData.BatchDataPtr->LocalPosition = p2;
-	s_CircleRendererData.BatchDataPtr->Colour = colour;
+		std::memcpy(data.BatchDataPtr, source, count * sizeof(Vertex));
+		data.BatchDataPtr += count;
+		data.VerticesCount += static_cast<GLsizei>(count);
 
-	s_CircleRendererData.BatchDataPtr++;
+		source += count;
+		remaining -= count;
+	}
+}
 
-	s_CircleRendererData.BatchDataPtr->WorldPosition = position + p3 * radius;
-	s_CircleRendererData.BatchDataPtr->LocalPosition = p3;
-	s_CircleRendererData.BatchDataPtr->Colour = colour;
+void Renderer::Submit(const DrawList &drawList)
+{
+	CopyVertices(s_CircleRendererData, drawList.m_Circles, 6, &Renderer::FlushCircleVertices, &Renderer::MapCircleBuffer);
+	CopyVertices(s_TriangleRendererData, drawList.m_Triangles, 3, &Renderer::FlushTriangleVertices, &Renderer::MapTriangleBuffer);
+	CopyVertices(s_LineRendererData, drawList.m_Lines, 2, &Renderer::FlushLineVertices, &Renderer::MapLineBuffer);
+}
 
-	s_CircleRendererData.BatchDataPtr++;
+void DrawList::Begin(const glm::mat4 &viewProj)
+{
+	m_ViewProj = viewProj;
 
-	s_CircleRendererData.BatchDataPtr->WorldPosition = position + p3 * radius;
-	s_CircleRendererData.BatchDataPtr->LocalPosition = p3;
-	s_CircleRendererData.BatchDataPtr->Colour = colour;
+	m_Circles.clear();
+	m_Triangles.clear();
+	m_Lines.clear();
+}
 
-	s_CircleRendererData.BatchDataPtr++;
+bool DrawList::IsVisible(const glm::vec3 &position) const
+{
+	// Improve this optimization.
+	glm::vec4 v = m_ViewProj * glm::vec4(position, 1.0f);
 
-	s_CircleRendererData.BatchDataPtr->WorldPosition = position + p4 * radius;
-	s_CircleRendererData.BatchDataPtr->LocalPosition = p4;
-	s_CircleRendererData.BatchDataPtr->Colour = colour;
+	return std::abs(v.x) <= 1.5f && std::abs(v.y) <= 1.5f;
+}
 
-	s_CircleRendererData.BatchDataPtr++;
+void DrawList::SubmitFilledCircle(const glm::vec3 &position, float radius, const glm::vec4 &colour)
+{
+	if (!IsVisible(position))
+		return;
 
-	s_CircleRendererData.BatchDataPtr->WorldPosition = position + p1 * radius;
-	s_CircleRendererData.BatchDataPtr->LocalPosition = p1;
-	s_CircleRendererData.BatchDataPtr->Colour = colour;
+	glm::vec3 p1 = glm::vec3(-1.0, -1.0, position.z);
+	glm::vec3 p2 = glm::vec3(-1.0, 1.0, position.z);
+	glm::vec3 p3 = glm::vec3(1.0, 1.0, position.z);
+	glm::vec3 p4 = glm::vec3(1.0, -1.0, position.z);
 
-	s_CircleRendererData.BatchDataPtr++;
+	m_Circles.push_back({ position + p1 * radius, p1, colour });
+	m_Circles.push_back({ position + p2 * radius, p2, colour });
+	m_Circles.push_back({ position + p3 * radius, p3, colour });
 
-	s_CircleRendererData.VerticesCount += 6;
+	m_Circles.push_back({ position + p3 * radius, p3, colour });
+	m_Circles.push_back({ position + p4 * radius, p4, colour });
+	m_Circles.push_back({ position + p1 * radius, p1, colour });
 }
 
-void Renderer::SubmitFilledPolygon(const std::vector<glm::vec3> &vertices, const glm::vec4 &colour)
+void DrawList::SubmitFilledPolygon(const glm::vec3 *vertices, size_t vertexCount, const glm::vec4 &colour)
 {
-	// Improve this optimization.
-	auto v = s_ViewProj * glm::vec4(vertices[0], 1.0f);
-	if (std::abs(v.x) > 1.5f || std::abs(v.y) > 1.5f)
+	if (vertexCount < 3 || !IsVisible(vertices[0]))
 		return;
 
-	size_t vertexCount = vertices.size();
-
-	// If there is insufficient room, flush the current batch.
-	if (kMaxVertices - s_TriangleRendererData.VerticesCount < (vertexCount - 2) * 3
-		|| kMaxVertices - s_LineRendererData.VerticesCount < vertexCount * 2)
-	{
-		Renderer::FlushTriangleVertices();
-		Renderer::FlushLineVertices();
-		Renderer::MapTriangleBuffer();
-		Renderer::MapLineBuffer();
-	}
-
 	glm::vec4 fillColour{
 		colour.r * 0.5f,
 		colour.g * 0.5f,
@@ -567,25 +569,9 @@ void Renderer::SubmitFilledPolygon(const std::vector<glm::vec3> &vertices, const
 
 	for (size_t i = 0; i < vertexCount - 2; i++)
 	{
-		s_TriangleRendererData.BatchDataPtr->WorldPosition = vertices[0];
-		// s_TriangleRendererData.BatchDataPtr->LocalPosition = glm::vec2();
-		s_TriangleRendererData.BatchDataPtr->Colour = fillColour;
-
-		s_TriangleRendererData.BatchDataPtr++;
-
-		s_TriangleRendererData.BatchDataPtr->WorldPosition = vertices[i + 1];
-		// s_TriangleRendererData.BatchDataPtr->LocalPosition = glm::vec2();
-		s_TriangleRendererData.BatchDataPtr->Colour = fillColour;
-
-		s_TriangleRendererData.BatchDataPtr++;
-
-		s_TriangleRendererData.BatchDataPtr->WorldPosition = vertices[i + 2];
-		// s_TriangleRendererData.BatchDataPtr->LocalPosition = glm::vec2();
-		s_TriangleRendererData.BatchDataPtr->Colour = fillColour;
-
-		s_TriangleRendererData.BatchDataPtr++;
-
-		s_TriangleRendererData.VerticesCount += 3;
+		m_Triangles.push_back({ vertices[0], glm::vec2(0.0f), fillColour });
+		m_Triangles.push_back({ vertices[i + 1], glm::vec2(0.0f), fillColour });
+		m_Triangles.push_back({ vertices[i + 2], glm::vec2(0.0f), fillColour });
 	}
 
 	glm::vec3 p1 = vertices[vertexCount - 1];
@@ -594,48 +580,18 @@ void Renderer::SubmitFilledPolygon(const std::vector<glm::vec3> &vertices, const
 	{
 		glm::vec3 p2 = vertices[i];
 
-		s_LineRendererData.BatchDataPtr->WorldPosition = p1 + glm::vec3(0.0f, 0.0f, 0.01f);
-		// s_TriangleRendererData.BatchDataPtr->LocalPosition = glm::vec2();
-		s_LineRendererData.BatchDataPtr->Colour = colour;
-
-		s_LineRendererData.BatchDataPtr++;
-
-		s_LineRendererData.BatchDataPtr->WorldPosition = p2 + glm::vec3(0.0f, 0.0f, 0.01f);
-		;
-		// s_TriangleRendererData.BatchDataPtr->LocalPosition = glm::vec2();
-		s_LineRendererData.BatchDataPtr->Colour = colour;
-
-		s_LineRendererData.BatchDataPtr++;
+		m_Lines.push_back({ p1 + glm::vec3(0.0f, 0.0f, 0.01f), glm::vec2(0.0f), colour });
+		m_Lines.push_back({ p2 + glm::vec3(0.0f, 0.0f, 0.01f), glm::vec2(0.0f), colour });
 
 		p1 = p2;
-
-		s_LineRendererData.VerticesCount += 2;
 	}
 }
 
-void Renderer::SubmitLine(const glm::vec3 &p1, const glm::vec3 &p2, const glm::vec4 &colour)
+void DrawList::SubmitLine(const glm::vec3 &p1, const glm::vec3 &p2, const glm::vec4 &colour)
 {
-	// Improve this optimization.
-	auto v = s_ViewProj * glm::vec4(p1, 1.0f);
-	if (std::abs(v.x) > 1.5f || std::abs(v.y) > 1.5f)
+	if (!IsVisible(p1))
 		return;
 
-	// If there is insufficient room, flush the current batch.
-	if (kMaxVertices - s_LineRendererData.VerticesCount < 2)
-	{
-		Renderer::FlushLineVertices();
-		Renderer::MapLineBuffer();
-	}
-
-	s_LineRendererData.BatchDataPtr->WorldPosition = p1;
-	// s_TriangleRendererData.BatchDataPtr->LocalPosition = glm::vec2();
-	s_LineRendererData.BatchDataPtr->Colour = colour;
-
-	s_LineRendererData.BatchDataPtr++;
-
-	s_LineRendererData.BatchDataPtr->WorldPosition = p2;
-	// s_TriangleRendererData.BatchDataPtr->LocalPosition = glm::vec2();
-	s_LineRendererData.BatchDataPtr->Colour = colour;
-
-	s_LineRendererData.BatchDataPtr++;
-}
\ No newline at end of file
+	m_Lines.push_back({ p1, glm::vec2(0.0f), colour });
+	m_Lines.push_back({ p2, glm::vec2(0.0f), colour });
+}
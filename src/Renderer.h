@@ -3,6 +3,43 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+struct Vertex
+{
+	glm::vec3 WorldPosition;
+	glm::vec2 LocalPosition;
+	glm::vec4 Colour;
+};
+
+// Vertices of a part of the scene built on the CPU. Any thread can fill a list
+// of its own, the renderer then copies whole lists into its buffers, so the
+// trig of drawing many cars can be spread over the job system.
+class DrawList
+{
+public:
+	// Empties the list, keeping its memory, shapes far outside viewProj are
+	// left out
+	void Begin(const glm::mat4 &viewProj);
+
+	void SubmitFilledCircle(const glm::vec3 &position, float radius, const glm::vec4 &colour);
+	void SubmitFilledPolygon(const glm::vec3 *vertices, size_t vertexCount, const glm::vec4 &colour);
+	void SubmitLine(const glm::vec3 &p1, const glm::vec3 &p2, const glm::vec4 &colour);
+
+	inline size_t GetVertexCount() const { return m_Circles.size() + m_Triangles.size() + m_Lines.size(); }
+
+	// Whether a shape around this point could be on screen
+	bool IsVisible(const glm::vec3 &position) const;
+
+private:
+	friend class Renderer;
+
+private:
+	glm::mat4 m_ViewProj = glm::mat4(1.0f);
+
+	std::vector<Vertex> m_Circles;
+	std::vector<Vertex> m_Triangles;
+	std::vector<Vertex> m_Lines;
+};
+
 class Renderer
 {
 private:
@@ -36,8 +73,9 @@ public:
 	static void BeginScene(const glm::mat4 &viewProj);
 	static void EndScene();
 
-	static void SubmitFilledCircle(const glm::vec3 &position, float radius, const glm::vec4 &colour);
-	static void SubmitFilledPolygon(const std::vector<glm::vec3> &vertices, const glm::vec4 &colour);
+	static const glm::mat4 &GetViewProj();
 
-	static void SubmitLine(const glm::vec3 &p1, const glm::vec3 &p2, const glm::vec4 &colour);
+	// Copies every vertex of the list into the batches, in the order lists
+	// are submitted
+	static void Submit(const DrawList &drawList);
 };
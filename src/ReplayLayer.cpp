@@ -0,0 +1,280 @@
+#include "ReplayLayer.h"
+#include "Application.h"
+#include "Log.h"
+
+#include <GLFW/glfw3.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtx/transform.hpp>
+
+#include <imgui.h>
+
+static constexpr float kMaxSpeed = 16.0f;
+
+bool ReplayLayer::OnMouseMoved(MouseMovedEvent &e)
+{
+	static double xpos = 0.0;
+	static double ypos = 0.0;
+
+	if (m_MousePressed && !m_FollowCam)
+	{
+		m_CamPosition -= glm::vec3{e.Xpos - xpos, ypos - e.Ypos, 0.0f} * (0.05f / m_CamScale);
+	}
+
+	xpos = e.Xpos;
+	ypos = e.Ypos;
+
+	return false;
+}
+
+bool ReplayLayer::OnMousePressed(MousePressedEvent &e)
+{
+	if (e.Button == GLFW_MOUSE_BUTTON_1)
+	{
+		m_MousePressed = true;
+	}
+
+	return false;
+}
+
+bool ReplayLayer::OnMouseReleased(MouseReleasedEvent &e)
+{
+	if (e.Button == GLFW_MOUSE_BUTTON_1)
+	{
+		m_MousePressed = false;
+	}
+
+	return false;
+}
+
+bool ReplayLayer::OnMouseScrolled(MouseScrolledEvent &e)
+{
+	m_CamScale += 0.3f * m_CamScale * static_cast<float>(e.Yoffset);
+
+	if (m_CamScale < 0.01f)
+	{
+		m_CamScale = 0.01f;
+	}
+	else if (m_CamScale > 2.0f)
+	{
+		m_CamScale = 2.0f;
+	}
+
+	return false;
+}
+
+bool ReplayLayer::OnKeyPressed(KeyPressedEvent &e)
+{
+	switch (e.Key)
+	{
+	case GLFW_KEY_ESCAPE:
+		BL_LOG("Closing application.");
+		Application::Get().Close();
+		break;
+	case GLFW_KEY_F:
+		m_FollowCam = !m_FollowCam;
+		BL_LOG("Follow car %s", m_FollowCam ? "enabled" : "disabled");
+		break;
+	case GLFW_KEY_E:
+		m_Speed = std::min(m_Speed + 1.0f, kMaxSpeed);
+		break;
+	case GLFW_KEY_Q:
+		m_Speed = std::max(m_Speed - 1.0f, -kMaxSpeed);
+		break;
+	case GLFW_KEY_LEFT:
+		m_Step = std::max(m_Step - 60.0f, 0.0f);
+		break;
+	case GLFW_KEY_RIGHT:
+		m_Step += 60.0f;
+		break;
+	case GLFW_KEY_SPACE:
+		m_Paused = !m_Paused;
+		BL_LOG("Pause %s", m_Paused ? "enabled" : "disabled");
+		break;
+	}
+
+	return false;
+}
+
+ReplayLayer::ReplayLayer(const std::string &path)
+	: Layer("Replay Layer")
+	, m_Path(path)
+	, m_LeaderIndex(0)
+	, m_Step(0.0f), m_Speed(1.0f)
+	, m_PosesStep(std::numeric_limits<uint32_t>::max())
+	, m_CamPosition(0, 0, 0), m_CamScale(0.5f)
+	, m_MousePressed(false), m_FollowCam(true), m_Paused(false)
+{
+	if (!m_Reader.Open(path))
+	{
+		return;
+	}
+
+	const Trajectory::FileHeader &header = m_Reader.GetHeader();
+
+	BL_LOG("Replaying generation %u, %zu cars over %u steps", header.GenerationIndex, m_Reader.GetNumCars(), m_Reader.GetNumSteps());
+
+	m_Platform.Create(static_cast<int>(header.PlatformCount), header.TerrainSeed);
+
+	m_ChassisShapes.resize(m_Reader.GetNumCars());
+	m_Poses.resize(m_Reader.GetNumCars());
+	m_HasPose.resize(m_Reader.GetNumCars());
+	for (size_t i = 0; i < m_Reader.GetNumCars(); i++)
+	{
+		m_ChassisShapes[i] = Car::MakeChassisShape(m_Reader.GetProto(i));
+	}
+
+	UpdatePoses();
+}
+
+void ReplayLayer::UpdatePoses()
+{
+	uint32_t step = static_cast<uint32_t>(m_Step);
+
+	if (step == m_PosesStep)
+	{
+		return;
+	}
+
+	m_PosesStep = step;
+
+	float leaderX = -std::numeric_limits<float>::max();
+
+	for (size_t i = 0; i < m_Poses.size(); i++)
+	{
+		CarPose &pose = m_Poses[i];
+
+		// Cached cars which were not simulated have no track, and a car is
+		// not shown where its track is corrupt
+		m_HasPose[i] = m_Reader.GetPose(i, step, pose);
+
+		if (!m_HasPose[i])
+		{
+			pose.Health = 0;
+			continue;
+		}
+
+		if (pose.Health > 0 && pose.Position.x > leaderX)
+		{
+			leaderX = pose.Position.x;
+			m_LeaderIndex = i;
+		}
+	}
+}
+
+void ReplayLayer::OnUpdate()
+{
+	if (!m_Reader.IsOpen())
+	{
+		return;
+	}
+
+	if (!m_Paused)
+	{
+		float lastStep = static_cast<float>(std::max(m_Reader.GetNumSteps(), 1u) - 1);
+
+		m_Step = std::clamp(m_Step + m_Speed, 0.0f, lastStep);
+	}
+
+	UpdatePoses();
+
+	if (m_FollowCam && m_LeaderIndex < m_Poses.size())
+	{
+		const b2Vec2 &position = m_Poses[m_LeaderIndex].Position;
+		m_CamPosition = {position.x, position.y, 0.0f};
+	}
+}
+
+void ReplayLayer::OnDraw()
+{
+	const Window& window = Application::Get().GetWindow();
+	float width = static_cast<float>(window.GetWidth());
+	float height = static_cast<float>(window.GetHeight());
+	float aspect = width / height;
+
+	auto viewProj = glm::ortho(-10.0f * aspect, 10.0f * aspect, -10.0f, 10.0f)
+		* glm::scale(glm::mat4(1.0f), glm::vec3(m_CamScale))
+		* glm::translate(glm::mat4(1.0f), -m_CamPosition);
+
+	Renderer::BeginScene(viewProj);
+
+	m_DrawList.Begin(viewProj);
+	m_Platform.Draw(m_DrawList);
+	for (size_t i = 0; i < m_Poses.size(); i++)
+	{
+		if (m_HasPose[i])
+		{
+			Car::DrawPose(m_DrawList, m_Reader.GetProto(i), m_ChassisShapes[i], m_Poses[i]);
+		}
+	}
+
+	Renderer::Submit(m_DrawList);
+	Renderer::EndScene();
+}
+
+void ReplayLayer::OnDrawImGui()
+{
+	ImGui::Begin("Replay");
+
+	if (!m_Reader.IsOpen())
+	{
+		ImGui::Text("Could not open '%s'", m_Path.c_str());
+		ImGui::End();
+		return;
+	}
+
+	const Trajectory::FileHeader &header = m_Reader.GetHeader();
+
+	ImGui::Text("File: %s", m_Path.c_str());
+	ImGui::Text("Generation: %u", header.GenerationIndex);
+	ImGui::Text("Cars: %zu", m_Reader.GetNumCars());
+	ImGui::Text("Time: %0.2fs / %0.2fs", m_Step * header.DeltaTime, m_Reader.GetNumSteps() * header.DeltaTime);
+
+	// Corrupt chunks are only found once they are decoded
+	size_t numCorrupt = m_Reader.GetNumCorruptTracks();
+	if (numCorrupt > 0 || m_Reader.IsTruncated())
+	{
+		ImGui::Text("The file is corrupt: %zu tracks%s", numCorrupt, m_Reader.IsTruncated() ? ", cut short" : "");
+	}
+
+	int step = static_cast<int>(m_Step);
+	if (ImGui::SliderInt("Step", &step, 0, static_cast<int>(std::max(m_Reader.GetNumSteps(), 1u)) - 1))
+	{
+		m_Step = static_cast<float>(step);
+	}
+
+	ImGui::SliderFloat("Speed", &m_Speed, -kMaxSpeed, kMaxSpeed);
+
+	if (ImGui::Button(m_Paused ? "Play" : "Pause"))
+	{
+		m_Paused = !m_Paused;
+	}
+
+	ImGui::SameLine();
+	ImGui::Checkbox("Follow Leader", &m_FollowCam);
+
+	if (m_LeaderIndex < m_Poses.size() && ImGui::CollapsingHeader("Leader"))
+	{
+		ImGui::Indent();
+
+		const CarPose &pose = m_Poses[m_LeaderIndex];
+
+		ImGui::Text("Car Id: %u", m_Reader.GetCarId(m_LeaderIndex));
+		ImGui::Text("Health: %d", pose.Health);
+		ImGui::Text("Position: (%0.3f, %0.3f)", pose.Position.x, pose.Position.y);
+
+		ImGui::Unindent();
+	}
+
+	ImGui::End();
+}
+
+void ReplayLayer::OnEvent(Event &e)
+{
+	EventDispatcher dispatcher(e);
+	dispatcher.dispatch<MouseMovedEvent>(std::bind(&ReplayLayer::OnMouseMoved, this, std::placeholders::_1));
+	dispatcher.dispatch<MouseScrolledEvent>(std::bind(&ReplayLayer::OnMouseScrolled, this, std::placeholders::_1));
+	dispatcher.dispatch<MousePressedEvent>(std::bind(&ReplayLayer::OnMousePressed, this, std::placeholders::_1));
+	dispatcher.dispatch<MouseReleasedEvent>(std::bind(&ReplayLayer::OnMouseReleased, this, std::placeholders::_1));
+	dispatcher.dispatch<KeyPressedEvent>(std::bind(&ReplayLayer::OnKeyPressed, this, std::placeholders::_1));
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "Layer.h"
+#include "Renderer.h"
+#include "Platform.h"
+#include "Trajectory.h"
+
+#include <glm/glm.hpp>
+
+// Plays back a recorded generation, see Trajectory. Nothing is simulated,
+// cars are drawn straight from their recorded poses.
+class ReplayLayer : public Layer
+{
+public:
+	ReplayLayer(const std::string &path);
+
+	virtual void OnUpdate() override;
+	virtual void OnDraw() override;
+	virtual void OnDrawImGui() override;
+	virtual void OnEvent(Event &e) override;
+
+private:
+	bool OnMouseMoved(MouseMovedEvent &e);
+	bool OnMousePressed(MousePressedEvent &e);
+	bool OnMouseReleased(MouseReleasedEvent &e);
+	bool OnMouseScrolled(MouseScrolledEvent &e);
+	bool OnKeyPressed(KeyPressedEvent &e);
+
+	// Decodes every car's pose at the current step
+	void UpdatePoses();
+
+private:
+	std::string m_Path;
+	Trajectory::Reader m_Reader;
+	Platform m_Platform;
+
+	std::vector<b2PolygonShape> m_ChassisShapes;
+	std::vector<CarPose> m_Poses;
+	std::vector<uint8_t> m_HasPose;
+	size_t m_LeaderIndex;
+
+	DrawList m_DrawList;
+
+	// Fractional so slow playback works, negative plays backwards
+	float m_Step;
+	float m_Speed;
+	uint32_t m_PosesStep;
+
+	glm::vec3 m_CamPosition;
+	float m_CamScale;
+	bool m_MousePressed, m_FollowCam, m_Paused;
+};
@@ -0,0 +1,244 @@
+#include "RunLog.h"
+#include "Log.h"
+
+#include <cstring>
+#include <filesystem>
+
+RunLog::Writer::Writer()
+	: m_File(nullptr)
+{
+}
+
+RunLog::Writer::~Writer()
+{
+	Close();
+}
+
+bool RunLog::Writer::Open(const std::string &path, uint64_t masterSeed, uint32_t terrainSeed, uint64_t physicsProfile)
+{
+	Close();
+
+	m_File = std::fopen(path.c_str(), "wb");
+	if (!m_File)
+	{
+		BL_LOG("Failed to open run log '%s' for writing", path.c_str());
+		return false;
+	}
+
+	Header header = {};
+	std::memcpy(header.Magic, kMagic, sizeof(kMagic));
+	header.Version = kVersion;
+	header.MasterSeed = masterSeed;
+	header.PhysicsProfile = physicsProfile;
+	header.TerrainSeed = terrainSeed;
+	header.ProtoSize = sizeof(CarProto);
+	header.ControllerSize = sizeof(ControllerProto);
+
+	std::fwrite(&header, sizeof(header), 1, m_File);
+	std::fflush(m_File);
+
+	return true;
+}
+
+bool RunLog::Writer::Resume(const std::string &path, uint64_t masterSeed, uint32_t terrainSeed, uint64_t physicsProfile,
+                            uint32_t generationIndex)
+{
+	Close();
+
+	std::error_code error;
+	if (!std::filesystem::exists(path, error))
+	{
+		return Open(path, masterSeed, terrainSeed, physicsProfile);
+	}
+
+	long end = -1;
+
+	{
+		Reader reader;
+		if (reader.Open(path))
+		{
+			const Header &header = reader.GetHeader();
+
+			if (   header.MasterSeed == masterSeed
+			    && header.TerrainSeed == terrainSeed
+			    && header.PhysicsProfile == physicsProfile)
+			{
+				end = reader.GetOffset(generationIndex);
+			}
+		}
+	}
+
+	if (end < 0)
+	{
+		BL_LOG("'%s' is not a log of this run up to generation %u, not logging", path.c_str(), generationIndex);
+		return false;
+	}
+
+	// The generations from here on are about to be simulated again
+	std::filesystem::resize_file(path, static_cast<uintmax_t>(end), error);
+	if (!error)
+	{
+		m_File = std::fopen(path.c_str(), "ab");
+	}
+
+	if (!m_File)
+	{
+		BL_LOG("Failed to open run log '%s' for appending", path.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+void RunLog::Writer::Close()
+{
+	if (m_File)
+	{
+		std::fclose(m_File);
+		m_File = nullptr;
+	}
+}
+
+void RunLog::Writer::Append(const GenerationRecord &record, const CarProto *carProtos, const ControllerProto *controllers,
+                            const float *targetFitness)
+{
+	if (!m_File)
+	{
+		return;
+	}
+
+	std::fwrite(&record, sizeof(record), 1, m_File);
+	std::fwrite(carProtos, sizeof(CarProto), record.NumCars, m_File);
+	std::fwrite(controllers, sizeof(ControllerProto), record.NumControllers, m_File);
+	std::fwrite(targetFitness, sizeof(float), record.TerrainCount, m_File);
+
+	// Each generation is complete on disk as soon as it starts
+	std::fflush(m_File);
+}
+
+RunLog::Reader::Reader()
+	: m_File(nullptr)
+	, m_Header()
+	, m_FirstGeneration(0)
+	, m_End(0)
+{
+}
+
+RunLog::Reader::~Reader()
+{
+	Close();
+}
+
+bool RunLog::Reader::Open(const std::string &path)
+{
+	Close();
+
+	m_File = std::fopen(path.c_str(), "rb");
+	if (!m_File)
+	{
+		BL_LOG("Failed to open run log '%s'", path.c_str());
+		return false;
+	}
+
+	if (   std::fread(&m_Header, sizeof(m_Header), 1, m_File) != 1
+	    || std::memcmp(m_Header.Magic, kMagic, sizeof(kMagic)) != 0
+	    || m_Header.Version != kVersion
+	    || m_Header.ProtoSize != sizeof(CarProto)
+	    || m_Header.ControllerSize != sizeof(ControllerProto))
+	{
+		BL_LOG("'%s' is not a run log from this build", path.c_str());
+		Close();
+		return false;
+	}
+
+	// Only the record headers are read, the genomes are skipped over
+	GenerationRecord record;
+	long offset = std::ftell(m_File);
+
+	while (std::fread(&record, sizeof(record), 1, m_File) == 1)
+	{
+		long next = offset + static_cast<long>(sizeof(record) + record.NumCars * sizeof(CarProto)
+		                                       + record.NumControllers * sizeof(ControllerProto)
+		                                       + record.TerrainCount * sizeof(float));
+
+		if (std::fseek(m_File, next, SEEK_SET) != 0)
+		{
+			break;
+		}
+
+		if (m_Offsets.empty())
+		{
+			m_FirstGeneration = record.GenerationIndex;
+		}
+
+		m_Offsets.push_back(offset);
+		offset = next;
+	}
+
+	// A record cut short by the process being killed is simply dropped
+	std::fseek(m_File, 0, SEEK_END);
+	if (!m_Offsets.empty() && std::ftell(m_File) < offset)
+	{
+		offset = m_Offsets.back();
+		m_Offsets.pop_back();
+	}
+
+	m_End = std::min(offset, std::ftell(m_File));
+
+	return true;
+}
+
+void RunLog::Reader::Close()
+{
+	if (m_File)
+	{
+		std::fclose(m_File);
+		m_File = nullptr;
+	}
+
+	m_Offsets.clear();
+	m_FirstGeneration = 0;
+	m_End = 0;
+}
+
+long RunLog::Reader::GetOffset(uint32_t generationIndex) const
+{
+	if (m_Offsets.empty())
+	{
+		return m_File ? m_End : -1;
+	}
+
+	if (generationIndex < m_FirstGeneration || generationIndex - m_FirstGeneration > m_Offsets.size())
+	{
+		return -1;
+	}
+
+	size_t index = generationIndex - m_FirstGeneration;
+
+	return index < m_Offsets.size() ? m_Offsets[index] : m_End;
+}
+
+bool RunLog::Reader::ReadGeneration(uint32_t generationIndex, GenerationRecord &record, std::vector<CarProto> &carProtos,
+                                    std::vector<ControllerProto> &controllers, std::vector<float> &targetFitness)
+{
+	if (!m_File || generationIndex < m_FirstGeneration || generationIndex - m_FirstGeneration >= m_Offsets.size())
+	{
+		return false;
+	}
+
+	std::fseek(m_File, m_Offsets[generationIndex - m_FirstGeneration], SEEK_SET);
+
+	if (   std::fread(&record, sizeof(record), 1, m_File) != 1
+	    || (record.NumControllers != 0 && record.NumControllers != record.NumCars))
+	{
+		return false;
+	}
+
+	carProtos.resize(record.NumCars);
+	controllers.resize(record.NumControllers);
+	targetFitness.resize(record.TerrainCount);
+
+	return    std::fread(carProtos.data(), sizeof(CarProto), record.NumCars, m_File) == record.NumCars
+	       && std::fread(controllers.data(), sizeof(ControllerProto), record.NumControllers, m_File) == record.NumControllers
+	       && std::fread(targetFitness.data(), sizeof(float), record.TerrainCount, m_File) == record.TerrainCount;
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "Car.h"
+
+#include <cstdio>
+
+// A compact binary log of a run, enough to re-simulate any one generation
+// without replaying the generations before it. The master seed and terrain
+// are written once, and then every generation appends the state of its
+// random stream, the genomes it was started with and the target fitness of
+// the lagging kill rule.
+//
+// A rerun scores every car as the run did, which `--bench replay` checks,
+// when it is the same build with the same physics settings. For that a
+// logged or rerun generation runs without the fitness cache, which is not
+// logged and would leave worlds with fewer bodies, changing the order Box2D
+// solves contacts in. It also breeds only once every car is done and is
+// never cut off by the wall clock. Logging stops when the surrogate, novelty
+// search or CMA-ES is turned on, as their state is not logged either, see
+// Generation::FindUnloggedSetting.
+
+namespace RunLog
+{
+	static constexpr char kMagic[4] = { 'B', 'L', 'R', 'L' };
+	static constexpr uint32_t kVersion = 6;
+
+	struct Header
+	{
+		char Magic[4];
+		uint32_t Version;
+		uint64_t MasterSeed;
+		uint64_t PhysicsProfile;
+		uint32_t TerrainSeed;
+		uint32_t ProtoSize;
+		uint32_t ControllerSize;
+		uint32_t Padding;
+	};
+
+	// Followed by NumCars CarProtos, NumControllers ControllerProtos, either
+	// one for each car or none, then TerrainCount floats with the target
+	// fitness of the lagging kill rule on each terrain. How fitness was
+	// evaluated can change during a run, so it is kept with each generation.
+	struct GenerationRecord
+	{
+		uint32_t GenerationIndex;
+		uint32_t NumCars;
+		uint64_t RandomCounter;
+		uint32_t FirstCarId;
+		uint32_t TerrainCount;
+		uint32_t Aggregation;
+		float Quantile;
+		uint32_t NumControllers;
+		uint32_t Padding;
+	};
+
+	class Writer
+	{
+	public:
+		Writer();
+		~Writer();
+
+		bool Open(const std::string &path, uint64_t masterSeed, uint32_t terrainSeed, uint64_t physicsProfile);
+		// Carries on the log of a resumed run from generationIndex, dropping
+		// any generations it already holds from there on. A log which does
+		// not exist yet is started part way through the run, one of another
+		// run is left alone and nothing is logged.
+		bool Resume(const std::string &path, uint64_t masterSeed, uint32_t terrainSeed, uint64_t physicsProfile,
+		            uint32_t generationIndex);
+		void Close();
+
+		void Append(const GenerationRecord &record, const CarProto *carProtos, const ControllerProto *controllers,
+		            const float *targetFitness);
+
+		inline bool IsOpen() const { return m_File != nullptr; }
+
+	private:
+		FILE *m_File;
+	};
+
+	class Reader
+	{
+	public:
+		Reader();
+		~Reader();
+
+		// Reads the header and builds an index of where each generation starts
+		bool Open(const std::string &path);
+		void Close();
+
+		bool ReadGeneration(uint32_t generationIndex, GenerationRecord &record, std::vector<CarProto> &carProtos,
+		                    std::vector<ControllerProto> &controllers, std::vector<float> &targetFitness);
+
+		inline const Header &GetHeader() const { return m_Header; }
+		// A log written while replaying starts part way through a run
+		inline uint32_t GetFirstGeneration() const { return m_FirstGeneration; }
+		inline size_t GetGenerationCount() const { return m_Offsets.size(); }
+
+		// Where a generation starts, or where the next one would be appended
+		// for the one after the last, -1 for any other
+		long GetOffset(uint32_t generationIndex) const;
+
+	private:
+		FILE *m_File;
+		Header m_Header;
+		uint32_t m_FirstGeneration;
+		std::vector<long> m_Offsets;
+		long m_End;
+	};
+}
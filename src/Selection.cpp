@@ -0,0 +1,156 @@
+#include "Selection.h"
+#include "Log.h"
+
+std::vector<size_t> Selection::RankByFitness(const std::vector<float> &fitness)
+{
+	std::vector<size_t> ranked(fitness.size());
+	std::iota(ranked.begin(), ranked.end(), 0_zu);
+
+	// Fittest first, ties keep their original order so the ranking is stable
+	std::stable_sort(ranked.begin(), ranked.end(), [&fitness](size_t a, size_t b)
+	{
+		return fitness[a] > fitness[b];
+	});
+
+	return ranked;
+}
+
+static size_t SearchCumulative(const std::vector<double> &cumulative, RandomStream &random)
+{
+	BL_ASSERT(!cumulative.empty(), "There is nothing to select from !");
+
+	double ratio = random.Float(0.0, cumulative.back());
+
+	auto segment = std::upper_bound(cumulative.cbegin(), cumulative.cend(), ratio);
+	return std::min(static_cast<size_t>(segment - cumulative.cbegin()), cumulative.size() - 1);
+}
+
+std::unique_ptr<Selection> Selection::Create(const SelectionSettings &settings)
+{
+	switch (settings.Type)
+	{
+	case SelectionType::Tournament:
+		return std::make_unique<TournamentSelection>(settings.TournamentSize);
+	case SelectionType::Rank:
+		return std::make_unique<RankSelection>();
+	case SelectionType::Truncation:
+		return std::make_unique<TruncationSelection>(settings.TruncationRatio);
+	case SelectionType::Roulette:
+	default:
+		return std::make_unique<RouletteSelection>();
+	}
+}
+
+const char *Selection::GetTypeName(SelectionType type)
+{
+	switch (type)
+	{
+	case SelectionType::Roulette:   return "Roulette";
+	case SelectionType::Tournament: return "Tournament";
+	case SelectionType::Rank:       return "Rank";
+	case SelectionType::Truncation: return "Truncation";
+	default:                        return "Unknown";
+	}
+}
+
+RouletteSelection::RouletteSelection()
+	: Selection("Roulette")
+{
+}
+
+void RouletteSelection::Prepare(const std::vector<float> &fitness)
+{
+	m_CumulativeFitness.resize(fitness.size());
+
+	double cumlFitness = 0.0;
+	for (size_t i = 0; i < fitness.size(); i++)
+	{
+		cumlFitness += std::max(static_cast<double>(fitness[i]), 0.0);
+		m_CumulativeFitness[i] = cumlFitness;
+	}
+
+	// Every car scored nothing, give them all an equal share instead
+	if (cumlFitness <= 0.0)
+	{
+		std::iota(m_CumulativeFitness.begin(), m_CumulativeFitness.end(), 1.0);
+	}
+}
+
+size_t RouletteSelection::Select(RandomStream &random) const
+{
+	return SearchCumulative(m_CumulativeFitness, random);
+}
+
+TournamentSelection::TournamentSelection(int tournamentSize)
+	: Selection("Tournament")
+	, m_TournamentSize(std::max(tournamentSize, 1))
+{
+}
+
+void TournamentSelection::Prepare(const std::vector<float> &fitness)
+{
+	m_Fitness = fitness;
+}
+
+size_t TournamentSelection::Select(RandomStream &random) const
+{
+	BL_ASSERT(!m_Fitness.empty(), "There is nothing to select from !");
+
+	size_t best = random.Int(0_zu, m_Fitness.size() - 1);
+
+	for (int i = 1; i < m_TournamentSize; i++)
+	{
+		size_t contender = random.Int(0_zu, m_Fitness.size() - 1);
+
+		if (m_Fitness[contender] > m_Fitness[best])
+		{
+			best = contender;
+		}
+	}
+
+	return best;
+}
+
+RankSelection::RankSelection()
+	: Selection("Rank")
+{
+}
+
+void RankSelection::Prepare(const std::vector<float> &fitness)
+{
+	m_Ranked = RankByFitness(fitness);
+	m_CumulativeWeight.resize(m_Ranked.size());
+
+	double cumlWeight = 0.0;
+	for (size_t i = 0; i < m_Ranked.size(); i++)
+	{
+		cumlWeight += static_cast<double>(m_Ranked.size() - i);
+		m_CumulativeWeight[i] = cumlWeight;
+	}
+}
+
+size_t RankSelection::Select(RandomStream &random) const
+{
+	return m_Ranked[SearchCumulative(m_CumulativeWeight, random)];
+}
+
+TruncationSelection::TruncationSelection(float ratio)
+	: Selection("Truncation")
+	, m_Ratio(std::clamp(ratio, 0.0f, 1.0f))
+	, m_NumSelectable(0)
+{
+}
+
+void TruncationSelection::Prepare(const std::vector<float> &fitness)
+{
+	m_Ranked = RankByFitness(fitness);
+	m_NumSelectable = std::max(static_cast<size_t>(m_Ratio * static_cast<float>(m_Ranked.size())), 1_zu);
+	m_NumSelectable = std::min(m_NumSelectable, m_Ranked.size());
+}
+
+size_t TruncationSelection::Select(RandomStream &random) const
+{
+	BL_ASSERT(m_NumSelectable > 0, "There is nothing to select from !");
+
+	return m_Ranked[random.Int(0_zu, m_NumSelectable - 1)];
+}
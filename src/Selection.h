@@ -0,0 +1,105 @@
+#pragma once
+
+#include "Random.h"
+
+enum class SelectionType
+{
+	Roulette = 0,
+	Tournament,
+	Rank,
+	Truncation,
+	Count
+};
+
+struct SelectionSettings
+{
+	SelectionType Type = SelectionType::Roulette;
+	int TournamentSize = 3;
+	float TruncationRatio = 0.5f;
+};
+
+class Selection
+{
+public:
+	virtual ~Selection() {}
+
+	// Called once per generation with the fitness of every car, before any
+	// parents are selected.
+	virtual void Prepare(const std::vector<float> &fitness) = 0;
+
+	// Returns the index of a single parent.
+	virtual size_t Select(RandomStream &random) const = 0;
+
+	const std::string &GetName() const { return m_Name; }
+
+public:
+	static std::unique_ptr<Selection> Create(const SelectionSettings &settings);
+
+	static const char *GetTypeName(SelectionType type);
+
+	// Indices of the cars ordered from the fittest to the least fit
+	static std::vector<size_t> RankByFitness(const std::vector<float> &fitness);
+
+protected:
+	Selection(const std::string &name) : m_Name(name) {}
+
+protected:
+	std::string m_Name;
+};
+
+// Fitness proportional selection, a binary search over the running total of
+// the fitness. Falls back to uniform selection when every car scored zero.
+class RouletteSelection : public Selection
+{
+public:
+	RouletteSelection();
+
+	virtual void Prepare(const std::vector<float> &fitness) override;
+	virtual size_t Select(RandomStream &random) const override;
+
+private:
+	std::vector<double> m_CumulativeFitness;
+};
+
+// The fittest of k cars picked uniformly at random.
+class TournamentSelection : public Selection
+{
+public:
+	TournamentSelection(int tournamentSize);
+
+	virtual void Prepare(const std::vector<float> &fitness) override;
+	virtual size_t Select(RandomStream &random) const override;
+
+private:
+	int m_TournamentSize;
+	std::vector<float> m_Fitness;
+};
+
+// Linear ranking, the worst car has weight 1 and the best has weight n.
+class RankSelection : public Selection
+{
+public:
+	RankSelection();
+
+	virtual void Prepare(const std::vector<float> &fitness) override;
+	virtual size_t Select(RandomStream &random) const override;
+
+private:
+	std::vector<size_t> m_Ranked;
+	std::vector<double> m_CumulativeWeight;
+};
+
+// Uniform selection among the best fraction of the cars.
+class TruncationSelection : public Selection
+{
+public:
+	TruncationSelection(float ratio);
+
+	virtual void Prepare(const std::vector<float> &fitness) override;
+	virtual size_t Select(RandomStream &random) const override;
+
+private:
+	float m_Ratio;
+	std::vector<size_t> m_Ranked;
+	size_t m_NumSelectable;
+};
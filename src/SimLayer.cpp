@@ -1,5 +1,6 @@
 #include "SimLayer.h"
 #include "Application.h"
+#include "Random.h"
 #include "Log.h"
 
 #include <GLFW/glfw3.h>
@@ -98,13 +99,14 @@ bool SimLayer::OnKeyPressed(KeyPressedEvent &e)
 	return false;
 }
 
-SimLayer::SimLayer()
+SimLayer::SimLayer(const GenerationSettings &settings)
 	: Layer("Simulation Layer")
 	, m_TimeMultiplier(1)
+	, m_ReplayGeneration(0)
 	, m_CamPosition(0, 0, 0), m_CamScale(0.5f)
 	, m_MousePressed(false), m_FollowCam(false), m_Paused(false)
 {
-	m_Generation.Create(50);
+	m_Generation.Create(settings);
 }
 
 void SimLayer::OnUpdate()
@@ -136,7 +138,9 @@ void SimLayer::OnDraw()
 		* glm::scale(glm::mat4(1.0f), glm::vec3(m_CamScale))
 		* glm::translate(glm::mat4(1.0f), -m_CamPosition);
 
+	// Ghosts go into the same batches as the live cars
 	Renderer::BeginScene(viewProj);
+	m_Generation.DrawGhosts();
 	m_Generation.Draw();
 	Renderer::EndScene();
 }
@@ -145,10 +149,264 @@ void SimLayer::OnDrawImGui()
 {
 	ImGui::Begin("Generation");
 
+	ImGui::Text("Generation: %d", m_Generation.GetGenerationIndex());
+
+	const std::vector<float> &bestFitness = m_Generation.GetBestFitnessHistory();
+	if (!bestFitness.empty())
+	{
+		ImGui::PlotLines("Best Fitness", bestFitness.data(), static_cast<int>(bestFitness.size()));
+	}
+
+	if (ImGui::CollapsingHeader("Evolution"))
+	{
+		ImGui::Indent();
+
+		GenerationSettings &settings = m_Generation.GetSettings();
+
+		const char *selectionNames[static_cast<int>(SelectionType::Count)];
+		for (int i = 0; i < static_cast<int>(SelectionType::Count); i++)
+		{
+			selectionNames[i] = Selection::GetTypeName(static_cast<SelectionType>(i));
+		}
+
+		int selectionType = static_cast<int>(settings.Selection.Type);
+		if (ImGui::Combo("Selection", &selectionType, selectionNames, static_cast<int>(SelectionType::Count)))
+		{
+			settings.Selection.Type = static_cast<SelectionType>(selectionType);
+		}
+
+		if (settings.Selection.Type == SelectionType::Tournament)
+		{
+			ImGui::SliderInt("Tournament Size", &settings.Selection.TournamentSize, 1, 16);
+		}
+		else if (settings.Selection.Type == SelectionType::Truncation)
+		{
+			ImGui::SliderFloat("Truncation Ratio", &settings.Selection.TruncationRatio, 0.05f, 1.0f);
+		}
+
+		const char *optimizerNames[static_cast<int>(OptimizerType::Count)];
+		for (int i = 0; i < static_cast<int>(OptimizerType::Count); i++)
+		{
+			optimizerNames[i] = Optimizer::GetTypeName(static_cast<OptimizerType>(i));
+		}
+
+		int optimizerType = static_cast<int>(settings.Optimizer.Type);
+		if (ImGui::Combo("Optimizer", &optimizerType, optimizerNames, static_cast<int>(OptimizerType::Count)))
+		{
+			settings.Optimizer.Type = static_cast<OptimizerType>(optimizerType);
+		}
+
+		// Only read when the optimizer is made, on a switch or a new run
+		if (settings.Optimizer.Type == OptimizerType::CmaEs)
+		{
+			ImGui::SliderFloat("Initial Sigma", &settings.Optimizer.CmaSigma, 0.01f, 0.5f);
+		}
+
+		// Takes effect from the next generation bred
+		if (ImGui::InputInt("Population", &settings.NumCars, 10, 1000))
+		{
+			settings.NumCars = std::clamp(settings.NumCars, 2, kMaxPopulation);
+		}
+
+		ImGui::SliderInt("Elite Count", &settings.EliteCount, 0, settings.NumCars);
+		ImGui::SliderFloat("Breed Quorum", &settings.BreedQuorum, 0.5f, 1.0f);
+		if (m_Generation.IsReplayable())
+		{
+			ImGui::Text("Breed Quorum and Wall Clock Limit are off while a run log is written or rerun");
+		}
+
+		ImGui::Checkbox("Surrogate Screening", &settings.Surrogate.Enabled);
+		if (settings.Surrogate.Enabled)
+		{
+			ImGui::SliderInt("Pool Factor", &settings.Surrogate.PoolFactor, 2, 16);
+			ImGui::SliderFloat("Explore Ratio", &settings.Surrogate.ExploreRatio, 0.0f, 1.0f);
+		}
+
+		ImGui::Unindent();
+	}
+
+	if (ImGui::CollapsingHeader("Terrains"))
+	{
+		ImGui::Indent();
+
+		EvaluationSettings &evaluation = m_Generation.GetSettings().Evaluation;
+
+		ImGui::SliderInt("Terrain Count", &evaluation.TerrainCount, 1, 16);
+
+		const char *aggregationNames[static_cast<int>(FitnessAggregation::Count)];
+		for (int i = 0; i < static_cast<int>(FitnessAggregation::Count); i++)
+		{
+			aggregationNames[i] = EvaluationSettings::GetAggregationName(static_cast<FitnessAggregation>(i));
+		}
+
+		int aggregation = static_cast<int>(evaluation.Aggregation);
+		if (ImGui::Combo("Aggregation", &aggregation, aggregationNames, static_cast<int>(FitnessAggregation::Count)))
+		{
+			evaluation.Aggregation = static_cast<FitnessAggregation>(aggregation);
+		}
+
+		if (evaluation.Aggregation == FitnessAggregation::Quantile)
+		{
+			ImGui::SliderFloat("Quantile", &evaluation.Quantile, 0.0f, 1.0f);
+		}
+
+		ImGui::Separator();
+
+		const std::vector<float> &championFitness = m_Generation.GetChampionTerrainFitness();
+		for (size_t i = 0; i < m_Generation.GetTerrainCount(); i++)
+		{
+			const Arena &arena = m_Generation.GetArena(i);
+
+			if (i < championFitness.size())
+			{
+				ImGui::Text("Terrain %zu (%u): %0.0f", i, arena.GetTerrainSeed(), championFitness[i]);
+			}
+			else
+			{
+				ImGui::Text("Terrain %zu (%u)", i, arena.GetTerrainSeed());
+			}
+		}
+
+		ImGui::Unindent();
+	}
+
+	if (ImGui::CollapsingHeader("Kill Rules"))
+	{
+		ImGui::Indent();
+
+		KillRules &rules = m_Generation.GetSettings().Kill;
+		const KillStats &stats = m_Generation.GetKillStats();
+
+		ImGui::SliderFloat("Time Limit", &rules.TimeLimit, 0.0f, 600.0f, "%.0fs");
+		ImGui::SliderFloat("Finish Bonus", &rules.FinishBonus, 0.0f, 100.0f, "%.1f/s");
+		ImGui::SliderFloat("Wall Clock Limit", &m_Generation.GetSettings().MaxGenerationSeconds, 0.0f, 600.0f, "%.0fs");
+		ImGui::SliderFloat("Flipped Time", &rules.FlippedTime, 0.0f, 10.0f, "%.1fs");
+		ImGui::SliderFloat("Stalled Time", &rules.StalledTime, 0.0f, 10.0f, "%.1fs");
+		ImGui::SliderFloat("Fallen Depth", &rules.FallenDepth, 0.0f, 50.0f, "%.0fm");
+		ImGui::Checkbox("Kill Lagging", &rules.KillLagging);
+
+		ImGui::Separator();
+
+		for (size_t i = static_cast<size_t>(KillReason::Health); i < static_cast<size_t>(KillReason::Count); i++)
+		{
+			ImGui::Text("%s: %u", Car::GetKillReasonName(static_cast<KillReason>(i)), stats.Counts[i]);
+		}
+
+		ImGui::Text("Simulated Time Saved: %0.1fs (%0.1fs total)", stats.SimulatedTimeSaved, m_Generation.GetTotalTimeSaved());
+
+		ImGui::Separator();
+
+		LatencyStats latency = m_Generation.GetGenerationLatency();
+		ImGui::Text("Generation Time p50: %0.2fs", latency.P50);
+		ImGui::Text("Generation Time p90: %0.2fs", latency.P90);
+		ImGui::Text("Generation Time p99: %0.2fs", latency.P99);
+		ImGui::Text("Generation Time Max: %0.2fs", latency.Max);
+		ImGui::Text("Cut Off: %d of %zu", m_Generation.GetCutOffCount(), latency.Count);
+
+		LatencyStats turnover = m_Generation.GetTurnoverLatency();
+		ImGui::Text("Turnover p50: %0.2fms", turnover.P50 * 1e3f);
+		ImGui::Text("Turnover Max: %0.2fms", turnover.Max * 1e3f);
+
+		ImGui::Unindent();
+	}
+
+	if (ImGui::CollapsingHeader("Novelty"))
+	{
+		ImGui::Indent();
+
+		GenerationSettings &settings = m_Generation.GetSettings();
+		const NoveltyStats &stats = m_Generation.GetNoveltyStats();
+
+		ImGui::Checkbox("Enabled", &settings.Novelty.Enabled);
+		ImGui::SliderFloat("Weight", &settings.Novelty.Weight, 0.0f, 10.0f);
+		ImGui::SliderInt("Neighbours", &settings.Novelty.Neighbours, 1, 64);
+		ImGui::Separator();
+		ImGui::Text("Archive: %zu in %zu cells of %0.2f", stats.ArchiveSize, stats.CellCount, stats.CellSize);
+		ImGui::Text("Indexing: %0.2fms", stats.IndexSeconds * 1e3f);
+		ImGui::Text("Scoring: %0.2fms", stats.QuerySeconds * 1e3f);
+
+		ImGui::Unindent();
+	}
+
+	if (ImGui::CollapsingHeader("Fitness Cache"))
+	{
+		ImGui::Indent();
+
+		GenerationSettings &settings = m_Generation.GetSettings();
+		const FitnessCache &cache = m_Generation.GetFitnessCache();
+		const FitnessCache::Stats &stats = cache.GetStats();
+
+		ImGui::Checkbox("Enabled", &settings.UseFitnessCache);
+		if (m_Generation.IsReplayable())
+		{
+			ImGui::Text("Off while a run log is written or rerun");
+		}
+		ImGui::Checkbox("Show Cached Cars", &settings.ShowCachedCars);
+		ImGui::Separator();
+		ImGui::Text("Terrain Seed: %u", m_Generation.GetTerrainSeed());
+		ImGui::Text("Entries: %zu", cache.GetSize());
+		ImGui::Text("Hit Rate: %0.1f%%", 100.0f * stats.GetHitRate());
+		ImGui::Text("Simulated Time Saved: %0.1fs", stats.SimulatedTimeSaved);
+
+		ImGui::Unindent();
+	}
+
+	if (ImGui::CollapsingHeader("Ghosts"))
+	{
+		ImGui::Indent();
+
+		GenerationSettings &settings = m_Generation.GetSettings();
+
+		ImGui::SliderInt("Ghost Count", &settings.GhostCount, 0, 16);
+
+		for (const Ghost &ghost : m_Generation.GetGhosts())
+		{
+			ImGui::Text("Generation %d: %d (%zu bytes)", ghost.GenerationIndex, ghost.Fitness, ghost.Track.GetByteSize());
+		}
+
+		ImGui::Unindent();
+	}
+
+	if (ImGui::CollapsingHeader("Replay"))
+	{
+		ImGui::Indent();
+
+		const GenerationSettings &settings = m_Generation.GetSettings();
+
+		// Replays come from the log of this run, or the log this run was replayed from
+		const std::string &logPath = !settings.RunLogPath.empty() ? settings.RunLogPath : settings.ReplayLogPath;
+
+		ImGui::Text("Master Seed: %llu", static_cast<unsigned long long>(Random::GetSeed()));
+
+		if (!logPath.empty())
+		{
+			ImGui::Text("Run Log: %s", logPath.c_str());
+			ImGui::InputInt("Generation", &m_ReplayGeneration);
+
+			if (ImGui::Button("Re-simulate"))
+			{
+				GenerationSettings replaySettings = settings;
+				replaySettings.RunLogPath.clear();
+				replaySettings.ResumePath.clear();
+				replaySettings.ReplayLogPath = logPath;
+				replaySettings.ReplayGeneration = m_ReplayGeneration;
+
+				m_Generation.Create(replaySettings);
+			}
+		}
+		else
+		{
+			ImGui::Text("Start with --log <file> to record a run log");
+		}
+
+		ImGui::Unindent();
+	}
+
 	if (ImGui::CollapsingHeader("Best Car"))
 	{
 		ImGui::Indent();
 
+		int bestIndex = m_Generation.GetBestCarIndex();
 		const Car *bestCar = m_Generation.GetBestCar();
 
 		if (bestCar)
@@ -161,16 +419,29 @@ void SimLayer::OnDrawImGui()
 			ImGui::Text("Fitness: %u", bestCar->GetFitness());
 			ImGui::Text("Velocity: (%0.3f, %0.3f)", bestCar->GetVelocity().x, bestCar->GetVelocity().y);
 			ImGui::Text("Position: (%0.3f, %0.3f)", bestCar->GetPosition().x, bestCar->GetPosition().y);
+			ImGui::Text("Controller: %s", proto.Controlled ? "Evolved" : "None");
+
+			if (m_Generation.GetTerrainCount() > 1 && ImGui::CollapsingHeader("Terrain Fitness"))
+			{
+				ImGui::Indent();
+				for (size_t i = 0; i < m_Generation.GetTerrainCount(); i++)
+				{
+					const Car &car = m_Generation.GetArena(i).GetCar(static_cast<size_t>(bestIndex));
+					ImGui::Text("Terrain %zu: %d%s", i, car.GetFitness(), car.IsDead() ? " (dead)" : "");
+				}
+				ImGui::Unindent();
+			}
 
 			if (ImGui::CollapsingHeader("Wheels"))
 			{
-				int wheelNum = 1;
-				for (const auto& wheel : proto.Wheels)
+				for (int i = 0; i < proto.WheelCount; i++)
 				{
+					const WheelProto &wheel = proto.Wheels[i];
+
 					ImGui::Indent();
 
 					char wheelNStr[32];
-					std::sprintf(wheelNStr, "Wheel %d", wheelNum++);
+					std::sprintf(wheelNStr, "Wheel %d", i + 1);
 
 					if (ImGui::CollapsingHeader(wheelNStr))
 					{
@@ -180,6 +451,7 @@ void SimLayer::OnDrawImGui()
 						ImGui::Text("Density: %0.3f", wheel.Density);
 						ImGui::Text("Friction: %0.3f", wheel.Friction);
 						ImGui::Text("Restitution: %0.3f", wheel.Restitution);
+						ImGui::Text("Vertex: %u", proto.WheelVertices[i]);
 						ImGui::Unindent();
 					}
 
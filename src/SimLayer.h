@@ -9,7 +9,7 @@
 class SimLayer : public Layer
 {
 public:
-	SimLayer();
+	SimLayer(const GenerationSettings &settings = GenerationSettings());
 
 	virtual void OnUpdate() override;
 	virtual void OnDraw() override;
@@ -26,6 +26,7 @@ private:
 private:
 	Generation m_Generation;
 	int m_TimeMultiplier;
+	int m_ReplayGeneration;
 	
 	glm::vec3 m_CamPosition;
 	float m_CamScale;
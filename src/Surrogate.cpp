@@ -0,0 +1,220 @@
+#include "Surrogate.h"
+#include "Log.h"
+
+static constexpr float kVertexScale = 1.0f / 15.0f;
+static constexpr float kRimSpeedScale = 1.0f / (CarConstants::kMaxWheelMotorSpeed * CarConstants::kMaxWheelRadius);
+
+FitnessSurrogate::FitnessSurrogate()
+{
+	Reset();
+}
+
+void FitnessSurrogate::Reset()
+{
+	m_Gram.assign(kNumFeatures * kNumFeatures, 0.0);
+	m_Moments.assign(kNumFeatures, 0.0);
+	m_SampleWeight = 0.0;
+
+	m_Weights.fill(0.0f);
+	m_Solved = false;
+}
+
+void FitnessSurrogate::MakeFeatures(const GenomeBatch &genomes, size_t index, float *features)
+{
+	const CarProto &carProto = genomes.Get(index);
+
+	size_t f = 0;
+
+	// Bias, which is never penalised
+	features[f++] = 1.0f;
+
+	features[f++] = carProto.Density / CarConstants::kMaxChassisDensity;
+	features[f++] = carProto.Friction;
+	features[f++] = carProto.Restitution;
+
+	float size = 0.0f;
+	for (size_t j = 0; j < CarConstants::kNumVertices; j++)
+	{
+		float x = carProto.Vertices[j].x * kVertexScale;
+		float y = carProto.Vertices[j].y * kVertexScale;
+
+		features[f++] = x;
+		features[f++] = y;
+
+		size += std::sqrt(x * x + y * y);
+	}
+
+	uint8_t wheelCount = carProto.WheelCount;
+	features[f++] = static_cast<float>(wheelCount) / static_cast<float>(CarConstants::kNumVertices);
+
+	// A few totals over the wheels, which a linear model cannot add up itself
+	float maxRadius = 0.0f;
+	float maxRimSpeed = 0.0f;
+	for (uint8_t j = 0; j < wheelCount; j++)
+	{
+		float radius = carProto.Wheels[j].Radius;
+
+		maxRadius = std::max(maxRadius, radius);
+		maxRimSpeed = std::max(maxRimSpeed, std::abs(carProto.Wheels[j].MotorSpeed) * radius);
+	}
+
+	features[f++] = size / static_cast<float>(CarConstants::kNumVertices);
+	features[f++] = maxRadius / CarConstants::kMaxWheelRadius;
+	features[f++] = maxRimSpeed * kRimSpeedScale;
+
+	// Unused wheels are all zero rather than their default genes
+	for (size_t j = 0; j < CarConstants::kNumVertices; j++)
+	{
+		float used = j < wheelCount ? 1.0f : 0.0f;
+
+		features[f++] = used;
+		features[f++] = used * carProto.Wheels[j].Radius / CarConstants::kMaxWheelRadius;
+		features[f++] = used * carProto.Wheels[j].Density / CarConstants::kMaxWheelDensity;
+		features[f++] = used * carProto.Wheels[j].Friction;
+		features[f++] = used * carProto.Wheels[j].Restitution;
+		features[f++] = used * -carProto.Wheels[j].MotorSpeed / CarConstants::kMaxWheelMotorSpeed;
+	}
+
+	BL_ASSERT(f == kNumFeatures, "Every feature has to be written !");
+}
+
+void FitnessSurrogate::Train(const GenomeBatch &genomes, const std::vector<float> &fitness, const SurrogateSettings &settings)
+{
+	BL_ASSERT(genomes.GetSize() == fitness.size(), "Every genome needs a fitness !");
+
+	size_t count = fitness.size();
+
+	double decay = static_cast<double>(std::clamp(settings.Decay, 0.0f, 1.0f));
+	for (double &value : m_Gram)
+	{
+		value *= decay;
+	}
+	for (double &value : m_Moments)
+	{
+		value *= decay;
+	}
+	m_SampleWeight = m_SampleWeight * decay + static_cast<double>(count);
+
+	m_Features.resize(count * kNumFeatures);
+	for (size_t i = 0; i < count; i++)
+	{
+		MakeFeatures(genomes, i, &m_Features[i * kNumFeatures]);
+	}
+
+	// Only the upper triangle, the solve mirrors it
+	for (size_t i = 0; i < count; i++)
+	{
+		const float *x = &m_Features[i * kNumFeatures];
+		double y = static_cast<double>(fitness[i]);
+
+		for (size_t a = 0; a < kNumFeatures; a++)
+		{
+			double xa = static_cast<double>(x[a]);
+			double *row = &m_Gram[a * kNumFeatures];
+
+			for (size_t b = a; b < kNumFeatures; b++)
+			{
+				row[b] += xa * static_cast<double>(x[b]);
+			}
+
+			m_Moments[a] += xa * y;
+		}
+	}
+
+	if (!Solve(static_cast<double>(std::max(settings.Ridge, 0.0f))))
+	{
+		BL_LOG("The fitness surrogate could not be solved, keeping its last weights");
+	}
+}
+
+bool FitnessSurrogate::Solve(double ridge)
+{
+	// Cholesky factorisation of the penalised Gram matrix, L * L^T
+	std::vector<double> lower(kNumFeatures * kNumFeatures, 0.0);
+
+	for (size_t a = 0; a < kNumFeatures; a++)
+	{
+		for (size_t b = 0; b <= a; b++)
+		{
+			double sum = m_Gram[b * kNumFeatures + a];
+
+			if (a == b && a > 0)
+			{
+				sum += ridge;
+			}
+
+			for (size_t k = 0; k < b; k++)
+			{
+				sum -= lower[a * kNumFeatures + k] * lower[b * kNumFeatures + k];
+			}
+
+			if (a == b)
+			{
+				if (sum <= 1e-12)
+				{
+					return false;
+				}
+
+				lower[a * kNumFeatures + a] = std::sqrt(sum);
+			}
+			else
+			{
+				lower[a * kNumFeatures + b] = sum / lower[b * kNumFeatures + b];
+			}
+		}
+	}
+
+	// Forwards through L, then backwards through L^T
+	std::array<double, kNumFeatures> z;
+	for (size_t a = 0; a < kNumFeatures; a++)
+	{
+		double sum = m_Moments[a];
+		for (size_t k = 0; k < a; k++)
+		{
+			sum -= lower[a * kNumFeatures + k] * z[k];
+		}
+		z[a] = sum / lower[a * kNumFeatures + a];
+	}
+
+	std::array<double, kNumFeatures> weights;
+	for (size_t a = kNumFeatures; a-- > 0;)
+	{
+		double sum = z[a];
+		for (size_t k = a + 1; k < kNumFeatures; k++)
+		{
+			sum -= lower[k * kNumFeatures + a] * weights[k];
+		}
+		weights[a] = sum / lower[a * kNumFeatures + a];
+	}
+
+	for (size_t a = 0; a < kNumFeatures; a++)
+	{
+		m_Weights[a] = static_cast<float>(weights[a]);
+	}
+	m_Solved = true;
+
+	return true;
+}
+
+bool FitnessSurrogate::IsReady(const SurrogateSettings &settings) const
+{
+	return m_Solved && m_SampleWeight >= static_cast<double>(settings.MinSamples);
+}
+
+void FitnessSurrogate::Predict(const GenomeBatch &genomes, size_t begin, size_t end, float *predictions) const
+{
+	std::array<float, kNumFeatures> features;
+
+	for (size_t i = begin; i < end; i++)
+	{
+		MakeFeatures(genomes, i, features.data());
+
+		float prediction = 0.0f;
+		for (size_t f = 0; f < kNumFeatures; f++)
+		{
+			prediction += m_Weights[f] * features[f];
+		}
+
+		predictions[i - begin] = prediction;
+	}
+}
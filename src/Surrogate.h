@@ -0,0 +1,73 @@
+#pragma once
+
+#include "GenomeBatch.h"
+
+struct SurrogateSettings
+{
+	// Breeds a pool of candidates several times larger than the population
+	// and only simulates the ones the model predicts will do best
+	bool Enabled = false;
+
+	// Candidates bred for every car which is simulated
+	int PoolFactor = 4;
+
+	// Share of the simulated cars taken from the pool unscreened, so the
+	// model keeps seeing genomes it would not have picked itself
+	float ExploreRatio = 0.1f;
+
+	// How much the samples of each earlier generation still count for
+	float Decay = 0.8f;
+
+	// Penalty on every weight but the bias
+	float Ridge = 1.0f;
+
+	// Samples, weighted by their decay, needed before screening starts
+	float MinSamples = 100.0f;
+};
+
+// Ridge regression from a genome's features to its fitness, trained online
+// on every generation which is simulated. Rather than keeping the samples,
+// the normal equations are accumulated and decayed each generation, so
+// training only costs a pass over the new genomes and a small solve.
+//
+// Features are scaled by the fixed ranges of the genes, so the model does not
+// depend on what it has seen so far. The controller weights are left out,
+// they are many and say little about fitness on their own.
+class FitnessSurrogate
+{
+public:
+	static constexpr size_t kNumWheelFeatures = 6;
+	static constexpr size_t kNumFeatures = 1 + 3 + 2 * CarConstants::kNumVertices + 1 + 3
+	                                     + kNumWheelFeatures * CarConstants::kNumVertices;
+
+	FitnessSurrogate();
+
+	void Reset();
+
+	void Train(const GenomeBatch &genomes, const std::vector<float> &fitness, const SurrogateSettings &settings);
+
+	// Once it has been trained on enough samples
+	bool IsReady(const SurrogateSettings &settings) const;
+
+	// Predicted fitness of genomes [begin, end), into predictions[0, end - begin)
+	void Predict(const GenomeBatch &genomes, size_t begin, size_t end, float *predictions) const;
+
+	inline double GetSampleWeight() const { return m_SampleWeight; }
+
+private:
+	static void MakeFeatures(const GenomeBatch &genomes, size_t index, float *features);
+
+	bool Solve(double ridge);
+
+private:
+	// Sums of x * x^T and x * fitness over the decayed samples
+	std::vector<double> m_Gram;
+	std::vector<double> m_Moments;
+	double m_SampleWeight;
+
+	std::array<float, kNumFeatures> m_Weights;
+	bool m_Solved;
+
+	// Features of the genomes being trained on, a row each
+	std::vector<float> m_Features;
+};
@@ -0,0 +1,611 @@
+#include "Trajectory.h"
+#include "Log.h"
+
+#include <cstring>
+
+// Written out once this much has built up, rather than a chunk at a time
+static constexpr size_t kFlushSize = 1 << 20;
+
+// Rounds half away from zero, without the cost of std::llround
+static inline int64_t Round(float value)
+{
+	return static_cast<int64_t>(value + (value < 0.0f ? -0.5f : 0.5f));
+}
+
+static inline bool IsAngleChannel(size_t channel)
+{
+	return channel == 2 || channel >= 4;
+}
+
+static inline int64_t QuantiseAngle(float angle)
+{
+	// Angles keep growing as wheels turn, only the angle modulo a turn is kept
+	return static_cast<uint16_t>(Round(angle * Trajectory::kAngleScale));
+}
+
+static inline int64_t Wrap16(int64_t value)
+{
+	return static_cast<int16_t>(static_cast<uint16_t>(value));
+}
+
+static inline uint8_t *WriteVarint(uint8_t *out, int64_t value)
+{
+	uint64_t zigzag = (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+
+	while (zigzag >= 0x80)
+	{
+		*out++ = static_cast<uint8_t>(zigzag) | 0x80;
+		zigzag >>= 7;
+	}
+	*out++ = static_cast<uint8_t>(zigzag);
+
+	return out;
+}
+
+// False when the data ends before the value does, or the value runs past
+// the 10 bytes any 64-bit value fits in
+static inline bool ReadVarint(const uint8_t *&data, const uint8_t *end, int64_t &value)
+{
+	uint64_t zigzag = 0;
+
+	for (int shift = 0; shift < 64; shift += 7)
+	{
+		if (data >= end)
+		{
+			return false;
+		}
+
+		uint8_t byte = *data++;
+		zigzag |= static_cast<uint64_t>(byte & 0x7f) << shift;
+
+		if (!(byte & 0x80))
+		{
+			value = static_cast<int64_t>(zigzag >> 1) ^ -static_cast<int64_t>(zigzag & 1);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void Trajectory::EncodePose(std::vector<uint8_t> &out, EncoderState &state, const CarPose &pose, uint8_t wheelCount, bool keyframe)
+{
+	int64_t values[kNumChannels];
+	values[0] = Round(pose.Position.x * kPositionScale);
+	values[1] = Round(pose.Position.y * kPositionScale);
+	values[2] = QuantiseAngle(pose.Angle);
+	values[3] = pose.Health;
+	for (uint8_t i = 0; i < wheelCount; i++)
+	{
+		values[4 + i] = QuantiseAngle(pose.WheelAngles[i]);
+	}
+
+	// At most 10 bytes a value, appended in one go
+	uint8_t bytes[kNumChannels * 10];
+	uint8_t *end = bytes;
+
+	size_t numChannels = 4 + wheelCount;
+	for (size_t c = 0; c < numChannels; c++)
+	{
+		bool angle = IsAngleChannel(c);
+
+		int64_t predicted = keyframe ? 0 : state.Last[c] + state.LastDelta[c];
+		int64_t residual = values[c] - predicted;
+		int64_t delta = values[c] - state.Last[c];
+
+		end = WriteVarint(end, angle ? Wrap16(residual) : residual);
+
+		state.LastDelta[c] = keyframe ? 0 : (angle ? Wrap16(delta) : delta);
+		state.Last[c] = values[c];
+	}
+
+	out.insert(out.end(), bytes, end);
+}
+
+// The decoder state holds the values of the last pose it decoded
+static void MakePose(const Trajectory::EncoderState &state, const CarProto &carProto, CarPose &pose)
+{
+	using namespace Trajectory;
+
+	const std::array<int64_t, kNumChannels> &values = state.Last;
+
+	pose.Position.x = static_cast<float>(values[0]) / kPositionScale;
+	pose.Position.y = static_cast<float>(values[1]) / kPositionScale;
+	pose.Angle = static_cast<float>(values[2]) / kAngleScale;
+	pose.Health = static_cast<int>(values[3]);
+
+	float c = std::cos(pose.Angle);
+	float s = std::sin(pose.Angle);
+
+	for (uint8_t i = 0; i < carProto.WheelCount; i++)
+	{
+		const b2Vec2 &anchor = carProto.Vertices[carProto.WheelVertices[i]];
+
+		pose.WheelPositions[i].x = pose.Position.x + c * anchor.x - s * anchor.y;
+		pose.WheelPositions[i].y = pose.Position.y + s * anchor.x + c * anchor.y;
+		pose.WheelAngles[i] = static_cast<float>(values[4 + i]) / kAngleScale;
+	}
+}
+
+const uint8_t *Trajectory::DecodePose(const uint8_t *data, const uint8_t *end, EncoderState &state, const CarProto &carProto, bool keyframe, CarPose &pose)
+{
+	size_t numChannels = 4 + carProto.WheelCount;
+	for (size_t c = 0; c < numChannels; c++)
+	{
+		int64_t residual;
+		if (!ReadVarint(data, end, residual))
+		{
+			return nullptr;
+		}
+
+		int64_t predicted = keyframe ? 0 : state.Last[c] + state.LastDelta[c];
+		int64_t value = predicted + residual;
+
+		if (IsAngleChannel(c))
+		{
+			value &= 0xffff;
+			state.LastDelta[c] = keyframe ? 0 : Wrap16(value - state.Last[c]);
+		}
+		else
+		{
+			state.LastDelta[c] = keyframe ? 0 : value - state.Last[c];
+		}
+
+		state.Last[c] = value;
+	}
+
+	MakePose(state, carProto, pose);
+
+	return data;
+}
+
+size_t Trajectory::DecodeChunk(const uint8_t *data, size_t size, uint32_t numSteps, const CarProto &carProto, CarPose *poses)
+{
+	const uint8_t *begin = data;
+	const uint8_t *end = data + size;
+
+	EncoderState state;
+
+	for (uint32_t step = 0; step < numSteps; step++)
+	{
+		data = DecodePose(data, end, state, carProto, step == 0, poses[step]);
+
+		if (!data)
+		{
+			return 0;
+		}
+	}
+
+	return static_cast<size_t>(data - begin);
+}
+
+bool Trajectory::Seek(const uint8_t *data, const std::vector<Chunk> &chunks, const CarProto &carProto, uint32_t step, Cursor &cursor)
+{
+	if (chunks.empty())
+	{
+		return false;
+	}
+
+	step = std::min(step, chunks.back().FirstStep + chunks.back().NumSteps - 1);
+
+	// Chunks are in step order, find the one holding the step. Before the
+	// first there is none.
+	auto it = std::upper_bound(chunks.begin(), chunks.end(), step,
+		[](uint32_t s, const Chunk &chunk) { return s < chunk.FirstStep; });
+
+	if (it == chunks.begin())
+	{
+		return false;
+	}
+
+	size_t chunkIndex = static_cast<size_t>(it - chunks.begin()) - 1;
+
+	const Chunk &chunk = chunks[chunkIndex];
+	const uint8_t *end = data + chunk.Offset + chunk.ByteSize;
+
+	if (!cursor.Data || cursor.ChunkIndex != chunkIndex)
+	{
+		cursor.ChunkIndex = chunkIndex;
+		cursor.Step = chunk.FirstStep;
+		cursor.Data = DecodePose(data + chunk.Offset, end, cursor.State, carProto, true, cursor.Pose);
+
+		if (!cursor.Data)
+		{
+			return false;
+		}
+
+		cursor.Snapshots[0] = { cursor.Data, cursor.State };
+		cursor.NumSnapshots = 1;
+	}
+	else if (step < cursor.Step)
+	{
+		// Back to the last snapshot at or before the step
+		uint32_t index = std::min((step - chunk.FirstStep) / kSnapshotSteps, cursor.NumSnapshots - 1);
+		const Cursor::Snapshot &snapshot = cursor.Snapshots[index];
+
+		cursor.Step = chunk.FirstStep + index * kSnapshotSteps;
+		cursor.Data = snapshot.Data;
+		cursor.State = snapshot.State;
+
+		MakePose(cursor.State, carProto, cursor.Pose);
+	}
+
+	while (cursor.Step < step)
+	{
+		cursor.Data = DecodePose(cursor.Data, end, cursor.State, carProto, false, cursor.Pose);
+
+		// Decoded again from its start next time
+		if (!cursor.Data)
+		{
+			return false;
+		}
+
+		cursor.Step++;
+
+		uint32_t offset = cursor.Step - chunk.FirstStep;
+		if (   offset % kSnapshotSteps == 0 && offset / kSnapshotSteps == cursor.NumSnapshots
+		    && cursor.NumSnapshots < cursor.Snapshots.size())
+		{
+			cursor.Snapshots[cursor.NumSnapshots++] = { cursor.Data, cursor.State };
+		}
+	}
+
+	return true;
+}
+
+void Trajectory::Track::Begin(const CarProto &carProto)
+{
+	m_Proto = carProto;
+	m_Bytes.clear();
+	m_Chunks.clear();
+	m_Length = 0;
+	m_Finished = false;
+	m_State = EncoderState();
+	m_Cursor = Cursor();
+}
+
+void Trajectory::Track::Append(const CarPose &pose)
+{
+	bool keyframe = m_Length % kChunkSteps == 0;
+
+	if (keyframe)
+	{
+		Chunk chunk;
+		chunk.FirstStep = m_Length;
+		chunk.NumSteps = 0;
+		chunk.Offset = m_Bytes.size();
+		chunk.ByteSize = 0;
+
+		m_Chunks.push_back(chunk);
+	}
+
+	EncodePose(m_Bytes, m_State, pose, m_Proto.WheelCount, keyframe);
+	m_Length++;
+
+	Chunk &chunk = m_Chunks.back();
+	chunk.NumSteps++;
+	chunk.ByteSize = static_cast<uint32_t>(m_Bytes.size() - chunk.Offset);
+
+	// The bytes may have moved
+	m_Cursor.Data = nullptr;
+}
+
+bool Trajectory::Track::GetPose(uint32_t step, CarPose &pose)
+{
+	if (!Seek(m_Bytes.data(), m_Chunks, m_Proto, step, m_Cursor))
+	{
+		return false;
+	}
+
+	pose = m_Cursor.Pose;
+
+	return true;
+}
+
+Trajectory::Recorder::Recorder()
+	: m_File(nullptr)
+{
+}
+
+Trajectory::Recorder::~Recorder()
+{
+	End();
+}
+
+bool Trajectory::Recorder::Begin(const std::string &path, uint32_t generationIndex, uint32_t terrainSeed, int platformCount,
+                                 const std::vector<CarProto> &carProtos, const std::vector<uint32_t> &carIds)
+{
+	End();
+
+	m_File = std::fopen(path.c_str(), "wb");
+	if (!m_File)
+	{
+		BL_LOG("Failed to open trajectory file '%s' for writing", path.c_str());
+		return false;
+	}
+
+	BL_ASSERT(carProtos.size() == carIds.size(), "Every car needs an id !");
+
+	FileHeader header = {};
+	std::memcpy(header.Magic, kMagic, sizeof(kMagic));
+	header.Version = kVersion;
+	header.HeaderSize = sizeof(FileHeader);
+	header.ProtoSize = sizeof(CarProto);
+	header.NumCars = static_cast<uint32_t>(carProtos.size());
+	header.GenerationIndex = generationIndex;
+	header.TerrainSeed = terrainSeed;
+	header.ChunkSteps = kChunkSteps;
+	header.DeltaTime = k_UpdateDeltaTime;
+	header.PositionScale = kPositionScale;
+	header.AngleScale = kAngleScale;
+	header.PlatformCount = static_cast<uint32_t>(platformCount);
+
+	std::fwrite(&header, sizeof(header), 1, m_File);
+	std::fwrite(carProtos.data(), sizeof(CarProto), carProtos.size(), m_File);
+	std::fwrite(carIds.data(), sizeof(uint32_t), carIds.size(), m_File);
+
+	m_Tracks.clear();
+	m_Tracks.resize(carProtos.size());
+	for (size_t i = 0; i < carProtos.size(); i++)
+	{
+		m_Tracks[i].WheelCount = carProtos[i].WheelCount;
+		m_Tracks[i].Chunk.reserve(kChunkSteps * 4);
+	}
+
+	m_Buffer.clear();
+	m_Buffer.reserve(kFlushSize + kChunkSteps * 4 * kNumChannels);
+
+	m_Stats = Stats();
+	m_Stats.Bytes = sizeof(header) + carProtos.size() * (sizeof(CarProto) + sizeof(uint32_t));
+
+	return true;
+}
+
+void Trajectory::Recorder::End()
+{
+	if (!m_File)
+	{
+		return;
+	}
+
+	for (size_t i = 0; i < m_Tracks.size(); i++)
+	{
+		FlushChunk(i);
+	}
+	FlushBuffer();
+
+	std::fclose(m_File);
+	m_File = nullptr;
+}
+
+void Trajectory::Recorder::Record(size_t carIndex, const CarPose &pose)
+{
+	Track &track = m_Tracks[carIndex];
+
+	if (!m_File || track.Finished)
+	{
+		return;
+	}
+
+	EncodePose(track.Chunk, track.State, pose, track.WheelCount, track.NumSteps == 0);
+	track.NumSteps++;
+	m_Stats.Poses++;
+
+	if (track.NumSteps == kChunkSteps)
+	{
+		FlushChunk(carIndex);
+	}
+}
+
+void Trajectory::Recorder::Finish(size_t carIndex)
+{
+	FlushChunk(carIndex);
+	m_Tracks[carIndex].Finished = true;
+}
+
+void Trajectory::Recorder::FlushChunk(size_t carIndex)
+{
+	Track &track = m_Tracks[carIndex];
+
+	if (track.NumSteps == 0)
+	{
+		return;
+	}
+
+	ChunkHeader chunk;
+	chunk.CarIndex = static_cast<uint32_t>(carIndex);
+	chunk.FirstStep = track.FirstStep;
+	chunk.NumSteps = track.NumSteps;
+	chunk.ByteSize = static_cast<uint32_t>(track.Chunk.size());
+
+	const uint8_t *chunkBytes = reinterpret_cast<const uint8_t *>(&chunk);
+	m_Buffer.insert(m_Buffer.end(), chunkBytes, chunkBytes + sizeof(chunk));
+	m_Buffer.insert(m_Buffer.end(), track.Chunk.begin(), track.Chunk.end());
+
+	track.FirstStep += track.NumSteps;
+	track.NumSteps = 0;
+	track.Chunk.clear();
+
+	if (m_Buffer.size() >= kFlushSize)
+	{
+		FlushBuffer();
+	}
+}
+
+void Trajectory::Recorder::FlushBuffer()
+{
+	if (m_File && !m_Buffer.empty())
+	{
+		std::fwrite(m_Buffer.data(), 1, m_Buffer.size(), m_File);
+		m_Stats.Bytes += m_Buffer.size();
+	}
+
+	m_Buffer.clear();
+}
+
+Trajectory::Reader::Reader()
+	: m_Header()
+	, m_NumSteps(0)
+	, m_Truncated(false)
+{
+}
+
+bool Trajectory::Reader::Open(const std::string &path)
+{
+	Close();
+
+	if (!m_File.Open(path))
+	{
+		BL_LOG("Failed to open trajectory file '%s'", path.c_str());
+		return false;
+	}
+
+	const uint8_t *data = m_File.GetData();
+	size_t size = m_File.GetSize();
+
+	if (size >= sizeof(FileHeader))
+	{
+		std::memcpy(&m_Header, data, sizeof(FileHeader));
+	}
+
+	if (   size < sizeof(FileHeader)
+	    || std::memcmp(m_Header.Magic, kMagic, sizeof(kMagic)) != 0
+	    || m_Header.Version != kVersion
+	    || m_Header.HeaderSize != sizeof(FileHeader)
+	    || m_Header.ProtoSize != sizeof(CarProto)
+	    || size < sizeof(FileHeader) + m_Header.NumCars * (sizeof(CarProto) + sizeof(uint32_t)))
+	{
+		BL_LOG("'%s' is not a trajectory file from this build", path.c_str());
+		Close();
+		return false;
+	}
+
+	size_t offset = sizeof(FileHeader);
+
+	m_CarProtos.resize(m_Header.NumCars);
+	std::memcpy(m_CarProtos.data(), data + offset, m_Header.NumCars * sizeof(CarProto));
+	offset += m_Header.NumCars * sizeof(CarProto);
+
+	// The wheel counts and vertex indices are used to decode and draw every
+	// pose, so genomes the server would turn away are not read any further
+	for (size_t i = 0; i < m_CarProtos.size(); i++)
+	{
+		if (!Car::IsValidProto(m_CarProtos[i]))
+		{
+			BL_LOG("The genome of car %zu in '%s' is invalid", i, path.c_str());
+			Close();
+			return false;
+		}
+	}
+
+	m_CarIds.resize(m_Header.NumCars);
+	std::memcpy(m_CarIds.data(), data + offset, m_Header.NumCars * sizeof(uint32_t));
+	offset += m_Header.NumCars * sizeof(uint32_t);
+
+	// Only the chunk headers are read up front, the poses stay on disk until
+	// they are needed.
+	m_Tracks.resize(m_Header.NumCars);
+
+	while (offset + sizeof(ChunkHeader) <= size)
+	{
+		ChunkHeader header;
+		std::memcpy(&header, data + offset, sizeof(header));
+		offset += sizeof(header);
+
+		if (header.CarIndex >= m_Header.NumCars || offset + header.ByteSize > size)
+		{
+			m_Truncated = true;
+			break;
+		}
+
+		// A track's chunks follow on from each other, from its first step.
+		// After one which does not the rest of the track is left out.
+		TrackChunks &track = m_Tracks[header.CarIndex];
+		uint32_t trackEnd = track.Chunks.empty() ? 0 : track.Chunks.back().FirstStep + track.Chunks.back().NumSteps;
+
+		if (header.FirstStep != trackEnd || header.NumSteps == 0 || header.NumSteps > kChunkSteps)
+		{
+			track.Corrupt = true;
+		}
+
+		if (!track.Corrupt)
+		{
+			Chunk chunk;
+			chunk.FirstStep = header.FirstStep;
+			chunk.NumSteps = header.NumSteps;
+			chunk.Offset = offset;
+			chunk.ByteSize = header.ByteSize;
+
+			track.Chunks.push_back(chunk);
+			m_NumSteps = std::max(m_NumSteps, header.FirstStep + header.NumSteps);
+		}
+
+		offset += header.ByteSize;
+	}
+
+	m_Truncated = m_Truncated || offset != size;
+
+	if (m_Truncated)
+	{
+		BL_LOG("'%s' is cut short, the last chunks are missing", path.c_str());
+	}
+
+	for (size_t i = 0; i < m_Tracks.size(); i++)
+	{
+		if (m_Tracks[i].Corrupt)
+		{
+			BL_LOG("The chunks of car %zu in '%s' are out of order, its track is cut off there", i, path.c_str());
+		}
+	}
+
+	return true;
+}
+
+void Trajectory::Reader::Close()
+{
+	m_File.Close();
+	m_CarProtos.clear();
+	m_CarIds.clear();
+	m_Tracks.clear();
+	m_NumSteps = 0;
+	m_Truncated = false;
+}
+
+size_t Trajectory::Reader::GetNumCorruptTracks() const
+{
+	return static_cast<size_t>(std::count_if(m_Tracks.begin(), m_Tracks.end(),
+		[](const TrackChunks &track) { return track.Corrupt; }));
+}
+
+uint32_t Trajectory::Reader::GetTrackLength(size_t carIndex) const
+{
+	const std::vector<Chunk> &chunks = m_Tracks[carIndex].Chunks;
+
+
+	return chunks.empty() ? 0 : chunks.back().FirstStep + chunks.back().NumSteps;
+}
+
+bool Trajectory::Reader::GetPose(size_t carIndex, uint32_t step, CarPose &pose)
+{
+	TrackChunks &track = m_Tracks[carIndex];
+
+	if (track.Chunks.empty())
+	{
+		return false;
+	}
+
+	if (!Seek(m_File.GetData(), track.Chunks, m_CarProtos[carIndex], step, track.Decoder))
+	{
+		if (!track.Corrupt)
+		{
+			BL_LOG("Chunk %zu of car %zu is cut short or corrupt, the car is not shown there", track.Decoder.ChunkIndex, carIndex);
+			track.Corrupt = true;
+		}
+
+		return false;
+	}
+
+	pose = track.Decoder.Pose;
+
+	return true;
+}
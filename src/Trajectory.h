@@ -0,0 +1,247 @@
+#pragma once
+
+#include "Car.h"
+#include "MappedFile.h"
+
+#include <cstdio>
+
+// Recorded poses of every car of a generation, so a run can be looked at
+// again without simulating it.
+//
+// Each car's track is split into chunks of up to kChunkSteps steps. A pose is
+// quantised to integers (positions to about a millimetre, angles to 16 bits)
+// and each value is stored as the zigzag varint of its difference from a
+// linear prediction of the previous two, which is one byte for most values
+// of a car moving smoothly. The first pose of a chunk is stored whole, so
+// every chunk can be decoded on its own.
+namespace Trajectory
+{
+	static constexpr char kMagic[4] = { 'B', 'L', 'T', 'R' };
+	static constexpr uint32_t kVersion = 3;
+
+	static constexpr uint32_t kChunkSteps = 256;
+
+	// How often a cursor keeps the decoder state within a chunk
+	static constexpr uint32_t kSnapshotSteps = 16;
+
+	static constexpr float kPositionScale = 1024.0f;
+	static constexpr float kAngleScale = 65536.0f / 6.28318530718f;
+
+	// Position x, y, angle, health, then one angle per wheel. The wheel
+	// positions are not stored, they follow from the chassis pose.
+	static constexpr size_t kNumChannels = 4 + CarConstants::kNumVertices;
+
+	// Followed by NumCars CarProtos, NumCars car ids and then the chunks
+	struct FileHeader
+	{
+		char Magic[4];
+		uint32_t Version;
+		uint32_t HeaderSize;
+		uint32_t ProtoSize;
+		uint32_t NumCars;
+		uint32_t GenerationIndex;
+		uint32_t TerrainSeed;
+		uint32_t ChunkSteps;
+		float DeltaTime;
+		float PositionScale;
+		float AngleScale;
+		uint32_t PlatformCount;
+	};
+
+	static_assert(sizeof(FileHeader) == 48, "The trajectory header layout must not change without a new version");
+
+	// Followed by ByteSize bytes of encoded poses
+	struct ChunkHeader
+	{
+		uint32_t CarIndex;
+		uint32_t FirstStep;
+		uint32_t NumSteps;
+		uint32_t ByteSize;
+	};
+
+	struct EncoderState
+	{
+		std::array<int64_t, kNumChannels> Last = {};
+		std::array<int64_t, kNumChannels> LastDelta = {};
+	};
+
+	// A keyframe resets the prediction and starts a new chunk
+	void EncodePose(std::vector<uint8_t> &out, EncoderState &state, const CarPose &pose, uint8_t wheelCount, bool keyframe);
+
+	// Decodes the next pose of a chunk and returns where the one after starts,
+	// or null when the chunk is cut short or corrupt
+	const uint8_t *DecodePose(const uint8_t *data, const uint8_t *end, EncoderState &state, const CarProto &carProto, bool keyframe, CarPose &pose);
+
+	// Decodes a whole chunk into numSteps poses, returns the bytes read or
+	// zero for a bad chunk
+	size_t DecodeChunk(const uint8_t *data, size_t size, uint32_t numSteps, const CarProto &carProto, CarPose *poses);
+
+	// Where a chunk of a track is, relative to the start of its data
+	struct Chunk
+	{
+		uint32_t FirstStep;
+		uint32_t NumSteps;
+		size_t Offset;
+		uint32_t ByteSize;
+	};
+
+	// Decoder state for the step of a track it was last asked for, and every
+	// kSnapshotSteps steps of its chunk up to there
+	struct Cursor
+	{
+		struct Snapshot
+		{
+			const uint8_t *Data = nullptr;
+			EncoderState State;
+		};
+
+		size_t ChunkIndex = 0;
+		uint32_t Step = 0;
+		const uint8_t *Data = nullptr;
+		EncoderState State;
+		CarPose Pose;
+
+		std::array<Snapshot, kChunkSteps / kSnapshotSteps> Snapshots;
+		uint32_t NumSnapshots = 0;
+	};
+
+	// Decodes a track's pose at a step. Later in the same chunk it carries on
+	// from the cursor, earlier it carries on from the snapshot before the step,
+	// so stepping either way decodes fewer than kSnapshotSteps poses. Another
+	// chunk is decoded from its start. Past the end of the track this is the
+	// last pose. False for an empty track, a step before its first chunk or a
+	// bad chunk.
+	bool Seek(const uint8_t *data, const std::vector<Chunk> &chunks, const CarProto &carProto, uint32_t step, Cursor &cursor);
+
+	// One car's track kept in memory, encoded the same way as in a file
+	class Track
+	{
+	public:
+		void Begin(const CarProto &carProto);
+		void Append(const CarPose &pose);
+		inline void Finish() { m_Finished = true; }
+
+		bool GetPose(uint32_t step, CarPose &pose);
+
+		inline bool IsFinished() const { return m_Finished; }
+		inline const CarProto &GetProto() const { return m_Proto; }
+		inline uint32_t GetLength() const { return m_Length; }
+		inline size_t GetByteSize() const { return m_Bytes.size(); }
+
+	private:
+		CarProto m_Proto;
+		std::vector<uint8_t> m_Bytes;
+		std::vector<Chunk> m_Chunks;
+		uint32_t m_Length = 0;
+		bool m_Finished = false;
+
+		EncoderState m_State;
+		Cursor m_Cursor;
+	};
+
+	// Streams the tracks of one generation to a file. Only the chunks being
+	// filled and a small write buffer are held in memory, however long the
+	// generation runs.
+	class Recorder
+	{
+	public:
+		struct Stats
+		{
+			uint64_t Poses = 0;
+			uint64_t Bytes = 0;
+
+			float GetBytesPerPose() const { return Poses > 0 ? static_cast<float>(Bytes) / static_cast<float>(Poses) : 0.0f; }
+		};
+
+	public:
+		Recorder();
+		~Recorder();
+
+		bool Begin(const std::string &path, uint32_t generationIndex, uint32_t terrainSeed, int platformCount,
+		           const std::vector<CarProto> &carProtos, const std::vector<uint32_t> &carIds);
+		void End();
+
+		// Called once for each step a car is simulated, Finish stops its track
+		void Record(size_t carIndex, const CarPose &pose);
+		void Finish(size_t carIndex);
+
+		inline bool IsRecording() const { return m_File != nullptr; }
+		inline bool IsFinished(size_t carIndex) const { return m_Tracks[carIndex].Finished; }
+
+		inline const Stats &GetStats() const { return m_Stats; }
+
+	private:
+		void FlushChunk(size_t carIndex);
+		void FlushBuffer();
+
+	private:
+		struct Track
+		{
+			EncoderState State;
+			std::vector<uint8_t> Chunk;
+			uint32_t FirstStep = 0;
+			uint32_t NumSteps = 0;
+			uint8_t WheelCount = 0;
+			bool Finished = false;
+		};
+
+		FILE *m_File;
+		std::vector<Track> m_Tracks;
+		std::vector<uint8_t> m_Buffer;
+		Stats m_Stats;
+	};
+
+	// Reads a recording in place from a mapped file. Each car keeps only a
+	// cursor into the chunk it was last asked for, so playing forwards decodes
+	// a single pose per car and step, playing backwards a bounded few, and a
+	// jump to another chunk at most that chunk.
+	class Reader
+	{
+	public:
+		Reader();
+
+		// False for a file from another build, or one with a genome which
+		// fails Car::IsValidProto
+		bool Open(const std::string &path);
+		void Close();
+
+		inline bool IsOpen() const { return m_File.IsOpen(); }
+
+		inline const FileHeader &GetHeader() const { return m_Header; }
+		inline size_t GetNumCars() const { return m_Tracks.size(); }
+		inline const CarProto &GetProto(size_t carIndex) const { return m_CarProtos[carIndex]; }
+		inline uint32_t GetCarId(size_t carIndex) const { return m_CarIds[carIndex]; }
+
+		// Steps recorded for a car, and for the longest track
+		uint32_t GetTrackLength(size_t carIndex) const;
+		inline uint32_t GetNumSteps() const { return m_NumSteps; }
+
+		// Past the end of a car's track this is the last pose it was in. False
+		// for a car without a track, or a step in a chunk which is cut short or
+		// corrupt, the first of which is logged.
+		bool GetPose(size_t carIndex, uint32_t step, CarPose &pose);
+
+		// A track is corrupt once one of its chunks is out of order or fails
+		// to decode, a file is cut short when its last chunk is missing bytes
+		inline bool IsCorrupt(size_t carIndex) const { return m_Tracks[carIndex].Corrupt; }
+		size_t GetNumCorruptTracks() const;
+		inline bool IsTruncated() const { return m_Truncated; }
+
+	private:
+		struct TrackChunks
+		{
+			std::vector<Chunk> Chunks;
+			Cursor Decoder;
+			bool Corrupt = false;
+		};
+
+	private:
+		MappedFile m_File;
+		FileHeader m_Header;
+		std::vector<CarProto> m_CarProtos;
+		std::vector<uint32_t> m_CarIds;
+		std::vector<TrackChunks> m_Tracks;
+		uint32_t m_NumSteps;
+		bool m_Truncated;
+	};
+}
@@ -0,0 +1,152 @@
+#include "Test.h"
+#include "GenomeBatch.h"
+#include "JobSystem.h"
+
+#include <cstring>
+
+// The Breeder's children only depend on the parents and the stream, never
+// on how the batch is split into jobs or calls
+
+static constexpr size_t kNumParents = 2000;
+
+// Twice the job size, so a batch is split when there are workers
+static constexpr size_t kNumChildren = 8192;
+
+static bool SameChildren(const GenomeBatch &a, const GenomeBatch &b, size_t offset = 0)
+{
+	if (a.GetSize() + offset > b.GetSize() || a.HasControllers() != b.HasControllers())
+	{
+		return false;
+	}
+
+	bool genomes = std::memcmp(a.Genomes.data(), b.Genomes.data() + offset, a.GetSize() * sizeof(CarProto)) == 0;
+	bool controllers = !a.HasControllers()
+	                || std::memcmp(a.Controllers.data(), b.Controllers.data() + offset, a.GetSize() * sizeof(ControllerProto)) == 0;
+
+	return genomes && controllers;
+}
+
+int main()
+{
+	JobSystem::Create();
+	Random::Seed(1234);
+
+	// Every other parent has a controller, so the controller genes are bred
+	GenomeBatch parents;
+	parents.Resize(kNumParents, true);
+
+	RandomStream protoRandom = Random::MakeStream(Random::kPopulationStream);
+	for (size_t i = 0; i < kNumParents; i++)
+	{
+		CarProto carProto = Car::RandomProto(protoRandom);
+		ControllerProto controller;
+		if (i % 2 == 0)
+		{
+			Car::RandomController(carProto, controller, protoRandom);
+		}
+
+		parents.Set(i, carProto, &controller);
+	}
+
+	std::vector<uint32_t> parents1(kNumChildren), parents2(kNumChildren);
+	for (size_t i = 0; i < kNumChildren; i++)
+	{
+		parents1[i] = protoRandom.Int(0u, static_cast<uint32_t>(kNumParents - 1));
+		parents2[i] = protoRandom.Int(0u, static_cast<uint32_t>(kNumParents - 1));
+	}
+
+	Breeder breeder;
+	GenomeBatch expected;
+	RandomStream expectedRandom = Random::MakeStream(Random::kGenerationStream);
+	breeder.Breed(parents, parents1, parents2, expected, expectedRandom);
+
+	Test::Run("Same stream, same children", [&]()
+	{
+		GenomeBatch children;
+		RandomStream random = Random::MakeStream(Random::kGenerationStream);
+		breeder.Breed(parents, parents1, parents2, children, random);
+
+		BL_CHECK(SameChildren(children, expected));
+		BL_CHECK(random.GetCounter() == expectedRandom.GetCounter());
+	});
+
+	Test::Run("Any number of threads", [&]()
+	{
+		for (size_t numWorkers : { 0, 1, 3 })
+		{
+			JobSystem::Destroy();
+			JobSystem::Create(numWorkers);
+
+			GenomeBatch children;
+			RandomStream random = Random::MakeStream(Random::kGenerationStream);
+			breeder.Breed(parents, parents1, parents2, children, random);
+
+			BL_CHECK(SameChildren(children, expected));
+			BL_CHECK(random.GetCounter() == expectedRandom.GetCounter());
+		}
+
+		JobSystem::Destroy();
+		JobSystem::Create();
+	});
+
+	Test::Run("Two batches, one after another", [&]()
+	{
+		size_t split = kNumChildren / 3;
+
+		std::vector<uint32_t> first1(parents1.begin(), parents1.begin() + split);
+		std::vector<uint32_t> first2(parents2.begin(), parents2.begin() + split);
+		std::vector<uint32_t> second1(parents1.begin() + split, parents1.end());
+		std::vector<uint32_t> second2(parents2.begin() + split, parents2.end());
+
+		GenomeBatch first, second;
+		RandomStream random = Random::MakeStream(Random::kGenerationStream);
+		breeder.Breed(parents, first1, first2, first, random);
+		breeder.Breed(parents, second1, second2, second, random);
+
+		BL_CHECK(SameChildren(first, expected));
+		BL_CHECK(SameChildren(second, expected, split));
+		BL_CHECK(random.GetCounter() == expectedRandom.GetCounter());
+	});
+
+	Test::Run("Children are valid cars", [&]()
+	{
+		size_t numControlled = 0;
+
+		for (size_t i = 0; i < expected.GetSize(); i++)
+		{
+			const ControllerProto *controller = expected.GetController(i);
+
+			BL_CHECK(Car::IsValidProto(expected.Get(i)));
+			BL_CHECK(!controller || Car::IsValidController(*controller));
+
+			numControlled += controller ? 1 : 0;
+		}
+
+		// About half of them are drawn to take their parent's controller
+		BL_CHECK(numControlled > 0 && numControlled < expected.GetSize());
+	});
+
+	Test::Run("Without controllers", [&]()
+	{
+		GenomeBatch uncontrolled;
+		uncontrolled.Resize(kNumParents);
+		for (size_t i = 0; i < kNumParents; i++)
+		{
+			CarProto carProto = parents.Get(i);
+			carProto.Controlled = 0;
+			uncontrolled.Set(i, carProto);
+		}
+
+		GenomeBatch children;
+		RandomStream random = Random::MakeStream(Random::kGenerationStream);
+		breeder.Breed(uncontrolled, parents1, parents2, children, random);
+
+		BL_CHECK(!children.HasControllers());
+		BL_CHECK(std::none_of(children.Genomes.begin(), children.Genomes.end(),
+			[](const CarProto &carProto) { return carProto.Controlled != 0; }));
+	});
+
+	JobSystem::Destroy();
+
+	return Test::Finish();
+}
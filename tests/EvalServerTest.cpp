@@ -0,0 +1,143 @@
+#include "Test.h"
+#include "EvalServer.h"
+#include "JobSystem.h"
+
+#include <cmath>
+#include <cstring>
+
+// A batch sent over the protocol is answered exactly as the server answers
+// it in process, invalid genomes included
+
+static constexpr size_t kNumGenomes = 40;
+
+static bool SameResult(const EvalProtocol::Result &a, const EvalProtocol::Result &b)
+{
+	bool sameFitness = std::isnan(a.Fitness) ? std::isnan(b.Fitness) : a.Fitness == b.Fitness;
+
+	return sameFitness && a.SimulatedTime == b.SimulatedTime && a.Reason == b.Reason && a.Code == b.Code;
+}
+
+int main()
+{
+	JobSystem::Create();
+	Random::Seed(1234);
+
+	// Short runs, the cars only have to get going
+	EvalServerSettings settings;
+	settings.TerrainSeed = 1234;
+	settings.Kill.TimeLimit = 2.0f;
+	settings.MaxBatchSize = 64;
+
+	// A few with controllers, and one genome of each kind the server turns away
+	std::vector<CarProto> genomes(kNumGenomes);
+	std::vector<ControllerProto> controllers(kNumGenomes);
+
+	RandomStream random = Random::MakeStream(Random::kPopulationStream);
+	for (size_t i = 0; i < kNumGenomes; i++)
+	{
+		genomes[i] = Car::RandomProto(random);
+		if (i % 4 == 0)
+		{
+			Car::RandomController(genomes[i], controllers[i], random);
+		}
+	}
+
+	genomes[1].Density = -1.0f;
+	genomes[2].WheelCount = CarConstants::kNumVertices + 1;
+	genomes[3].Vertices.fill(b2Vec2_zero);
+	controllers[4].Weights[0] = 2.0f * CarConstants::kMaxControllerWeight;
+
+	std::vector<size_t> invalid = { 1, 2, 3, 4 };
+
+	// In process
+	std::vector<EvalProtocol::Result> expected(kNumGenomes);
+	std::vector<EvalProtocol::Summary> expectedSummaries(kNumGenomes);
+	{
+		EvalServer server;
+		server.Create(settings);
+		server.Evaluate(genomes.data(), controllers.data(), kNumGenomes, 0, expected.data(), expectedSummaries.data());
+
+		BL_CHECK(server.GetStats().InvalidGenomes == invalid.size());
+	}
+
+	Test::Run("Invalid genomes are errors", [&]()
+	{
+		for (size_t i = 0; i < kNumGenomes; i++)
+		{
+			bool isInvalid = std::find(invalid.begin(), invalid.end(), i) != invalid.end();
+
+			BL_CHECK(isInvalid == (expected[i].Code == EvalProtocol::ResultCode::InvalidGenome));
+			BL_CHECK(isInvalid == std::isnan(expected[i].Fitness));
+			BL_CHECK(isInvalid || expected[i].Code == EvalProtocol::ResultCode::Ok);
+		}
+	});
+
+	EvalClient client;
+	BL_CHECK(client.StartLocal(settings));
+
+	Test::Run("Round trips match the server in process", [&]()
+	{
+		std::vector<EvalProtocol::Result> results;
+		std::vector<EvalProtocol::Summary> summaries;
+
+		BL_CHECK(client.Evaluate(genomes.data(), controllers.data(), kNumGenomes, 0, true, results, summaries));
+		BL_CHECK(results.size() == kNumGenomes && summaries.size() == kNumGenomes);
+
+		for (size_t i = 0; i < std::min(results.size(), kNumGenomes); i++)
+		{
+			BL_CHECK(SameResult(results[i], expected[i]));
+		}
+
+		BL_CHECK(summaries.size() == kNumGenomes
+		      && std::memcmp(summaries.data(), expectedSummaries.data(), kNumGenomes * sizeof(EvalProtocol::Summary)) == 0);
+
+		// The next batch reuses the arenas, whose bodies box2d may order
+		// differently, so only what was valid is compared
+		BL_CHECK(client.Evaluate(genomes.data(), controllers.data(), kNumGenomes, 0, false, results, summaries));
+		BL_CHECK(results.size() == kNumGenomes && summaries.empty());
+
+		for (size_t i = 0; i < std::min(results.size(), kNumGenomes); i++)
+		{
+			BL_CHECK(results[i].Code == expected[i].Code);
+		}
+	});
+
+	Test::Run("Controllers are only read with the flag", [&]()
+	{
+		// Without the section a controlled genome has no controller
+		std::vector<EvalProtocol::Result> results;
+		std::vector<EvalProtocol::Summary> summaries;
+
+		BL_CHECK(client.Evaluate(genomes.data(), nullptr, kNumGenomes, 0, false, results, summaries));
+		BL_CHECK(results.size() == kNumGenomes && summaries.empty());
+
+		for (size_t i = 0; i < std::min(results.size(), kNumGenomes); i++)
+		{
+			bool isInvalid = genomes[i].Controlled || std::find(invalid.begin(), invalid.end(), i) != invalid.end();
+			BL_CHECK(isInvalid == (results[i].Code == EvalProtocol::ResultCode::InvalidGenome));
+		}
+	});
+
+	Test::Run("Batches over the limit are refused", [&]()
+	{
+		std::vector<CarProto> large(settings.MaxBatchSize + 1, genomes[0]);
+		std::vector<EvalProtocol::Result> results;
+		std::vector<EvalProtocol::Summary> summaries;
+
+		BL_CHECK(!client.Evaluate(large.data(), nullptr, large.size(), 0, false, results, summaries));
+	});
+
+	client.Close();
+
+	Test::Run("Quitting stops the server", [&]()
+	{
+		EvalClient quitting;
+		BL_CHECK(quitting.StartLocal(settings));
+		BL_CHECK(quitting.Quit());
+		quitting.Close();
+	});
+
+	JobSystem::Destroy();
+
+	return Test::Finish();
+}
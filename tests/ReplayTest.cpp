@@ -0,0 +1,79 @@
+#include "Test.h"
+#include "BenchmarkUtils.h"
+#include "JobSystem.h"
+
+#include <filesystem>
+
+// Every generation of a logged run reruns on its own to the same fitness,
+// also when the run asked for what a logged run has to do without
+
+static constexpr int kNumCars = 20;
+static constexpr int kNumGenerations = 3;
+
+// Logs a run and reruns each of its generations, which have to match
+static void CheckReplays(const GenerationSettings &settings)
+{
+	std::vector<uint64_t> logged;
+	{
+		Generation generation;
+		Benchmark::CreateGeneration(generation, settings);
+
+		BL_CHECK(generation.IsReplayable());
+		BL_CHECK(Benchmark::RunGenerations(generation, kNumGenerations - 1, logged));
+		BL_CHECK(logged.size() == kNumGenerations);
+	}
+
+	for (int g = 0; g < static_cast<int>(logged.size()); g++)
+	{
+		GenerationSettings replaySettings = settings;
+		replaySettings.RunLogPath.clear();
+		replaySettings.ReplayLogPath = settings.RunLogPath;
+		replaySettings.ReplayGeneration = g;
+
+		// Twice, a rerun does not depend on the one before it
+		for (int rerun = 0; rerun < 2; rerun++)
+		{
+			Generation generation;
+			generation.Create(replaySettings);
+
+			std::vector<uint64_t> checksums;
+			BL_CHECK(generation.GetGenerationIndex() == g);
+			BL_CHECK(Benchmark::RunGenerations(generation, g, checksums));
+			BL_CHECK(checksums.size() == 1 && checksums.front() == logged[g]);
+		}
+	}
+}
+
+int main()
+{
+	JobSystem::Create();
+
+	std::filesystem::path directory = std::filesystem::temp_directory_path() / "blobolution_replay_test";
+	std::filesystem::create_directories(directory);
+
+	// Short generations, the cars only have to get going
+	GenerationSettings settings = Benchmark::MakeSettings(kNumCars);
+	settings.Kill.TimeLimit = 5.0f;
+	settings.RunLogPath = (directory / "run.bllog").string();
+
+	Test::Run("Logged generations rerun exactly", [&]()
+	{
+		CheckReplays(settings);
+	});
+
+	Test::Run("A logged run ignores the cache and quorum", [&]()
+	{
+		GenerationSettings asked = settings;
+		asked.UseFitnessCache = true;
+		asked.BreedQuorum = 0.5f;
+
+		CheckReplays(asked);
+	});
+
+	std::error_code error;
+	std::filesystem::remove_all(directory, error);
+
+	JobSystem::Destroy();
+
+	return Test::Finish();
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdio>
+
+// What the tests are written with. A failed check is printed and the test
+// carries on, so one run shows every failure, and main returns Finish().
+namespace Test
+{
+	inline int s_Failures = 0;
+
+	inline void Run(const char *name, const std::function<void()> &test)
+	{
+		int failures = s_Failures;
+		test();
+
+		fprintf(stdout, "%-48s %s\n", name, s_Failures == failures ? "ok" : "FAILED");
+	}
+
+	inline int Finish()
+	{
+		return s_Failures == 0 ? 0 : 1;
+	}
+}
+
+#define BL_CHECK(condition)                                                   \
+do                                                                            \
+{                                                                             \
+	if (!(condition))                                                         \
+	{                                                                         \
+		fprintf(stdout, "[FAIL] %s:%d %s\n", __FILE__, __LINE__, #condition); \
+		Test::s_Failures++;                                                   \
+	}                                                                         \
+} while (0)
@@ -0,0 +1,297 @@
+#include "Test.h"
+#include "Trajectory.h"
+#include "Random.h"
+
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+
+// Recordings read back as they were written, within the quantisation, and
+// files which were cut short or damaged are reported rather than read past
+
+static constexpr uint32_t kLongTrack = 700;
+static constexpr uint32_t kShortTrack = 100;
+
+static CarPose MakeTestPose(size_t carIndex, uint32_t step)
+{
+	float t = static_cast<float>(step);
+
+	CarPose pose;
+	pose.Position = { 0.05f * t + static_cast<float>(carIndex), 2.0f + std::sin(0.03f * t) };
+	pose.Angle = 0.02f * t;
+	pose.Health = 100 - static_cast<int>(step / 10);
+	for (size_t w = 0; w < CarConstants::kNumVertices; w++)
+	{
+		pose.WheelAngles[w] = -0.03f * t * static_cast<float>(w + 1);
+	}
+
+	return pose;
+}
+
+static bool SameAngle(float a, float b)
+{
+	return std::abs(std::remainder(a - b, 6.28318530718f)) <= 1.0f / Trajectory::kAngleScale;
+}
+
+// Equal to the pose which was recorded within the quantisation
+static bool IsPose(const CarPose &pose, const CarProto &carProto, size_t carIndex, uint32_t step)
+{
+	CarPose expected = MakeTestPose(carIndex, step);
+
+	bool same =    std::abs(pose.Position.x - expected.Position.x) <= 1.0f / Trajectory::kPositionScale
+	            && std::abs(pose.Position.y - expected.Position.y) <= 1.0f / Trajectory::kPositionScale
+	            && SameAngle(pose.Angle, expected.Angle)
+	            && pose.Health == expected.Health;
+
+	for (uint8_t w = 0; w < carProto.WheelCount; w++)
+	{
+		same = same && SameAngle(pose.WheelAngles[w], expected.WheelAngles[w]);
+	}
+
+	return same;
+}
+
+static std::vector<uint8_t> ReadFile(const std::string &path)
+{
+	std::vector<uint8_t> bytes(std::filesystem::file_size(path));
+
+	FILE *file = std::fopen(path.c_str(), "rb");
+	size_t read = std::fread(bytes.data(), 1, bytes.size(), file);
+	std::fclose(file);
+
+	bytes.resize(read);
+	return bytes;
+}
+
+static void WriteFile(const std::string &path, const std::vector<uint8_t> &bytes)
+{
+	FILE *file = std::fopen(path.c_str(), "wb");
+	std::fwrite(bytes.data(), 1, bytes.size(), file);
+	std::fclose(file);
+}
+
+// Where the header of a car's nth chunk is in a file
+static size_t FindChunk(const std::vector<uint8_t> &bytes, size_t numCars, uint32_t carIndex, size_t nth)
+{
+	size_t offset = sizeof(Trajectory::FileHeader) + numCars * (sizeof(CarProto) + sizeof(uint32_t));
+
+	while (offset + sizeof(Trajectory::ChunkHeader) <= bytes.size())
+	{
+		Trajectory::ChunkHeader header;
+		std::memcpy(&header, bytes.data() + offset, sizeof(header));
+
+		if (header.CarIndex == carIndex && nth-- == 0)
+		{
+			return offset;
+		}
+
+		offset += sizeof(header) + header.ByteSize;
+	}
+
+	return 0;
+}
+
+int main()
+{
+	Random::Seed(1234);
+
+	// One car runs past a few chunks, one finishes in its first and one,
+	// as a cached car would, is never simulated
+	RandomStream random = Random::MakeStream(Random::kPopulationStream);
+	std::vector<CarProto> carProtos = { Car::RandomProto(random), Car::RandomProto(random), Car::RandomProto(random) };
+	std::vector<uint32_t> carIds = { 10, 11, 12 };
+
+	std::filesystem::path directory = std::filesystem::temp_directory_path() / "blobolution_trajectory_test";
+	std::filesystem::create_directories(directory);
+
+	std::string path = (directory / "recording.traj").string();
+	std::string damagedPath = (directory / "damaged.traj").string();
+
+	{
+		Trajectory::Recorder recorder;
+		BL_CHECK(recorder.Begin(path, 3, 1234, 10, carProtos, carIds));
+
+		for (uint32_t step = 0; step < kLongTrack; step++)
+		{
+			recorder.Record(0, MakeTestPose(0, step));
+
+			if (step < kShortTrack)
+			{
+				recorder.Record(1, MakeTestPose(1, step));
+			}
+			else if (step == kShortTrack)
+			{
+				recorder.Finish(1);
+			}
+		}
+
+		recorder.End();
+	}
+
+	std::vector<uint8_t> bytes = ReadFile(path);
+
+	Test::Run("Recordings read back", [&]()
+	{
+		Trajectory::Reader reader;
+		BL_CHECK(reader.Open(path));
+		BL_CHECK(reader.GetNumCars() == carProtos.size());
+		BL_CHECK(reader.GetHeader().GenerationIndex == 3 && reader.GetHeader().TerrainSeed == 1234);
+		BL_CHECK(reader.GetCarId(2) == 12);
+		BL_CHECK(std::memcmp(&reader.GetProto(1), &carProtos[1], sizeof(CarProto)) == 0);
+		BL_CHECK(reader.GetNumSteps() == kLongTrack);
+		BL_CHECK(reader.GetTrackLength(0) == kLongTrack && reader.GetTrackLength(1) == kShortTrack && reader.GetTrackLength(2) == 0);
+
+		CarPose pose;
+
+		// Forwards, backwards and jumping about
+		for (uint32_t step = 0; step < kLongTrack; step++)
+		{
+			BL_CHECK(reader.GetPose(0, step, pose) && IsPose(pose, carProtos[0], 0, step));
+		}
+		for (uint32_t step = kLongTrack; step-- > 0; )
+		{
+			BL_CHECK(reader.GetPose(0, step, pose) && IsPose(pose, carProtos[0], 0, step));
+		}
+		for (int i = 0; i < 200; i++)
+		{
+			uint32_t step = random.Int(0u, kLongTrack - 1);
+			BL_CHECK(reader.GetPose(0, step, pose) && IsPose(pose, carProtos[0], 0, step));
+		}
+
+		// Past the end of a track it stays where it finished
+		BL_CHECK(reader.GetPose(1, kLongTrack - 1, pose) && IsPose(pose, carProtos[1], 1, kShortTrack - 1));
+		BL_CHECK(!reader.GetPose(2, 0, pose));
+
+		BL_CHECK(reader.GetNumCorruptTracks() == 0 && !reader.IsTruncated());
+	});
+
+	Test::Run("Tracks kept in memory", [&]()
+	{
+		Trajectory::Track track;
+		track.Begin(carProtos[0]);
+		for (uint32_t step = 0; step < kLongTrack; step++)
+		{
+			track.Append(MakeTestPose(0, step));
+		}
+		track.Finish();
+
+		BL_CHECK(track.GetLength() == kLongTrack && track.IsFinished());
+
+		CarPose pose;
+		for (uint32_t step = kLongTrack; step-- > 0; )
+		{
+			BL_CHECK(track.GetPose(step, pose) && IsPose(pose, carProtos[0], 0, step));
+		}
+	});
+
+	Test::Run("Seeking outside the chunks", [&]()
+	{
+		static constexpr uint32_t kFirstStep = 10;
+
+		std::vector<uint8_t> data;
+		Trajectory::EncoderState state;
+		for (uint32_t step = kFirstStep; step < kFirstStep + 5; step++)
+		{
+			Trajectory::EncodePose(data, state, MakeTestPose(0, step), carProtos[0].WheelCount, step == kFirstStep);
+		}
+
+		std::vector<Trajectory::Chunk> chunks = { { kFirstStep, 5, 0, static_cast<uint32_t>(data.size()) } };
+		Trajectory::Cursor cursor;
+
+		BL_CHECK(!Trajectory::Seek(data.data(), {}, carProtos[0], 0, cursor));
+		BL_CHECK(!Trajectory::Seek(data.data(), chunks, carProtos[0], kFirstStep - 1, cursor));
+		BL_CHECK(Trajectory::Seek(data.data(), chunks, carProtos[0], kFirstStep + 2, cursor));
+		BL_CHECK(IsPose(cursor.Pose, carProtos[0], 0, kFirstStep + 2));
+	});
+
+	Test::Run("Files cut short", [&]()
+	{
+		std::vector<uint8_t> damaged(bytes.begin(), bytes.end() - 5);
+		WriteFile(damagedPath, damaged);
+
+		Trajectory::Reader reader;
+		BL_CHECK(reader.Open(damagedPath));
+		BL_CHECK(reader.IsTruncated());
+
+		// The chunks which are still whole read back
+		CarPose pose;
+		BL_CHECK(reader.GetPose(0, 0, pose) && IsPose(pose, carProtos[0], 0, 0));
+		for (uint32_t step = 0; step < kLongTrack; step++)
+		{
+			reader.GetPose(0, step, pose);
+		}
+		BL_CHECK(reader.GetNumCorruptTracks() == 0);
+	});
+
+	Test::Run("Chunks which fail to decode", [&]()
+	{
+		// Varints which never end, in car 0's first chunk
+		std::vector<uint8_t> damaged = bytes;
+		size_t chunk = FindChunk(damaged, carProtos.size(), 0, 0) + sizeof(Trajectory::ChunkHeader);
+		std::fill(damaged.begin() + chunk + 40, damaged.begin() + chunk + 80, 0xff);
+		WriteFile(damagedPath, damaged);
+
+		Trajectory::Reader reader;
+		BL_CHECK(reader.Open(damagedPath));
+
+		CarPose pose;
+		bool decoded = true;
+		for (uint32_t step = 0; step < Trajectory::kChunkSteps; step++)
+		{
+			decoded = decoded && reader.GetPose(0, step, pose);
+		}
+
+		BL_CHECK(!decoded);
+		BL_CHECK(reader.IsCorrupt(0) && !reader.IsCorrupt(1));
+		BL_CHECK(reader.GetPose(1, 0, pose) && IsPose(pose, carProtos[1], 1, 0));
+	});
+
+	Test::Run("Chunks out of order", [&]()
+	{
+		std::vector<uint8_t> damaged = bytes;
+		size_t chunk = FindChunk(damaged, carProtos.size(), 0, 1);
+
+		Trajectory::ChunkHeader header;
+		std::memcpy(&header, damaged.data() + chunk, sizeof(header));
+		header.FirstStep += 1;
+		std::memcpy(damaged.data() + chunk, &header, sizeof(header));
+		WriteFile(damagedPath, damaged);
+
+		// The track stops before the chunk which does not follow on
+		Trajectory::Reader reader;
+		BL_CHECK(reader.Open(damagedPath));
+		BL_CHECK(reader.IsCorrupt(0));
+		BL_CHECK(reader.GetTrackLength(0) == Trajectory::kChunkSteps);
+
+		CarPose pose;
+		BL_CHECK(reader.GetPose(0, 10, pose) && IsPose(pose, carProtos[0], 0, 10));
+	});
+
+	Test::Run("Genomes the server would turn away", [&]()
+	{
+		auto openWith = [&](const std::function<void(CarProto &)> &damage)
+		{
+			std::vector<uint8_t> damaged = bytes;
+			uint8_t *proto = damaged.data() + sizeof(Trajectory::FileHeader);
+
+			CarProto carProto;
+			std::memcpy(&carProto, proto, sizeof(CarProto));
+			damage(carProto);
+			std::memcpy(proto, &carProto, sizeof(CarProto));
+			WriteFile(damagedPath, damaged);
+
+			Trajectory::Reader reader;
+			return reader.Open(damagedPath);
+		};
+
+		BL_CHECK(openWith([](CarProto &) {}));
+		BL_CHECK(!openWith([](CarProto &carProto) { carProto.WheelCount = CarConstants::kNumVertices + 1; }));
+		BL_CHECK(!openWith([](CarProto &carProto) { carProto.WheelVertices[0] = CarConstants::kNumVertices; }));
+		BL_CHECK(!openWith([](CarProto &carProto) { carProto.Vertices[0].x = NAN; }));
+	});
+
+	std::error_code error;
+	std::filesystem::remove_all(directory, error);
+
+	return Test::Finish();
+}